@@ -11,6 +11,7 @@
 #include "runtime/function/input/input_system.h"
 
 #include "runtime/function/render/render_camera.h"
+#include "runtime/function/render/pathtracing/path_tracer.h"
 #include "runtime/function/render/render_system.h"
 #include "runtime/function/render/window_system.h"
 
@@ -220,6 +221,17 @@ namespace MiniEngine
             m_mouse_x = xpos;
             m_mouse_y = ypos;
         }
+        else if (g_runtime_global_context.m_render_system->getPathTracer()->init_info->Progressive)
+        {
+            // the progressive path tracer restarts whenever the camera moves, so it can look around
+            if (m_mouse_x >= 0.0f && m_mouse_y >= 0.0f &&
+                g_editor_global_context.m_window_system->isMouseButtonDown(GLFW_MOUSE_BUTTON_RIGHT))
+            {
+                m_camera->processMouseMovement(xpos - m_mouse_x, m_mouse_y - ypos);
+            }
+            m_mouse_x = xpos;
+            m_mouse_y = ypos;
+        }
     }
 
     void EditorInputManager::onCursorEnter(int entered)
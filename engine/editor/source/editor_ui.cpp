@@ -23,6 +23,7 @@
 #include "runtime/function/render/render_camera.h"
 #include "runtime/function/render/render_system.h"
 #include "runtime/function/render/window_system.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh_cache.h"
 #include "runtime/function/render/rtr/loader/assimpLoader.h"
 #include "runtime/function/render/rtr/loader/textureLoader.h"
 #include "runtime/function/render/rtr/loader/cubeTextureLoader.h"
@@ -732,20 +733,69 @@ namespace MiniEngine
 
         if (ImGui::TreeNode("Offline Rendering"))
         {
+            // a widget returns true on the frame its value changes
+            bool changed = false;
+            // the film and the texture are sized when a render starts, so the resolution is not
+            // a change a running render could pick up
             ImGui::Text("Resolution");
             ImGui::DragInt("Width", &m_rendering_init_info->Resolution.x, 1.f, 1.f, 4096.f, "%d", ImGuiSliderFlags_AlwaysClamp);
             ImGui::DragInt("Height", &m_rendering_init_info->Resolution.y, 1.f, 1.f, 4096.f, "%d", ImGuiSliderFlags_AlwaysClamp);
 
             ImGui::Text("Ray Tracing");
-            ImGui::DragInt("Sample Count", &m_rendering_init_info->SampleCount, 1.f, 1.f, 1048576.f, "%d", ImGuiSliderFlags_AlwaysClamp);
-            ImGui::DragInt("Bounce Limit", &m_rendering_init_info->BounceLimit, 1.f, 1.f, 1024.f, "%d", ImGuiSliderFlags_AlwaysClamp);
-            ImGui::Checkbox("Impotance Samling", &m_rendering_init_info->ImportSample);
-            ImGui::Checkbox("BVH", &m_rendering_init_info->BVH);
-            ImGui::Checkbox("Multi-Thread", &m_rendering_init_info->MultiThread);
-            ImGui::Checkbox("Denoise", &m_rendering_init_info->Denoise);
+            changed |= ImGui::DragInt("Sample Count", &m_rendering_init_info->SampleCount, 1.f, 1.f, 1048576.f, "%d", ImGuiSliderFlags_AlwaysClamp);
+            changed |= ImGui::Checkbox("Adaptive Sampling", &m_rendering_init_info->Adaptive);
+            if (m_rendering_init_info->Adaptive)
+            {
+                changed |= ImGui::DragInt("Min Samples", &m_rendering_init_info->AdaptiveMinSamples, 1.f, 2.f, 1048576.f, "%d", ImGuiSliderFlags_AlwaysClamp);
+                changed |= ImGui::DragFloat("Error Threshold", &m_rendering_init_info->AdaptiveThreshold, 0.001f, 0.001f, 1.f, "%.3f", ImGuiSliderFlags_AlwaysClamp);
+                changed |= ImGui::Checkbox("Sample Heatmap", &m_rendering_init_info->SampleHeatmap);
+            }
+            changed |= ImGui::DragInt("Bounce Limit", &m_rendering_init_info->BounceLimit, 1.f, 1.f, 1024.f, "%d", ImGuiSliderFlags_AlwaysClamp);
+            changed |= ImGui::DragInt("Roulette Depth", &m_rendering_init_info->RouletteDepth, 1.f, 1.f, 1024.f, "%d", ImGuiSliderFlags_AlwaysClamp);
+            changed |= ImGui::Checkbox("Impotance Samling", &m_rendering_init_info->ImportSample);
+            if (m_rendering_init_info->ImportSample)
+            {
+                changed |= ImGui::Checkbox("Light BVH", &m_rendering_init_info->LightBVH);
+            }
+            changed |= ImGui::DragInt("Seed", &m_rendering_init_info->Seed, 1.f, 0.f, 2147483647.f, "%d", ImGuiSliderFlags_AlwaysClamp);
+            changed |= ImGui::Checkbox("Sobol Sampler", &m_rendering_init_info->LowDiscrepancy);
+            changed |= ImGui::Checkbox("Mip Mapping", &m_rendering_init_info->MipMapping);
+            changed |= ImGui::Checkbox("BVH", &m_rendering_init_info->BVH);
+            if (m_rendering_init_info->BVH)
+            {
+                changed |= ImGui::Checkbox("SAH", &m_rendering_init_info->SAH);
+                if (m_rendering_init_info->SAH)
+                {
+                    changed |= ImGui::DragInt("Leaf Size", &m_rendering_init_info->LeafSize, 1.f, 1.f, 64.f, "%d", ImGuiSliderFlags_AlwaysClamp);
+                    changed |= ImGui::DragFloat("Traversal Cost", &m_rendering_init_info->TraversalCost, 0.05f, 0.f, 16.f, "%.2f", ImGuiSliderFlags_AlwaysClamp);
+                }
+                changed |= ImGui::Checkbox("SIMD", &m_rendering_init_info->SIMD);
+                changed |= ImGui::Checkbox("Cache on Disk", &m_rendering_init_info->CacheBVH);
+                // the cache keeps the most recently used BVHs up to BVHCache::DefaultMaxSize on its own
+                ImGui::SameLine();
+                if (ImGui::Button("Clear"))
+                {
+                    PathTracing::BVHCache().clear();
+                }
+            }
+            changed |= ImGui::Checkbox("Multi-Thread", &m_rendering_init_info->MultiThread);
+            changed |= ImGui::Checkbox("Denoise", &m_rendering_init_info->Denoise);
+            changed |= ImGui::Checkbox("ACES Tone Mapping", &m_rendering_init_info->ToneMapping);
+            changed |= ImGui::Checkbox("Progressive", &m_rendering_init_info->Progressive);
+            if (m_rendering_init_info->Progressive)
+            {
+                changed |= ImGui::DragFloat("Frame Budget (ms)", &m_rendering_init_info->FrameBudget, 1.f, 1.f, 1000.f, "%.0f", ImGuiSliderFlags_AlwaysClamp);
+            }
+
+            // a running progressive render picks the new settings up at its next frame
+            if (changed && m_rendering_init_info->Progressive)
+            {
+                g_editor_global_context.m_render_system->getPathTracer()->publishSettings();
+            }
 
             ImGui::Text("Output");
             ImGui::Checkbox("Render to Disk", &m_rendering_init_info->Output);
+            ImGui::Checkbox("HDR (.pfm)", &m_rendering_init_info->OutputHDR);
             static char buf[128] = "";
             if (ImGui::InputText("..", buf, 128))
             {
@@ -773,6 +823,41 @@ namespace MiniEngine
             ImGui::Spacing();
         }
 
+        if (ImGui::TreeNode("Path Tracer Statistics"))
+        {
+            // live while a render runs, the last render's afterwards
+            PathTracing::RenderStatistics stats = g_editor_global_context.m_render_system->getPathTracer()->getStatistics();
+            auto megabytes = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+            double per_sample = stats.camera_samples > 0 ? 1.0 / stats.camera_samples : 0.0;
+
+            ImGui::Text("Memory");
+            ImGui::Text("  Primitives      %8.2f MB", megabytes(stats.primitive_bytes));
+            ImGui::Text("  BVH Nodes       %8.2f MB", megabytes(stats.bvh_bytes));
+            ImGui::Text("  Lights          %8.2f MB", megabytes(stats.light_bytes));
+            ImGui::Text("  Textures        %8.2f MB (%d files)", megabytes(stats.texture_bytes), stats.textures);
+            ImGui::Text("  Films           %8.2f MB", megabytes(stats.film_bytes));
+            ImGui::Text("  Total           %8.2f MB (%d materials)", megabytes(stats.getTotalBytes()), stats.materials);
+
+            ImGui::Text("Work (per sample)");
+            ImGui::Text("  Camera Samples  %lld", stats.camera_samples);
+            ImGui::Text("  Rays            %lld (%.2f)", stats.rays, stats.rays * per_sample);
+            ImGui::Text("  Nodes Visited   %lld (%.2f)", stats.nodes_visited, stats.nodes_visited * per_sample);
+            ImGui::Text("  Triangle Tests  %lld (%.2f)", stats.triangle_tests, stats.triangle_tests * per_sample);
+            ImGui::Text("  Path Length     %.2f", stats.getAveragePathLength());
+            ImGui::Text("  Roulette Kills  %lld (%.2f)", stats.roulette_terminations, stats.roulette_terminations * per_sample);
+
+            ImGui::Text("Time");
+            ImGui::Text("  Transfer        %8.3f s", stats.transfer_time);
+            ImGui::Text("  Build           %8.3f s", stats.build_time);
+            ImGui::Text("  Trace           %8.3f s (%.2f Mrays/s)", stats.trace_time, stats.trace_time > 0 ? stats.rays / stats.trace_time / 1e6 : 0.0);
+            ImGui::Text("  Denoise         %8.3f s", stats.denoise_time);
+            ImGui::Text("  Write           %8.3f s", stats.write_time);
+            ImGui::Text("  Total           %8.3f s", stats.total_time);
+
+            ImGui::TreePop();
+            ImGui::Spacing();
+        }
+
         ImGui::End();
     }
 
@@ -896,15 +981,22 @@ namespace MiniEngine
                         ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Building BVH...");
                         break;
                     case 2:
-                        ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Rendering (%.2f%%)...", 
-                                                  g_editor_global_context.m_render_system->getPathTracer()->progress);
+                        if (m_rendering_init_info->Progressive)
+                            ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Progressive: %d spp, frame %d (WASD and right drag move the camera)",
+                                                      g_editor_global_context.m_render_system->getPathTracer()->accumulated_samples.load(),
+                                                      g_editor_global_context.m_render_system->getPathTracer()->frame_count.load());
+                        else
+                            ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Rendering (%.2f%%)...", 
+                                                      g_editor_global_context.m_render_system->getPathTracer()->progress.load());
                         break;
                     case 3:
                         ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), "Denoising...");
                         break;
                     case 4:
-                        ImGui::TextColored(ImVec4(0.5f, 1.f, 0.5f, 1.0f), "Rendering is completed in %.2fs!", 
-                                                  g_editor_global_context.m_render_system->getPathTracer()->render_time);
+                        ImGui::TextColored(ImVec4(0.5f, 1.f, 0.5f, 1.0f), "Rendering is completed in %.2fs! (BVH %.3fs, SAH cost %.2f)", 
+                                                  g_editor_global_context.m_render_system->getPathTracer()->render_time,
+                                                  g_editor_global_context.m_render_system->getPathTracer()->bvh_build_time,
+                                                  g_editor_global_context.m_render_system->getPathTracer()->bvh_sah_cost);
                         break;
                     default:
                         break;
@@ -955,7 +1047,15 @@ namespace MiniEngine
             }
             else
             {
-                if (g_editor_global_context.m_render_system->getPathTracer()->state == 2)
+                if (g_editor_global_context.m_render_system->getPathTracer()->state == 2 && m_rendering_init_info->Progressive)
+                {
+                    // stopping is how a progressive render ends, it saves what it has accumulated
+                    if (ImGui::Button(" Stop "))
+                    {
+                        g_editor_global_context.m_render_system->getPathTracer()->should_stop_tracing = true;
+                    }
+                }
+                else if (g_editor_global_context.m_render_system->getPathTracer()->state == 2)
                 {
                     if (ImGui::Button(" Stop "))
                     {
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cfloat>
+#include <cstdint>
 #include <random>
 
 namespace MiniEngine
@@ -96,5 +97,52 @@ namespace MiniEngine
         ResultType next() { return (*m_dist)(m_engine); }
     };
 
+    // PCG32 (O'Neill, pcg-random.org): a 64 bit LCG with a permuted 32 bit output.
+    // Tiny state and cheap seeding, so one engine per pixel sample is affordable.
+    // Streams with different increments never overlap.
+    class PCG32
+    {
+    private:
+        uint64_t m_state;
+        uint64_t m_inc;
+
+    public:
+        using result_type = uint32_t;
+
+        static constexpr uint64_t DefaultState  = 0x853c49e6748fea9bULL;
+        static constexpr uint64_t DefaultStream = 0xda3e39cb94b95bdbULL;
+
+        explicit PCG32(uint64_t state = DefaultState, uint64_t stream = DefaultStream) { seed(state, stream); }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return UINT32_MAX; }
+
+        void seed(uint64_t state, uint64_t stream = DefaultStream)
+        {
+            m_state = 0;
+            m_inc   = (stream << 1u) | 1u;
+            (*this)();
+            m_state += state;
+            (*this)();
+        }
+
+        result_type operator()()
+        {
+            uint64_t old_state = m_state;
+            m_state            = old_state * 6364136223846793005ULL + m_inc;
+
+            uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+            uint32_t rot        = static_cast<uint32_t>(old_state >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+        }
+
+        void discard(unsigned long long n)
+        {
+            while (n--)
+                (*this)();
+        }
+    };
+
     using DefaultRNG = RandomNumberGenerator<std::mt19937>;
+    using PCGRNG     = RandomNumberGenerator<PCG32>;
 } // namespace Chaos
@@ -33,6 +33,12 @@ namespace MiniEngine::PathTracing
             return true;
         }
 
+        float surfaceArea() const
+        {
+            vec3 d = max - min;
+            return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
         static AABB getSurroundingBox(AABB box0, AABB box1)
         {
             vec3 small(fmin(box0.min.x, box1.min.x),
@@ -18,7 +18,7 @@ namespace MiniEngine::PathTracing
         {
             auto objects = src_objects; // Create a modifiable array of the source scene objects
 
-            int axis = static_cast<int>(linearRand(0, 3));
+            int axis = std::min(static_cast<int>(randomFloat(0, 3)), 2);
             auto comparator = (axis == 0)   ? compareX
                               : (axis == 1) ? compareY
                                             : compareZ;
@@ -60,6 +60,7 @@ namespace MiniEngine::PathTracing
         }
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
         virtual bool aabb(AABB &bounding_box) const override;
 
     private:
@@ -107,4 +108,12 @@ namespace MiniEngine::PathTracing
         return hit_left || hit_right;
     }
 
+    bool BVH::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        if (!box.hit(r, t_min, t_max))
+            return false;
+
+        return left->occluded(r, t_min, t_max) || right->occluded(r, t_min, t_max);
+    }
+
 }
@@ -0,0 +1,458 @@
+#include "runtime/function/render/pathtracing/acc_struct/bvh4.h"
+#include "runtime/function/render/pathtracing/common/render_statistics.h"
+
+#include <chrono>
+
+#ifdef PATH_TRACING_SSE
+#include <emmintrin.h>
+#endif
+
+namespace MiniEngine::PathTracing
+{
+    namespace
+    {
+        struct StackEntry
+        {
+            int32_t index;
+            int32_t count; // > 0 for leaves
+            float t;
+        };
+
+        // ray data shared by every node and triangle test of one traversal
+        struct RayPacket
+        {
+            vec3 origin;
+            vec3 direction;
+            vec3 inv_direction;
+            int near_offset[3]; // which of min/max is the entry plane per axis
+        };
+
+        // triangles in a leaf of count blocks, only its last block can have padding lanes
+        inline int leafTriangles(const Triangle4 *leaf_blocks, int count)
+        {
+            const Triangle4 &last = leaf_blocks[count - 1];
+            return 4 * (count - 1) + (last.id[0] >= 0) + (last.id[1] >= 0) + (last.id[2] >= 0) + (last.id[3] >= 0);
+        }
+
+        // returns a bit mask of the children hit by the ray and their entry distances
+        inline int intersectChildren(const BVH4Node &node, const RayPacket &ray, float t_min, float t_max, float t_near[4])
+        {
+            const float *planes_x[2] = {node.min_x, node.max_x};
+            const float *planes_y[2] = {node.min_y, node.max_y};
+            const float *planes_z[2] = {node.min_z, node.max_z};
+
+#ifdef PATH_TRACING_SSE
+            __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+            __m128 ix = _mm_set1_ps(ray.inv_direction.x), iy = _mm_set1_ps(ray.inv_direction.y), iz = _mm_set1_ps(ray.inv_direction.z);
+
+            __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes_x[ray.near_offset[0]]), ox), ix);
+            __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes_x[1 - ray.near_offset[0]]), ox), ix);
+            __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes_y[ray.near_offset[1]]), oy), iy);
+            __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes_y[1 - ray.near_offset[1]]), oy), iy);
+            __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes_z[ray.near_offset[2]]), oz), iz);
+            __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes_z[1 - ray.near_offset[2]]), oz), iz);
+
+            // min/max return the second operand for NaN (0 * inf), so the slab results go first
+            __m128 t0 = _mm_max_ps(tz0, _mm_max_ps(ty0, _mm_max_ps(tx0, _mm_set1_ps(t_min))));
+            __m128 t1 = _mm_min_ps(tz1, _mm_min_ps(ty1, _mm_min_ps(tx1, _mm_set1_ps(t_max))));
+
+            _mm_storeu_ps(t_near, t0);
+            return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+#else
+            int mask = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                float t0 = t_min, t1 = t_max;
+                float near_x = planes_x[ray.near_offset[0]][i], far_x = planes_x[1 - ray.near_offset[0]][i];
+                float near_y = planes_y[ray.near_offset[1]][i], far_y = planes_y[1 - ray.near_offset[1]][i];
+                float near_z = planes_z[ray.near_offset[2]][i], far_z = planes_z[1 - ray.near_offset[2]][i];
+
+                t0 = fmax((near_x - ray.origin.x) * ray.inv_direction.x, t0);
+                t1 = fmin((far_x - ray.origin.x) * ray.inv_direction.x, t1);
+                t0 = fmax((near_y - ray.origin.y) * ray.inv_direction.y, t0);
+                t1 = fmin((far_y - ray.origin.y) * ray.inv_direction.y, t1);
+                t0 = fmax((near_z - ray.origin.z) * ray.inv_direction.z, t0);
+                t1 = fmin((far_z - ray.origin.z) * ray.inv_direction.z, t1);
+
+                t_near[i] = t0;
+                if (t0 <= t1)
+                    mask |= 1 << i;
+            }
+            return mask;
+#endif
+        }
+
+        // Moller-Trumbore for four triangles, same arithmetic as TriangleMesh::intersect
+        inline int intersectBlock(const Triangle4 &block, const RayPacket &ray, float t_min, float t_max, float t[4], float u[4], float v[4])
+        {
+#ifdef PATH_TRACING_SSE
+            __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+            __m128 e1x = _mm_load_ps(block.e1_x), e1y = _mm_load_ps(block.e1_y), e1z = _mm_load_ps(block.e1_z);
+            __m128 e2x = _mm_load_ps(block.e2_x), e2y = _mm_load_ps(block.e2_y), e2z = _mm_load_ps(block.e2_z);
+
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+            __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, qx), _mm_mul_ps(e1y, qy)), _mm_mul_ps(e1z, qz));
+            __m128 f = _mm_div_ps(_mm_set1_ps(1.f), a);
+
+            __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.v0_x));
+            __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.v0_y));
+            __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.v0_z));
+
+            __m128 uu = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, qx), _mm_mul_ps(sy, qy)), _mm_mul_ps(sz, qz)));
+
+            __m128 kx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            __m128 ky = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            __m128 kz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+            __m128 vv = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, kx), _mm_mul_ps(dy, ky)), _mm_mul_ps(dz, kz)));
+            __m128 tt = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, kx), _mm_mul_ps(e2y, ky)), _mm_mul_ps(e2z, kz)));
+
+            __m128 abs_a = _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+            __m128 zero = _mm_setzero_ps();
+            __m128 valid = _mm_cmpge_ps(abs_a, _mm_set1_ps(EPS * EPS));
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, zero));
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.f)));
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(tt, _mm_set1_ps(t_min)));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(tt, _mm_set1_ps(t_max)));
+
+            _mm_storeu_ps(t, tt);
+            _mm_storeu_ps(u, uu);
+            _mm_storeu_ps(v, vv);
+            return _mm_movemask_ps(valid);
+#else
+            int mask = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                vec3 edge1(block.e1_x[i], block.e1_y[i], block.e1_z[i]);
+                vec3 edge2(block.e2_x[i], block.e2_y[i], block.e2_z[i]);
+
+                vec3 q = cross(ray.direction, edge2);
+                float a = dot(edge1, q);
+                if (fabs(a) < EPS * EPS)
+                    continue;
+
+                float f = 1.f / a;
+                vec3 s = ray.origin - vec3(block.v0_x[i], block.v0_y[i], block.v0_z[i]);
+                u[i] = f * dot(s, q);
+                vec3 k = cross(s, edge1);
+                v[i] = f * dot(ray.direction, k);
+                t[i] = f * dot(edge2, k);
+
+                if (u[i] >= 0 && v[i] >= 0 && u[i] + v[i] <= 1 && t[i] >= t_min && t[i] <= t_max)
+                    mask |= 1 << i;
+            }
+            return mask;
+#endif
+        }
+    }
+
+    bool BVH4::isSupported()
+    {
+        // PATH_TRACING_SSE is only defined when the compiler targets SSE2, which every x86-64
+        // cpu has, so there is nothing left to check at run time
+#ifdef PATH_TRACING_SSE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    BVH4::BVH4(TriangleMesh mesh, const BVHBuildParams &build_params)
+    {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        vector<AABB> boxes(mesh.size());
+        for (int i = 0; i < mesh.size(); i++)
+        {
+            boxes[i] = mesh.bounds(i);
+        }
+
+        BVHBuilder builder;
+        builder.build(boxes, build_params);
+        sah_cost = builder.sah_cost;
+
+        triangles = std::move(mesh);
+        triangles.reorder(builder.order);
+
+        if (!builder.nodes.empty())
+        {
+            bounds = builder.nodes[0].box;
+            nodes.reserve(builder.nodes.size() / 2 + 1);
+            blocks.reserve(triangles.size() / 2 + 1);
+            collapse(builder.nodes, 0);
+        }
+
+        std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+        build_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time).count();
+    }
+
+    int BVH4::packLeaf(const BVHBuildNode &leaf)
+    {
+        int first_block = blocks.size();
+
+        for (int start = leaf.first; start < leaf.first + leaf.count; start += 4)
+        {
+            Triangle4 block;
+            for (int lane = 0; lane < 4; lane++)
+            {
+                int id = start + lane;
+                bool valid = id < leaf.first + leaf.count;
+
+                // padding lanes get zero edges, which the determinant test rejects
+                block.v0_x[lane] = valid ? triangles.v0_x[id] : 0.f;
+                block.v0_y[lane] = valid ? triangles.v0_y[id] : 0.f;
+                block.v0_z[lane] = valid ? triangles.v0_z[id] : 0.f;
+                block.e1_x[lane] = valid ? triangles.e1_x[id] : 0.f;
+                block.e1_y[lane] = valid ? triangles.e1_y[id] : 0.f;
+                block.e1_z[lane] = valid ? triangles.e1_z[id] : 0.f;
+                block.e2_x[lane] = valid ? triangles.e2_x[id] : 0.f;
+                block.e2_y[lane] = valid ? triangles.e2_y[id] : 0.f;
+                block.e2_z[lane] = valid ? triangles.e2_z[id] : 0.f;
+                block.id[lane] = valid ? id : -1;
+            }
+            blocks.push_back(block);
+        }
+
+        return first_block;
+    }
+
+    int BVH4::collapse(const vector<BVHBuildNode> &build_nodes, int build_id)
+    {
+        // open the largest interior children until there are four of them
+        int children[4];
+        int child_count = 0;
+
+        const BVHBuildNode &root = build_nodes[build_id];
+        if (root.isLeaf())
+        {
+            children[child_count++] = build_id;
+        }
+        else
+        {
+            children[child_count++] = root.left;
+            children[child_count++] = root.right;
+        }
+
+        while (child_count < 4)
+        {
+            int largest = -1;
+            float largest_area = -1.f;
+            for (int i = 0; i < child_count; i++)
+            {
+                const BVHBuildNode &child = build_nodes[children[i]];
+                if (!child.isLeaf() && child.box.surfaceArea() > largest_area)
+                {
+                    largest = i;
+                    largest_area = child.box.surfaceArea();
+                }
+            }
+
+            if (largest < 0)
+                break;
+
+            const BVHBuildNode &opened = build_nodes[children[largest]];
+            children[largest] = opened.left;
+            children[child_count++] = opened.right;
+        }
+
+        int id = nodes.size();
+        nodes.push_back(BVH4Node());
+
+        for (int i = 0; i < 4; i++)
+        {
+            BVH4Node &node = nodes[id];
+
+            if (i >= child_count)
+            {
+                // empty slot, inverted bounds never pass the slab test
+                node.min_x[i] = node.min_y[i] = node.min_z[i] = INF;
+                node.max_x[i] = node.max_y[i] = node.max_z[i] = -INF;
+                node.child[i] = 0;
+                node.count[i] = -1;
+                continue;
+            }
+
+            const BVHBuildNode &child = build_nodes[children[i]];
+            node.min_x[i] = child.box.min.x, node.min_y[i] = child.box.min.y, node.min_z[i] = child.box.min.z;
+            node.max_x[i] = child.box.max.x, node.max_y[i] = child.box.max.y, node.max_z[i] = child.box.max.z;
+
+            int child_index;
+            int count;
+            if (child.isLeaf())
+            {
+                child_index = packLeaf(child);
+                count = (child.count + 3) / 4;
+            }
+            else
+            {
+                // the recursion grows 'nodes', so 'node' is looked up again afterwards
+                child_index = collapse(build_nodes, children[i]);
+                count = 0;
+            }
+
+            nodes[id].child[i] = child_index;
+            nodes[id].count[i] = count;
+        }
+
+        return id;
+    }
+
+    bool BVH4::aabb(AABB &bounding_box) const
+    {
+        if (nodes.empty())
+            return false;
+
+        bounding_box = bounds;
+        return true;
+    }
+
+    bool BVH4::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (nodes.empty())
+            return false;
+
+        TraversalScope counters;
+
+        RayPacket ray;
+        ray.origin = r.origin;
+        ray.direction = r.direction;
+        ray.inv_direction = 1.f / r.direction;
+        for (int a = 0; a < 3; a++)
+        {
+            ray.near_offset[a] = ray.inv_direction[a] < 0 ? 1 : 0;
+        }
+
+        StackEntry stack[MaxStackDepth];
+        int stack_size = 0;
+        stack[stack_size++] = {0, 0, t_min};
+
+        int closest = -1;
+        float closest_u, closest_v;
+
+        while (stack_size > 0)
+        {
+            StackEntry entry = stack[--stack_size];
+            if (entry.t > t_max)
+                continue;
+
+            if (entry.count > 0)
+            {
+                counters.triangle_tests += leafTriangles(&blocks[entry.index], entry.count);
+                for (int b = entry.index; b < entry.index + entry.count; b++)
+                {
+                    float t[4], u[4], v[4];
+                    int mask = intersectBlock(blocks[b], ray, t_min, t_max, t, u, v);
+                    for (int lane = 0; mask; lane++, mask >>= 1)
+                    {
+                        if ((mask & 1) && t[lane] <= t_max)
+                        {
+                            closest = blocks[b].id[lane];
+                            closest_u = u[lane];
+                            closest_v = v[lane];
+                            t_max = t[lane];
+                        }
+                    }
+                }
+                continue;
+            }
+
+            const BVH4Node &node = nodes[entry.index];
+            counters.nodes_visited++;
+            float t_near[4];
+            int mask = intersectChildren(node, ray, t_min, t_max, t_near);
+
+            // sort the hit children far to near so the nearest one is popped first
+            StackEntry hits[4];
+            int hit_count = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if (!(mask & (1 << i)) || node.count[i] < 0)
+                    continue;
+
+                StackEntry hit_entry = {node.child[i], node.count[i], t_near[i]};
+                int j = hit_count++;
+                while (j > 0 && hits[j - 1].t < hit_entry.t)
+                {
+                    hits[j] = hits[j - 1];
+                    j--;
+                }
+                hits[j] = hit_entry;
+            }
+
+            for (int i = 0; i < hit_count; i++)
+            {
+                stack[stack_size++] = hits[i];
+            }
+        }
+
+        if (closest < 0)
+            return false;
+
+        triangles.fillHitRecord(closest, r, t_max, closest_u, closest_v, rec);
+        return true;
+    }
+
+    bool BVH4::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        if (nodes.empty())
+            return false;
+
+        TraversalScope counters;
+
+        RayPacket ray;
+        ray.origin = r.origin;
+        ray.direction = r.direction;
+        ray.inv_direction = 1.f / r.direction;
+        for (int a = 0; a < 3; a++)
+        {
+            ray.near_offset[a] = ray.inv_direction[a] < 0 ? 1 : 0;
+        }
+
+        StackEntry stack[MaxStackDepth];
+        int stack_size = 0;
+        stack[stack_size++] = {0, 0, t_min};
+
+        while (stack_size > 0)
+        {
+            StackEntry entry = stack[--stack_size];
+
+            if (entry.count > 0)
+            {
+                counters.triangle_tests += leafTriangles(&blocks[entry.index], entry.count);
+                for (int b = entry.index; b < entry.index + entry.count; b++)
+                {
+                    float t[4], u[4], v[4];
+                    if (intersectBlock(blocks[b], ray, t_min, t_max, t, u, v))
+                        return true;
+                }
+                continue;
+            }
+
+            const BVH4Node &node = nodes[entry.index];
+            counters.nodes_visited++;
+            float t_near[4];
+            int mask = intersectChildren(node, ray, t_min, t_max, t_near);
+
+            // t_max never shrinks, so a full sort buys nothing. Only the nearest child is
+            // pushed last, occluders tend to sit near the shading point.
+            int nearest = -1;
+            for (int i = 0; i < 4; i++)
+            {
+                if (!(mask & (1 << i)) || node.count[i] < 0)
+                    continue;
+
+                stack[stack_size++] = {node.child[i], node.count[i], t_near[i]};
+                if (nearest < 0 || t_near[i] < stack[nearest].t)
+                    nearest = stack_size - 1;
+            }
+            if (nearest >= 0)
+                std::swap(stack[nearest], stack[stack_size - 1]);
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/acc_struct/sah_bvh.h"
+#include "runtime/function/render/pathtracing/primitive/triangle_mesh.h"
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define PATH_TRACING_SSE
+#endif
+
+namespace MiniEngine::PathTracing
+{
+    // Four children per node, their bounds stored as structure of arrays so one ray is
+    // tested against all of them at once.
+    struct alignas(16) BVH4Node
+    {
+        float min_x[4], min_y[4], min_z[4];
+        float max_x[4], max_y[4], max_z[4];
+        int32_t child[4]; // node index, or the first Triangle4 block of a leaf (see count)
+        int32_t count[4]; // number of Triangle4 blocks of a leaf child, 0 for interior children, -1 for empty slots
+    };
+
+    // Four triangles intersected together, padded with degenerate triangles.
+    struct alignas(16) Triangle4
+    {
+        float v0_x[4], v0_y[4], v0_z[4];
+        float e1_x[4], e1_y[4], e1_z[4];
+        float e2_x[4], e2_y[4], e2_z[4];
+        int32_t id[4]; // index into the triangle soup, -1 for padding
+    };
+
+    class BVH4 : public Hittable
+    {
+    public:
+        vector<BVH4Node> nodes;
+        vector<Triangle4> blocks;
+        TriangleMesh triangles; // shading data of the closest hit, in leaf order
+
+        float build_time = 0.f; // seconds
+        float sah_cost = 0.f;
+
+        BVH4() = default;
+        BVH4(TriangleMesh mesh, const BVHBuildParams &build_params = BVHBuildParams());
+
+        // true when the SIMD kernels were compiled in
+        static bool isSupported();
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+
+    private:
+        friend class BVHCache;
+
+        static const int MaxStackDepth = 256; // every visited node can push up to three more entries than it pops
+        static_assert(MaxStackDepth > 3 * BVHBuilder::MaxDepth, "the traversal stack must hold three entries per level");
+
+        AABB bounds;
+
+        int collapse(const vector<BVHBuildNode> &build_nodes, int build_id);
+        int packLeaf(const BVHBuildNode &leaf);
+    };
+}
@@ -0,0 +1,490 @@
+#include "runtime/function/render/pathtracing/acc_struct/bvh_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MiniEngine::PathTracing
+{
+    namespace
+    {
+        const char Magic[8] = {'M', 'E', 'B', 'V', 'H', 'C', 'A', 'C'};
+        const size_t SectionAlignment = 64;
+
+        struct BVHCacheHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t wide;       // 1 for BVH4, 0 for LinearBVH
+            uint64_t key;
+            uint32_t node_size;  // sizeof of the node and block structs, catches layout changes
+            uint32_t block_size;
+            uint64_t triangle_count;
+            uint64_t node_count;
+            uint64_t block_count;
+            uint64_t file_size;
+            float sah_cost;
+            float bounds[6];
+            uint32_t pad;
+        };
+
+        // read only view of a whole file, unmapped on destruction
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(const std::string &path)
+            {
+#ifdef _WIN32
+                file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE)
+                    return;
+                LARGE_INTEGER file_size;
+                if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+                    return;
+                mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (!mapping)
+                    return;
+                void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (!view)
+                    return;
+                bytes = static_cast<const uint8_t *>(view);
+                length = static_cast<size_t>(file_size.QuadPart);
+#else
+                int fd = open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    return;
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0)
+                {
+                    void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (view != MAP_FAILED)
+                    {
+                        bytes = static_cast<const uint8_t *>(view);
+                        length = static_cast<size_t>(st.st_size);
+                    }
+                }
+                close(fd); // the mapping stays valid
+#endif
+            }
+
+            ~MappedFile()
+            {
+#ifdef _WIN32
+                if (bytes)
+                    UnmapViewOfFile(bytes);
+                if (mapping)
+                    CloseHandle(mapping);
+                if (file != INVALID_HANDLE_VALUE)
+                    CloseHandle(file);
+#else
+                if (bytes)
+                    munmap(const_cast<uint8_t *>(bytes), length);
+#endif
+            }
+
+            MappedFile(const MappedFile &) = delete;
+            MappedFile &operator=(const MappedFile &) = delete;
+
+            const uint8_t *data() const { return bytes; }
+            size_t size() const { return length; }
+
+        private:
+            const uint8_t *bytes = nullptr;
+            size_t length = 0;
+#ifdef _WIN32
+            HANDLE file = INVALID_HANDLE_VALUE;
+            HANDLE mapping = nullptr;
+#endif
+        };
+
+        size_t align(size_t offset)
+        {
+            return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+        }
+
+        // 64 bit multiply-xorshift over whole words, a few GB/s so hashing stays far below a rebuild
+        class Hasher
+        {
+        public:
+            void add(const void *data, size_t size)
+            {
+                const uint8_t *bytes = static_cast<const uint8_t *>(data);
+                size_t i = 0;
+                for (; i + 8 <= size; i += 8)
+                {
+                    uint64_t word;
+                    memcpy(&word, bytes + i, 8);
+                    mix(word);
+                }
+                uint64_t tail = 0;
+                memcpy(&tail, bytes + i, size - i);
+                mix(tail ^ (static_cast<uint64_t>(size) << 56));
+            }
+
+            template <typename T>
+            void add(const vector<T> &data)
+            {
+                add(data.data(), data.size() * sizeof(T));
+            }
+
+            template <typename T>
+            void addValue(const T &value)
+            {
+                add(&value, sizeof(T));
+            }
+
+            uint64_t get() const
+            {
+                uint64_t h = state;
+                h ^= h >> 33;
+                h *= 0xff51afd7ed558ccdull;
+                h ^= h >> 33;
+                return h;
+            }
+
+        private:
+            uint64_t state = 0xcbf29ce484222325ull;
+
+            void mix(uint64_t word)
+            {
+                state ^= word * 0x9e3779b97f4a7c15ull;
+                state = (state << 27) | (state >> 37);
+                state *= 0x100000001b3ull;
+            }
+        };
+
+        // the per triangle arrays of a (const) TriangleMesh in file order, with their elements per triangle
+        template <typename Mesh, typename Visitor>
+        void visitTriangleArrays(Mesh &mesh, Visitor &&visit)
+        {
+            visit(mesh.v0_x, 1), visit(mesh.v0_y, 1), visit(mesh.v0_z, 1);
+            visit(mesh.e1_x, 1), visit(mesh.e1_y, 1), visit(mesh.e1_z, 1);
+            visit(mesh.e2_x, 1), visit(mesh.e2_y, 1), visit(mesh.e2_z, 1);
+            visit(mesh.normals, 1);
+            visit(mesh.texcoords, 3);
+            visit(mesh.material_ids, 1);
+            visit(mesh.light_ids, 1);
+            visit(mesh.uv_densities, 1);
+        }
+
+        class CacheWriter
+        {
+        public:
+            explicit CacheWriter(std::ofstream &out) : out(out) {}
+
+            template <typename T>
+            void write(const vector<T> &data)
+            {
+                pad();
+                out.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T));
+                offset += data.size() * sizeof(T);
+            }
+
+            void writeHeader(const BVHCacheHeader &header)
+            {
+                out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                offset += sizeof(header);
+            }
+
+            size_t size() const { return offset; }
+
+        private:
+            std::ofstream &out;
+            size_t offset = 0;
+
+            void pad()
+            {
+                static const char zeros[SectionAlignment] = {};
+                size_t aligned = align(offset);
+                out.write(zeros, aligned - offset);
+                offset = aligned;
+            }
+        };
+
+        class CacheReader
+        {
+        public:
+            CacheReader(const uint8_t *data, size_t size) : data(data), length(size) {}
+
+            // false once the file is shorter than its header claims
+            template <typename T>
+            bool read(vector<T> &out, size_t count)
+            {
+                offset = align(offset);
+                size_t bytes = count * sizeof(T);
+                if (offset + bytes > length)
+                    return false;
+                out.resize(count);
+                memcpy(out.data(), data + offset, bytes);
+                offset += bytes;
+                return true;
+            }
+
+            void skipHeader() { offset = sizeof(BVHCacheHeader); }
+            size_t position() const { return offset; }
+
+        private:
+            const uint8_t *data;
+            size_t length;
+            size_t offset = 0;
+        };
+
+        template <typename Node, typename Block>
+        bool saveCache(const std::string &path, uint64_t key, bool wide, const TriangleMesh &triangles,
+                       const vector<Node> &nodes, const vector<Block> *blocks, float sah_cost, const AABB &bounds)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+            // written next to the final name and renamed, so a reader never maps a partial file
+            std::string temp_path = path + ".tmp";
+            {
+                std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+                if (!out)
+                    return false;
+
+                BVHCacheHeader header = {};
+                memcpy(header.magic, Magic, sizeof(Magic));
+                header.version = BVHCache::Version;
+                header.wide = wide ? 1 : 0;
+                header.key = key;
+                header.node_size = sizeof(Node);
+                header.block_size = sizeof(Block);
+                header.triangle_count = triangles.size();
+                header.node_count = nodes.size();
+                header.block_count = blocks ? blocks->size() : 0;
+                header.sah_cost = sah_cost;
+                for (int a = 0; a < 3; a++)
+                {
+                    header.bounds[a] = bounds.min[a];
+                    header.bounds[3 + a] = bounds.max[a];
+                }
+
+                // the size is only known after the sections, so the header is written twice
+                CacheWriter writer(out);
+                writer.writeHeader(header);
+                visitTriangleArrays(triangles, [&](const auto &data, size_t)
+                                    { writer.write(data); });
+                writer.write(nodes);
+                if (blocks)
+                    writer.write(*blocks);
+
+                header.file_size = writer.size();
+                out.seekp(0);
+                out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                if (!out)
+                    return false;
+            }
+
+            std::filesystem::rename(temp_path, path, error);
+            if (error)
+            {
+                std::filesystem::remove(temp_path, error);
+                return false;
+            }
+            return true;
+        }
+
+        // the modification time doubles as the last use, so eviction is least recently used first
+        void touch(const std::string &path)
+        {
+            std::error_code error;
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        }
+
+        bool isCacheFile(const std::filesystem::directory_entry &entry)
+        {
+            std::error_code error;
+            std::string extension = entry.path().extension().string();
+            return entry.is_regular_file(error) && (extension == ".bvh" || extension == ".tmp");
+        }
+
+        template <typename Node, typename Block>
+        bool loadCache(const std::string &path, uint64_t key, bool wide, const TriangleMesh &mesh, TriangleMesh &triangles,
+                       vector<Node> &nodes, vector<Block> *blocks, float &sah_cost, float &build_time, AABB &bounds)
+        {
+            std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+            MappedFile file(path);
+            if (!file.data() || file.size() < sizeof(BVHCacheHeader))
+                return false;
+
+            BVHCacheHeader header;
+            memcpy(&header, file.data(), sizeof(header));
+            if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != BVHCache::Version)
+            {
+                std::cout << "BVH cache: " << path << " was written by another version, rebuilding" << std::endl;
+                return false;
+            }
+            if (header.key != key || header.wide != (wide ? 1u : 0u) || header.node_size != sizeof(Node) ||
+                header.block_size != sizeof(Block) || header.triangle_count != mesh.size() || header.file_size != file.size())
+            {
+                std::cout << "BVH cache: " << path << " does not match the scene, rebuilding" << std::endl;
+                return false;
+            }
+
+            CacheReader reader(file.data(), file.size());
+            reader.skipHeader();
+
+            TriangleMesh loaded;
+            bool complete = true;
+            visitTriangleArrays(loaded, [&](auto &data, size_t per_triangle)
+                                { complete = complete && reader.read(data, header.triangle_count * per_triangle); });
+            complete = complete && reader.read(nodes, header.node_count);
+            if (blocks)
+                complete = complete && reader.read(*blocks, header.block_count);
+            if (!complete || reader.position() != file.size())
+            {
+                std::cout << "BVH cache: " << path << " is truncated, rebuilding" << std::endl;
+                return false;
+            }
+
+            loaded.materials = mesh.materials;
+            triangles = std::move(loaded);
+            sah_cost = header.sah_cost;
+            build_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - start_time).count();
+            bounds = AABB(vec3(header.bounds[0], header.bounds[1], header.bounds[2]), vec3(header.bounds[3], header.bounds[4], header.bounds[5]));
+            return true;
+        }
+    }
+
+    BVHCache::BVHCache()
+    {
+        std::error_code error;
+        std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+        directory = ((error ? std::filesystem::path(".") : temp) / "MiniEngine" / "bvh_cache").string();
+    }
+
+    BVHCache::BVHCache(const std::string &directory) : directory(directory)
+    {
+    }
+
+    uint64_t BVHCache::computeKey(const TriangleMesh &mesh, const BVHBuildParams &params, bool wide)
+    {
+        Hasher hasher;
+        hasher.addValue(Version);
+        hasher.addValue(wide);
+        hasher.addValue(params.bucket_count);
+        hasher.addValue(params.max_leaf_size);
+        hasher.addValue(params.traversal_cost);
+        hasher.addValue(params.intersection_cost);
+        hasher.addValue(params.sah);
+        visitTriangleArrays(mesh, [&](const auto &data, size_t)
+                            { hasher.add(data); });
+        return hasher.get();
+    }
+
+    std::string BVHCache::getPath(uint64_t key) const
+    {
+        std::ostringstream name;
+        name << std::hex << key << ".bvh";
+        return (std::filesystem::path(directory) / name.str()).string();
+    }
+
+    bool BVHCache::load(uint64_t key, const TriangleMesh &mesh, LinearBVH &bvh) const
+    {
+        AABB bounds;
+        if (!loadCache<LinearBVHNode, Triangle4>(getPath(key), key, false, mesh, bvh.triangles, bvh.nodes, nullptr, bvh.sah_cost, bvh.build_time, bounds))
+            return false;
+        touch(getPath(key));
+        return true;
+    }
+
+    bool BVHCache::load(uint64_t key, const TriangleMesh &mesh, BVH4 &bvh) const
+    {
+        if (!loadCache(getPath(key), key, true, mesh, bvh.triangles, bvh.nodes, &bvh.blocks, bvh.sah_cost, bvh.build_time, bvh.bounds))
+            return false;
+        touch(getPath(key));
+        return true;
+    }
+
+    bool BVHCache::save(uint64_t key, const LinearBVH &bvh) const
+    {
+        AABB bounds;
+        bvh.aabb(bounds);
+        if (!saveCache<LinearBVHNode, Triangle4>(getPath(key), key, false, bvh.triangles, bvh.nodes, nullptr, bvh.sah_cost, bounds))
+            return false;
+        evict();
+        return true;
+    }
+
+    bool BVHCache::save(uint64_t key, const BVH4 &bvh) const
+    {
+        if (!saveCache(getPath(key), key, true, bvh.triangles, bvh.nodes, &bvh.blocks, bvh.sah_cost, bvh.bounds))
+            return false;
+        evict();
+        return true;
+    }
+
+    void BVHCache::evict() const
+    {
+        struct CacheFile
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type time;
+            uintmax_t size;
+        };
+
+        std::error_code error;
+        vector<CacheFile> files;
+        uintmax_t total_size = 0;
+        for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (!isCacheFile(entry))
+                continue;
+            CacheFile file = {entry.path(), entry.last_write_time(error), entry.file_size(error)};
+            if (error)
+                continue;
+            files.push_back(file);
+            total_size += file.size;
+        }
+
+        // the newest file is the one just saved, it stays even when it alone is over the limit
+        std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b)
+                  { return a.time < b.time; });
+        for (size_t i = 0; i + 1 < files.size() && total_size > max_size; i++)
+        {
+            if (std::filesystem::remove(files[i].path, error))
+            {
+                total_size -= files[i].size;
+                std::cout << "BVH cache: evicted " << files[i].path.string() << std::endl;
+            }
+        }
+    }
+
+    int BVHCache::clear() const
+    {
+        std::error_code error;
+        vector<std::filesystem::path> files;
+        for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (isCacheFile(entry))
+                files.push_back(entry.path());
+        }
+
+        int removed = 0;
+        for (const std::filesystem::path &path : files)
+        {
+            removed += std::filesystem::remove(path, error) ? 1 : 0;
+        }
+        return removed;
+    }
+}
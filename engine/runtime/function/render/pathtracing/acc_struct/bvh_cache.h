@@ -0,0 +1,50 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/acc_struct/linear_bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh4.h"
+
+#include <cstdint>
+#include <string>
+
+namespace MiniEngine::PathTracing
+{
+    // Built BVHs kept on disk between runs, one file per key. A file stores the triangles in leaf
+    // order and the flattened nodes, it is memory mapped and copied out on load. Files written
+    // by another version, another node layout or for another key are ignored, so a stale cache
+    // only costs a rebuild. Every save drops the least recently used files past max_size.
+    class BVHCache
+    {
+    public:
+        static const uint32_t Version = 2;
+        static const uintmax_t DefaultMaxSize = uintmax_t(2) << 30; // bytes
+
+        uintmax_t max_size = DefaultMaxSize;
+
+        // in the system temp directory
+        BVHCache();
+        explicit BVHCache(const std::string &directory);
+
+        // hash over the triangle data and everything the build depends on
+        static uint64_t computeKey(const TriangleMesh &mesh, const BVHBuildParams &params, bool wide);
+
+        // the materials of the loaded triangles are taken from mesh, which must be the soup the key
+        // was computed from. build_time becomes the time the load took.
+        bool load(uint64_t key, const TriangleMesh &mesh, LinearBVH &bvh) const;
+        bool load(uint64_t key, const TriangleMesh &mesh, BVH4 &bvh) const;
+
+        bool save(uint64_t key, const LinearBVH &bvh) const;
+        bool save(uint64_t key, const BVH4 &bvh) const;
+
+        std::string getPath(uint64_t key) const;
+        const std::string &getDirectory() const { return directory; }
+
+        // removes the oldest files, by last load or save, until the rest fit in max_size
+        void evict() const;
+        // removes every file of the cache, returns how many
+        int clear() const;
+
+    private:
+        std::string directory;
+    };
+}
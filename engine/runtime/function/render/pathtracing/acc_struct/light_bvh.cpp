@@ -0,0 +1,349 @@
+#include "runtime/function/render/pathtracing/acc_struct/light_bvh.h"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    namespace
+    {
+        inline float safeSqrt(float x)
+        {
+            return sqrt(std::max(x, 0.f));
+        }
+
+        // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+        inline float cosSubClamped(float sin_a, float cos_a, float sin_b, float cos_b)
+        {
+            if (cos_a > cos_b)
+                return 1.f;
+            return cos_a * cos_b + sin_a * sin_b;
+        }
+
+        inline float sinSubClamped(float sin_a, float cos_a, float sin_b, float cos_b)
+        {
+            if (cos_a > cos_b)
+                return 0.f;
+            return sin_a * cos_b - cos_a * sin_b;
+        }
+
+        // v rotated by 'angle' around the unit 'axis' (Rodrigues)
+        inline vec3 rotate(const vec3 &v, const vec3 &axis, float angle)
+        {
+            float c = cos(angle);
+            float s = sin(angle);
+            return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1 - c);
+        }
+
+        // solid angle measure of a cone of normals widened by the pi / 2 emission falloff, for the SAH
+        inline float orientationMeasure(float cos_theta_o)
+        {
+            float theta_o = acos(glm::clamp(cos_theta_o, -1.f, 1.f));
+            float theta_w = std::min(theta_o + 0.5f * PI, PI);
+            float sin_theta_o = sin(theta_o);
+            return 2 * PI * (1 - cos_theta_o) +
+                   0.5f * PI * (2 * theta_w * sin_theta_o - cos(theta_o - 2 * theta_w) - 2 * theta_o * sin_theta_o + cos_theta_o);
+        }
+
+        inline AABB emptyBox()
+        {
+            return AABB(vec3(INF), vec3(-INF));
+        }
+    }
+
+    LightBounds LightBounds::merge(const LightBounds &a, const LightBounds &b)
+    {
+        LightBounds result;
+        result.box = AABB::getSurroundingBox(a.box, b.box);
+        result.power = a.power + b.power;
+
+        // smallest cone holding both cones
+        float theta_a = acos(glm::clamp(a.cos_theta_o, -1.f, 1.f));
+        float theta_b = acos(glm::clamp(b.cos_theta_o, -1.f, 1.f));
+        float theta_d = acos(glm::clamp(dot(a.axis, b.axis), -1.f, 1.f));
+
+        if (std::min(theta_d + theta_b, PI) <= theta_a)
+        {
+            result.axis = a.axis;
+            result.cos_theta_o = a.cos_theta_o;
+            return result;
+        }
+        if (std::min(theta_d + theta_a, PI) <= theta_b)
+        {
+            result.axis = b.axis;
+            result.cos_theta_o = b.cos_theta_o;
+            return result;
+        }
+
+        float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+        vec3 rotation_axis = cross(a.axis, b.axis);
+        if (theta_o >= PI || dot(rotation_axis, rotation_axis) < 1e-12f)
+        {
+            result.axis = a.axis;
+            result.cos_theta_o = -1.f;
+            return result;
+        }
+
+        result.axis = normalize(rotate(a.axis, normalize(rotation_axis), theta_o - theta_a));
+        result.cos_theta_o = cos(theta_o);
+        return result;
+    }
+
+    void LightBVHNode::setBounds(const LightBounds &bounds)
+    {
+        box = bounds.box;
+        center = 0.5f * (box.min + box.max);
+        radius2 = dot(box.max - center, box.max - center);
+        axis = bounds.axis;
+        cos_theta_o = bounds.cos_theta_o;
+        sin_theta_o = safeSqrt(1 - cos_theta_o * cos_theta_o);
+        power = bounds.power;
+        min_distance2 = 0.5f * length(box.max - box.min);
+    }
+
+    float LightBVHNode::importance(const vec3 &p, const vec3 &n) const
+    {
+        vec3 to_point = p - center;
+        float center_dist2 = dot(to_point, to_point);
+        // points inside or close to the box would blow up, clamp the distance to the box size
+        float d2 = std::max(center_dist2, min_distance2);
+        if (d2 <= 0.f || power <= 0.f)
+            return 0.f;
+
+        vec3 wi = to_point / sqrt(std::max(center_dist2, 1e-12f));
+
+        // half angle of the box as seen from p, everything when p is inside
+        float cos_theta_b = -1.f;
+        if (center_dist2 > radius2)
+            cos_theta_b = sqrt(1 - radius2 / center_dist2);
+        float sin_theta_b = safeSqrt(1 - cos_theta_b * cos_theta_b);
+
+        // the receiving side first, half of all emitters are usually behind the surface
+        float cos_theta_pi = 1.f;
+        if (n != vec3(0, 0, 0))
+        {
+            float cos_theta_i = -dot(wi, n);
+            float sin_theta_i = safeSqrt(1 - cos_theta_i * cos_theta_i);
+            cos_theta_pi = cosSubClamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+            if (cos_theta_pi <= 0.f)
+                return 0.f;
+        }
+
+        // smallest angle between an emission normal and some direction towards p
+        float cos_theta_w = dot(axis, wi);
+        float sin_theta_w = safeSqrt(1 - cos_theta_w * cos_theta_w);
+        float cos_theta_x = cosSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        float sin_theta_x = sinSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        float cos_theta_p = cosSubClamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+        // one sided emitters, nothing leaves past 90 degrees
+        if (cos_theta_p <= 0.f)
+            return 0.f;
+
+        return power * cos_theta_p * cos_theta_pi / d2;
+    }
+
+    void LightBVH::clear()
+    {
+        nodes.clear();
+        emitter_nodes.clear();
+    }
+
+    void LightBVH::build(const vector<LightBounds> &emitters)
+    {
+        clear();
+        if (emitters.empty())
+            return;
+
+        vector<int> ids(emitters.size());
+        for (int i = 0; i < ids.size(); i++)
+        {
+            ids[i] = i;
+        }
+
+        nodes.reserve(2 * emitters.size());
+        emitter_nodes.assign(emitters.size(), -1);
+        buildRecursive(emitters, ids, 0, ids.size(), -1, 0);
+    }
+
+    int LightBVH::buildRecursive(const vector<LightBounds> &emitters, vector<int> &ids, int start, int end, int parent, int depth)
+    {
+        int index = nodes.size();
+        nodes.emplace_back();
+        nodes[index].parent = parent;
+
+        if (end - start == 1)
+        {
+            nodes[index].setBounds(emitters[ids[start]]);
+            nodes[index].offset = ids[start];
+            nodes[index].is_leaf = true;
+            emitter_nodes[ids[start]] = index;
+            return index;
+        }
+
+        LightBounds bounds = emitters[ids[start]];
+        AABB centroid_box = emptyBox();
+        for (int i = start; i < end; i++)
+        {
+            const LightBounds &emitter = emitters[ids[i]];
+            if (i > start)
+                bounds = LightBounds::merge(bounds, emitter);
+            vec3 centroid = 0.5f * (emitter.box.min + emitter.box.max);
+            centroid_box = AABB::getSurroundingBox(centroid_box, AABB(centroid, centroid));
+        }
+
+        // binned surface area orientation heuristic, cost ~ power * area * orientation measure
+        vec3 extent = centroid_box.max - centroid_box.min;
+        float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+
+        int best_axis = -1;
+        int best_split = -1;
+        float best_cost = INF;
+        if (depth < MaxSAHDepth && max_extent > 0.f)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (extent[axis] <= 0.f)
+                    continue;
+
+                LightBounds buckets[BucketCount];
+                bool bucket_used[BucketCount] = {};
+                for (int i = start; i < end; i++)
+                {
+                    const LightBounds &emitter = emitters[ids[i]];
+                    float centroid = 0.5f * (emitter.box.min[axis] + emitter.box.max[axis]);
+                    int b = std::min(static_cast<int>(BucketCount * (centroid - centroid_box.min[axis]) / extent[axis]), BucketCount - 1);
+                    buckets[b] = bucket_used[b] ? LightBounds::merge(buckets[b], emitter) : emitter;
+                    bucket_used[b] = true;
+                }
+
+                auto cost = [](const LightBounds &b)
+                {
+                    return b.power * b.box.surfaceArea() * orientationMeasure(b.cos_theta_o);
+                };
+
+                // long thin nodes are cheaper to split across their length
+                float axis_weight = max_extent / extent[axis];
+                for (int split = 0; split < BucketCount - 1; split++)
+                {
+                    LightBounds below, above;
+                    bool has_below = false, has_above = false;
+                    for (int b = 0; b <= split; b++)
+                    {
+                        if (!bucket_used[b])
+                            continue;
+                        below = has_below ? LightBounds::merge(below, buckets[b]) : buckets[b];
+                        has_below = true;
+                    }
+                    for (int b = split + 1; b < BucketCount; b++)
+                    {
+                        if (!bucket_used[b])
+                            continue;
+                        above = has_above ? LightBounds::merge(above, buckets[b]) : buckets[b];
+                        has_above = true;
+                    }
+                    if (!has_below || !has_above)
+                        continue;
+
+                    float split_cost = axis_weight * (cost(below) + cost(above));
+                    if (split_cost < best_cost)
+                    {
+                        best_cost = split_cost;
+                        best_axis = axis;
+                        best_split = split;
+                    }
+                }
+            }
+        }
+
+        int mid = start;
+        if (best_axis >= 0)
+        {
+            auto first_above = std::partition(ids.begin() + start, ids.begin() + end, [&](int id)
+                                              {
+                const LightBounds &emitter = emitters[id];
+                float centroid = 0.5f * (emitter.box.min[best_axis] + emitter.box.max[best_axis]);
+                int b = std::min(static_cast<int>(BucketCount * (centroid - centroid_box.min[best_axis]) / extent[best_axis]), BucketCount - 1);
+                return b <= best_split; });
+            mid = static_cast<int>(first_above - ids.begin());
+        }
+        if (mid == start || mid == end)
+        {
+            // coincident centroids or too deep, halve the range along the largest axis
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            mid = (start + end) / 2;
+            std::nth_element(ids.begin() + start, ids.begin() + mid, ids.begin() + end, [&](int a, int b)
+                             { return emitters[a].box.min[axis] + emitters[a].box.max[axis] < emitters[b].box.min[axis] + emitters[b].box.max[axis]; });
+        }
+
+        buildRecursive(emitters, ids, start, mid, index, depth + 1);
+        int second = buildRecursive(emitters, ids, mid, end, index, depth + 1);
+
+        nodes[index].setBounds(bounds);
+        nodes[index].offset = second;
+        nodes[index].is_leaf = false;
+        return index;
+    }
+
+    int LightBVH::sample(const vec3 &p, const vec3 &n, float u, float &pmf) const
+    {
+        pmf = 0.f;
+        if (nodes.empty())
+            return -1;
+
+        int index = 0;
+        float probability = 1.f;
+        while (!nodes[index].is_leaf)
+        {
+            int children[2] = {index + 1, nodes[index].offset};
+            float importance0 = nodes[children[0]].importance(p, n);
+            float importance1 = nodes[children[1]].importance(p, n);
+            if (importance0 <= 0.f && importance1 <= 0.f)
+                return -1;
+
+            // reuse the remainder of u for the next level
+            float p0 = importance0 / (importance0 + importance1);
+            if (u < p0)
+            {
+                u = std::min(u / p0, 0x1.fffffep-1f);
+                index = children[0];
+                probability *= p0;
+            }
+            else
+            {
+                u = std::min((u - p0) / (1 - p0), 0x1.fffffep-1f);
+                index = children[1];
+                probability *= 1 - p0;
+            }
+        }
+
+        if (nodes[index].importance(p, n) <= 0.f)
+            return -1;
+
+        pmf = probability;
+        return nodes[index].offset;
+    }
+
+    float LightBVH::pmf(const vec3 &p, const vec3 &n, int emitter) const
+    {
+        int index = emitter_nodes[emitter];
+        if (nodes[index].importance(p, n) <= 0.f)
+            return 0.f;
+
+        float probability = 1.f;
+        for (int parent = nodes[index].parent; parent >= 0; index = parent, parent = nodes[parent].parent)
+        {
+            float importance0 = nodes[parent + 1].importance(p, n);
+            float importance1 = nodes[nodes[parent].offset].importance(p, n);
+            float importance = index == parent + 1 ? importance0 : importance1;
+            if (importance <= 0.f)
+                return 0.f;
+            probability *= importance / (importance0 + importance1);
+        }
+        return probability;
+    }
+
+    size_t LightBVH::getMemoryUsage() const
+    {
+        return nodes.capacity() * sizeof(LightBVHNode) + emitter_nodes.capacity() * sizeof(int);
+    }
+}
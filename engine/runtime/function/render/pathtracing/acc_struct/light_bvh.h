@@ -0,0 +1,68 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/acc_struct/aabb.h"
+
+namespace MiniEngine::PathTracing
+{
+    // Spatial and directional bounds of a set of one sided emitters: a box, the total power and
+    // the cone (axis, cos_theta_o) holding every emission normal.
+    struct LightBounds
+    {
+        AABB box;
+        vec3 axis{0, 0, 1};
+        float cos_theta_o = 1.f;
+        float power = 0.f;
+
+        static LightBounds merge(const LightBounds &a, const LightBounds &b);
+    };
+
+    // LightBounds with the terms of its importance that do not depend on the shading point
+    struct LightBVHNode
+    {
+        AABB box;
+        vec3 center;
+        float radius2;       // bounding sphere of the box
+        vec3 axis;
+        float cos_theta_o;
+        float sin_theta_o;
+        float power;
+        float min_distance2; // distance clamp for points close to the box
+        int offset;          // interior: second child, the first one follows its parent; leaf: emitter index
+        int parent;          // -1 for the root
+        bool is_leaf;
+
+        void setBounds(const LightBounds &bounds);
+
+        // conservative estimate of the light arriving at p, 0 only when none can arrive. n is the
+        // normal of the receiving surface, zero when light from any side counts.
+        float importance(const vec3 &p, const vec3 &n) const;
+    };
+
+    // Light BVH after Conty and Kulla, "Importance Sampling of Many Lights with Adaptive Tree
+    // Splitting" (2018): emitters are chosen by walking down the tree and picking each child in
+    // proportion to its importance for the shading point. One emitter per leaf, so the
+    // probability of any emitter follows from the path back to the root.
+    class LightBVH
+    {
+    public:
+        vector<LightBVHNode> nodes;
+        vector<int> emitter_nodes; // leaf of every emitter
+
+        void build(const vector<LightBounds> &emitters);
+        void clear();
+        bool empty() const { return nodes.empty(); }
+
+        // -1 when no emitter can light p
+        int sample(const vec3 &p, const vec3 &n, float u, float &pmf) const;
+        float pmf(const vec3 &p, const vec3 &n, int emitter) const;
+
+        size_t getMemoryUsage() const;
+
+    private:
+        static const int MaxSAHDepth = 64; // deeper nodes split at the median, which bounds the tree depth
+        static const int BucketCount = 12;
+
+        int buildRecursive(const vector<LightBounds> &emitters, vector<int> &ids, int start, int end, int parent, int depth);
+    };
+}
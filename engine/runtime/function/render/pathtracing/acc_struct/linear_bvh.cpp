@@ -0,0 +1,200 @@
+#include "runtime/function/render/pathtracing/acc_struct/linear_bvh.h"
+#include "runtime/function/render/pathtracing/common/render_statistics.h"
+
+#include <chrono>
+
+namespace MiniEngine::PathTracing
+{
+    LinearBVH::LinearBVH(TriangleMesh mesh, const BVHBuildParams &build_params)
+    {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        BVHBuildParams params = build_params;
+        params.max_leaf_size = std::min(params.max_leaf_size, MaxLeafPrimitives);
+
+        vector<AABB> boxes(mesh.size());
+        for (int i = 0; i < mesh.size(); i++)
+        {
+            boxes[i] = mesh.bounds(i);
+        }
+
+        BVHBuilder builder;
+        builder.build(boxes, params);
+        sah_cost = builder.sah_cost;
+
+        // store the triangles in leaf order so a leaf is a contiguous slice of the arrays
+        triangles = std::move(mesh);
+        triangles.reorder(builder.order);
+
+        // the builder already emits nodes depth first with the left child right after its parent,
+        // so flattening only has to repack them
+        nodes.resize(builder.nodes.size());
+        for (int i = 0; i < builder.nodes.size(); i++)
+        {
+            const BVHBuildNode &src = builder.nodes[i];
+            LinearBVHNode &dst = nodes[i];
+
+            dst.box_min = src.box.min;
+            dst.box_max = src.box.max;
+            dst.axis = static_cast<uint8_t>(src.axis);
+            dst.pad = 0;
+
+            if (src.isLeaf())
+            {
+                dst.primitives_offset = src.first;
+                dst.primitive_count = static_cast<uint16_t>(src.count);
+            }
+            else
+            {
+                dst.second_child_offset = src.right;
+                dst.primitive_count = 0;
+            }
+        }
+
+        std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+        build_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time).count();
+    }
+
+    bool LinearBVH::aabb(AABB &bounding_box) const
+    {
+        if (nodes.empty())
+            return false;
+
+        bounding_box = AABB(nodes[0].box_min, nodes[0].box_max);
+        return true;
+    }
+
+    bool LinearBVH::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (nodes.empty())
+            return false;
+
+        TraversalScope counters;
+
+        vec3 inv_direction = 1.f / r.direction;
+        bool dir_is_neg[3] = {inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0};
+
+        int to_visit[MaxStackDepth];
+        int to_visit_offset = 0;
+        int current = 0;
+        int closest = -1;
+        float closest_u, closest_v;
+
+        while (true)
+        {
+            const LinearBVHNode &node = nodes[current];
+            counters.nodes_visited++;
+
+            if (node.hit(r.origin, inv_direction, t_min, t_max))
+            {
+                if (node.primitive_count > 0)
+                {
+                    counters.triangle_tests += node.primitive_count;
+                    for (int i = node.primitives_offset; i < node.primitives_offset + node.primitive_count; i++)
+                    {
+                        float t, u, v;
+                        if (triangles.intersect(i, r, t_min, t_max, t, u, v))
+                        {
+                            closest = i;
+                            closest_u = u;
+                            closest_v = v;
+                            t_max = t;
+                        }
+                    }
+
+                    if (to_visit_offset == 0)
+                        break;
+                    current = to_visit[--to_visit_offset];
+                }
+                else
+                {
+                    // visit the nearer child first and defer the other one
+                    if (dir_is_neg[node.axis])
+                    {
+                        to_visit[to_visit_offset++] = current + 1;
+                        current = node.second_child_offset;
+                    }
+                    else
+                    {
+                        to_visit[to_visit_offset++] = node.second_child_offset;
+                        current = current + 1;
+                    }
+                }
+            }
+            else
+            {
+                if (to_visit_offset == 0)
+                    break;
+                current = to_visit[--to_visit_offset];
+            }
+        }
+
+        if (closest < 0)
+            return false;
+
+        // the shading data is only fetched once, for the closest hit
+        triangles.fillHitRecord(closest, r, t_max, closest_u, closest_v, rec);
+        return true;
+    }
+
+    bool LinearBVH::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        if (nodes.empty())
+            return false;
+
+        TraversalScope counters;
+
+        vec3 inv_direction = 1.f / r.direction;
+        bool dir_is_neg[3] = {inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0};
+
+        int to_visit[MaxStackDepth];
+        int to_visit_offset = 0;
+        int current = 0;
+
+        while (true)
+        {
+            const LinearBVHNode &node = nodes[current];
+            counters.nodes_visited++;
+
+            if (node.hit(r.origin, inv_direction, t_min, t_max))
+            {
+                if (node.primitive_count > 0)
+                {
+                    counters.triangle_tests += node.primitive_count;
+                    for (int i = node.primitives_offset; i < node.primitives_offset + node.primitive_count; i++)
+                    {
+                        float t, u, v;
+                        if (triangles.intersect(i, r, t_min, t_max, t, u, v))
+                            return true;
+                    }
+
+                    if (to_visit_offset == 0)
+                        break;
+                    current = to_visit[--to_visit_offset];
+                }
+                else
+                {
+                    // occluders tend to sit near the shading point, so the near child still goes first
+                    if (dir_is_neg[node.axis])
+                    {
+                        to_visit[to_visit_offset++] = current + 1;
+                        current = node.second_child_offset;
+                    }
+                    else
+                    {
+                        to_visit[to_visit_offset++] = node.second_child_offset;
+                        current = current + 1;
+                    }
+                }
+            }
+            else
+            {
+                if (to_visit_offset == 0)
+                    break;
+                current = to_visit[--to_visit_offset];
+            }
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/acc_struct/sah_bvh.h"
+#include "runtime/function/render/pathtracing/primitive/triangle_mesh.h"
+
+#include <cstdint>
+
+namespace MiniEngine::PathTracing
+{
+    // 32 bytes, two nodes per cache line
+    struct alignas(32) LinearBVHNode
+    {
+        vec3 box_min;
+        union
+        {
+            int primitives_offset;   // leaf
+            int second_child_offset; // interior, the first child directly follows its parent
+        };
+        vec3 box_max;
+        uint16_t primitive_count;    // 0 for interior nodes
+        uint8_t axis;
+        uint8_t pad;
+
+        inline bool hit(const vec3 &origin, const vec3 &inv_direction, float t_min, float t_max) const
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                float t0 = (box_min[a] - origin[a]) * inv_direction[a];
+                float t1 = (box_max[a] - origin[a]) * inv_direction[a];
+                if (inv_direction[a] < 0.f)
+                    std::swap(t0, t1);
+                t_min = fmax(t0, t_min);
+                t_max = fmin(t1, t_max);
+                if (t_max < t_min)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode is expected to be 32 bytes");
+
+    // Depth first flattened BVH over a triangle soup, traversed with an explicit stack.
+    class LinearBVH : public Hittable
+    {
+    public:
+        vector<LinearBVHNode> nodes;
+        TriangleMesh triangles; // reordered so that every leaf references a contiguous range
+
+        float build_time = 0.f; // seconds
+        float sah_cost = 0.f;
+
+        LinearBVH() = default;
+        LinearBVH(TriangleMesh mesh, const BVHBuildParams &build_params = BVHBuildParams());
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+
+    private:
+        static const int MaxStackDepth = BVHBuilder::MaxDepth + 1; // one deferred child per level
+        static const int MaxLeafPrimitives = 0xffff;
+    };
+}
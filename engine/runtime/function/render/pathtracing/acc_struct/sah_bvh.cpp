@@ -0,0 +1,338 @@
+#include "runtime/function/render/pathtracing/acc_struct/sah_bvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace MiniEngine::PathTracing
+{
+    static AABB emptyBox()
+    {
+        return AABB(vec3(INF), vec3(-INF));
+    }
+
+    void BVHBuilder::build(const vector<AABB> &boxes, const BVHBuildParams &build_params)
+    {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        params = build_params;
+        params.bucket_count = std::max(params.bucket_count, 2);
+        params.max_leaf_size = std::max(params.max_leaf_size, 1);
+
+        nodes.clear();
+        order.clear();
+        depth = 0;
+
+        // the build only moves these small records around, never the primitives themselves
+        vector<BuildPrimitive> primitives(boxes.size());
+        for (int i = 0; i < boxes.size(); i++)
+        {
+            primitives[i].box = boxes[i];
+            primitives[i].centroid = 0.5f * (boxes[i].min + boxes[i].max);
+            primitives[i].index = i;
+        }
+
+        if (!primitives.empty())
+        {
+            nodes.reserve(2 * primitives.size());
+            buildRecursive(primitives, 0, primitives.size(), 0);
+            assert(depth <= MaxDepth);
+        }
+
+        order.resize(primitives.size());
+        for (int i = 0; i < primitives.size(); i++)
+        {
+            order[i] = primitives[i].index;
+        }
+
+        sah_cost = computeSAHCost();
+
+        std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+        build_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time).count();
+    }
+
+    int BVHBuilder::makeLeaf(int start, int end, const AABB &box)
+    {
+        BVHBuildNode leaf;
+        leaf.box = box;
+        leaf.left = -1;
+        leaf.right = -1;
+        leaf.first = start;
+        leaf.count = end - start;
+        leaf.axis = 0;
+
+        nodes.push_back(leaf);
+        return nodes.size() - 1;
+    }
+
+    int BVHBuilder::buildRecursive(vector<BuildPrimitive> &primitives, int start, int end, int level)
+    {
+        depth = std::max(depth, level);
+
+        AABB box = emptyBox();
+        AABB centroid_box = emptyBox();
+        for (int i = start; i < end; i++)
+        {
+            box = AABB::getSurroundingBox(box, primitives[i].box);
+            centroid_box = AABB::getSurroundingBox(centroid_box, AABB(primitives[i].centroid, primitives[i].centroid));
+        }
+
+        int count = end - start;
+        if (count == 1)
+        {
+            return makeLeaf(start, end, box);
+        }
+
+        vec3 extent = centroid_box.max - centroid_box.min;
+        int mid = start + count / 2;
+        int split_axis = -1;
+
+        // a degenerate SAH split peels off a few primitives per level, deep down only medians are safe
+        bool sah = params.sah && level < MedianSplitDepth;
+
+        if (sah)
+        {
+            // bin the centroids along every axis and sweep the buckets to find the cheapest split plane
+            struct Bucket
+            {
+                int count = 0;
+                AABB box = emptyBox();
+            };
+
+            const int bucket_count = params.bucket_count;
+            vector<Bucket> buckets(bucket_count);
+            vector<float> right_area(bucket_count);
+            vector<int> right_count(bucket_count);
+
+            float best_cost = INF;
+            int best_bucket = -1;
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (extent[axis] <= 0.f)
+                    continue;
+
+                for (auto &bucket : buckets)
+                {
+                    bucket = Bucket();
+                }
+
+                float scale = bucket_count / extent[axis];
+                for (int i = start; i < end; i++)
+                {
+                    int b = std::min(int((primitives[i].centroid[axis] - centroid_box.min[axis]) * scale), bucket_count - 1);
+                    buckets[b].count++;
+                    buckets[b].box = AABB::getSurroundingBox(buckets[b].box, primitives[i].box);
+                }
+
+                // sweep from the right to get the area and count right of every plane
+                AABB accumulated = emptyBox();
+                int accumulated_count = 0;
+                for (int b = bucket_count - 1; b > 0; b--)
+                {
+                    accumulated = AABB::getSurroundingBox(accumulated, buckets[b].box);
+                    accumulated_count += buckets[b].count;
+                    right_area[b] = accumulated_count ? accumulated.surfaceArea() : 0.f;
+                    right_count[b] = accumulated_count;
+                }
+
+                // sweep from the left and evaluate the split after bucket b
+                accumulated = emptyBox();
+                accumulated_count = 0;
+                for (int b = 0; b < bucket_count - 1; b++)
+                {
+                    accumulated = AABB::getSurroundingBox(accumulated, buckets[b].box);
+                    accumulated_count += buckets[b].count;
+
+                    if (accumulated_count == 0 || right_count[b + 1] == 0)
+                        continue;
+
+                    float cost = accumulated.surfaceArea() * accumulated_count + right_area[b + 1] * right_count[b + 1];
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        split_axis = axis;
+                        best_bucket = b;
+                    }
+                }
+            }
+
+            if (split_axis < 0)
+            {
+                // every centroid is in the same place, binning cannot separate them
+                if (count <= params.max_leaf_size)
+                    return makeLeaf(start, end, box);
+            }
+            else
+            {
+                float leaf_cost = params.intersection_cost * count;
+                float split_cost = params.traversal_cost + params.intersection_cost * best_cost / fmax(box.surfaceArea(), 1e-12f);
+                if (count <= params.max_leaf_size && leaf_cost <= split_cost)
+                    return makeLeaf(start, end, box);
+
+                float scale = bucket_count / extent[split_axis];
+                float axis_min = centroid_box.min[split_axis];
+                auto split = std::partition(primitives.begin() + start, primitives.begin() + end,
+                                            [=](const BuildPrimitive &p)
+                                            {
+                                                int b = std::min(int((p.centroid[split_axis] - axis_min) * scale), bucket_count - 1);
+                                                return b <= best_bucket;
+                                            });
+                mid = split - primitives.begin();
+            }
+        }
+        else if (count <= params.max_leaf_size)
+        {
+            return makeLeaf(start, end, box);
+        }
+
+        if (split_axis < 0 || mid == start || mid == end)
+        {
+            // object median of the largest axis
+            if (split_axis < 0)
+                split_axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+            mid = start + count / 2;
+            std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+                             [=](const BuildPrimitive &a, const BuildPrimitive &b)
+                             { return a.centroid[split_axis] < b.centroid[split_axis]; });
+        }
+
+        int id = nodes.size();
+        nodes.push_back(BVHBuildNode());
+        nodes[id].box = box;
+        nodes[id].first = start;
+        nodes[id].count = 0;
+        nodes[id].axis = split_axis;
+
+        // children are appended after the parent, so the references are only taken once they are done
+        int left = buildRecursive(primitives, start, mid, level + 1);
+        int right = buildRecursive(primitives, mid, end, level + 1);
+        nodes[id].left = left;
+        nodes[id].right = right;
+
+        return id;
+    }
+
+    float BVHBuilder::computeSAHCost() const
+    {
+        if (nodes.empty())
+            return 0.f;
+
+        float root_area = fmax(nodes[0].box.surfaceArea(), 1e-12f);
+        float cost = 0.f;
+        for (const auto &node : nodes)
+        {
+            float probability = node.box.surfaceArea() / root_area;
+            if (node.isLeaf())
+                cost += probability * params.intersection_cost * node.count;
+            else
+                cost += probability * params.traversal_cost;
+        }
+        return cost;
+    }
+
+    SAHBVH::SAHBVH(const HittableList &list, const BVHBuildParams &build_params)
+    {
+        vector<AABB> boxes(list.objects.size());
+        for (int i = 0; i < list.objects.size(); i++)
+        {
+            if (!list.objects[i]->aabb(boxes[i]))
+                std::cerr << "No bounding box in SAHBVH constructor.\n";
+        }
+
+        BVHBuilder builder;
+        builder.build(boxes, build_params);
+
+        nodes = std::move(builder.nodes);
+        objects.resize(builder.order.size());
+        for (int i = 0; i < builder.order.size(); i++)
+        {
+            objects[i] = list.objects[builder.order[i]];
+        }
+
+        build_time = builder.build_time;
+        sah_cost = builder.sah_cost;
+    }
+
+    bool SAHBVH::aabb(AABB &bounding_box) const
+    {
+        if (nodes.empty())
+            return false;
+
+        bounding_box = nodes[0].box;
+        return true;
+    }
+
+    bool SAHBVH::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (nodes.empty())
+            return false;
+
+        return hitNode(0, r, t_min, t_max, rec);
+    }
+
+    bool SAHBVH::hitNode(int id, const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        const BVHBuildNode &node = nodes[id];
+
+        if (!node.box.hit(r, t_min, t_max))
+            return false;
+
+        if (node.isLeaf())
+        {
+            bool hit_anything = false;
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                if (objects[i]->hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+            return hit_anything;
+        }
+
+        // visit the child on the side of the ray origin first so the far one is culled by a closer hit
+        bool reverse = r.direction[node.axis] < 0;
+        int first = reverse ? node.right : node.left;
+        int second = reverse ? node.left : node.right;
+
+        bool hit_first = hitNode(first, r, t_min, t_max, rec);
+        bool hit_second = hitNode(second, r, t_min, hit_first ? rec.t : t_max, rec);
+
+        return hit_first || hit_second;
+    }
+
+    bool SAHBVH::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        if (nodes.empty())
+            return false;
+
+        return occludedNode(0, r, t_min, t_max);
+    }
+
+    bool SAHBVH::occludedNode(int id, const Ray &r, float t_min, float t_max) const
+    {
+        const BVHBuildNode &node = nodes[id];
+
+        if (!node.box.hit(r, t_min, t_max))
+            return false;
+
+        if (node.isLeaf())
+        {
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                if (objects[i]->occluded(r, t_min, t_max))
+                    return true;
+            }
+            return false;
+        }
+
+        bool reverse = r.direction[node.axis] < 0;
+        int first = reverse ? node.right : node.left;
+        int second = reverse ? node.left : node.right;
+
+        return occludedNode(first, r, t_min, t_max) || occludedNode(second, r, t_min, t_max);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/common/hittable.h"
+
+namespace MiniEngine::PathTracing
+{
+    struct BVHBuildParams
+    {
+        int bucket_count = 12;         // number of centroid bins evaluated per axis
+        int max_leaf_size = 4;         // leaves are forced to split above this size
+        float traversal_cost = 1.f;    // cost of visiting an interior node, relative to one primitive test
+        float intersection_cost = 1.f; // cost of testing one primitive
+        bool sah = true;               // otherwise split at the object median of the largest axis
+    };
+
+    struct BVHBuildNode
+    {
+        AABB box;
+        int left;  // the left child always follows its parent, 'left' is kept for readability
+        int right;
+        int first; // first primitive of a leaf
+        int count; // 0 for interior nodes
+        int axis;
+
+        bool isLeaf() const { return count > 0; }
+    };
+
+    // Binned surface area heuristic builder. The nodes are emitted depth first in
+    // one array and 'order' maps the leaf ranges back to the input primitives.
+    // Below MedianSplitDepth every split is an object median, which halves the
+    // count, so no tree gets deeper than MaxDepth and the fixed traversal stacks
+    // of the BVHs built on top of it cannot overflow.
+    class BVHBuilder
+    {
+    public:
+        static const int MedianSplitDepth = 32;
+        static const int MaxDepth = MedianSplitDepth + 31; // edges from the root to the deepest leaf
+
+        vector<BVHBuildNode> nodes;
+        vector<int> order;
+
+        float build_time = 0.f; // seconds
+        float sah_cost = 0.f;   // expected cost of a ray query, relative to one primitive test
+        int depth = 0;          // of the deepest leaf, the root is 0
+
+        void build(const vector<AABB> &boxes, const BVHBuildParams &build_params);
+
+    private:
+        struct BuildPrimitive
+        {
+            AABB box;
+            vec3 centroid;
+            int index;
+        };
+
+        BVHBuildParams params;
+
+        int buildRecursive(vector<BuildPrimitive> &primitives, int start, int end, int level);
+        int makeLeaf(int start, int end, const AABB &box);
+        float computeSAHCost() const;
+    };
+
+    class SAHBVH : public Hittable
+    {
+    public:
+        vector<shared_ptr<Hittable>> objects; // reordered so that every leaf references a contiguous range
+        vector<BVHBuildNode> nodes;
+
+        float build_time = 0.f;
+        float sah_cost = 0.f;
+
+        SAHBVH() = default;
+        SAHBVH(const HittableList &list, const BVHBuildParams &build_params = BVHBuildParams());
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+
+    private:
+        bool hitNode(int id, const Ray &r, float t_min, float t_max, HitRecord &rec) const;
+        bool occludedNode(int id, const Ray &r, float t_min, float t_max) const;
+    };
+}
@@ -0,0 +1,254 @@
+#include "runtime/function/render/pathtracing/acc_struct/tlas.h"
+#include "runtime/function/render/pathtracing/common/render_statistics.h"
+
+#include <chrono>
+
+namespace MiniEngine::PathTracing
+{
+    Instance::Instance(int blas, const mat4 &transform, const AABB &object_bounds, int first_light)
+        : blas(blas), object_to_world(transform), first_light(first_light)
+    {
+        world_to_object = inverse(transform);
+        normal_to_world = transpose(mat3(world_to_object));
+        scale = cbrt(fabs(determinant(mat3(transform))));
+        identity = transform == mat4(1.f);
+
+        // world box around the eight transformed corners
+        bounds = AABB(vec3(INF), vec3(-INF));
+        for (int corner = 0; corner < 8; corner++)
+        {
+            vec3 p((corner & 1) ? object_bounds.max.x : object_bounds.min.x,
+                   (corner & 2) ? object_bounds.max.y : object_bounds.min.y,
+                   (corner & 4) ? object_bounds.max.z : object_bounds.min.z);
+            vec3 q = vec3(transform * vec4(p, 1.f));
+            bounds = AABB(glm::min(bounds.min, q), glm::max(bounds.max, q));
+        }
+    }
+
+    TLAS::TLAS(vector<shared_ptr<Hittable>> blas_list, vector<Instance> instance_list)
+    {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        blases = std::move(blas_list);
+
+        vector<AABB> boxes(instance_list.size());
+        for (size_t i = 0; i < instance_list.size(); i++)
+        {
+            boxes[i] = instance_list[i].bounds;
+        }
+
+        // an instance test costs a transform plus a whole bottom level traversal
+        BVHBuildParams params;
+        params.max_leaf_size = 2;
+        params.intersection_cost = 4.f;
+
+        BVHBuilder builder;
+        builder.build(boxes, params);
+        sah_cost = builder.sah_cost;
+
+        instances.reserve(instance_list.size());
+        for (int id : builder.order)
+        {
+            instances.push_back(instance_list[id]);
+        }
+
+        nodes.resize(builder.nodes.size());
+        for (size_t i = 0; i < builder.nodes.size(); i++)
+        {
+            const BVHBuildNode &src = builder.nodes[i];
+            LinearBVHNode &dst = nodes[i];
+
+            dst.box_min = src.box.min;
+            dst.box_max = src.box.max;
+            dst.axis = static_cast<uint8_t>(src.axis);
+            dst.pad = 0;
+
+            if (src.isLeaf())
+            {
+                dst.primitives_offset = src.first;
+                dst.primitive_count = static_cast<uint16_t>(src.count);
+            }
+            else
+            {
+                dst.second_child_offset = src.right;
+                dst.primitive_count = 0;
+            }
+        }
+
+        std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+        build_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time).count();
+    }
+
+    bool TLAS::aabb(AABB &bounding_box) const
+    {
+        if (nodes.empty())
+            return false;
+
+        bounding_box = AABB(nodes[0].box_min, nodes[0].box_max);
+        return true;
+    }
+
+    bool TLAS::hitInstance(const Instance &instance, const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        const Hittable &blas = *blases[instance.blas];
+
+        if (instance.identity)
+        {
+            if (!blas.hit(r, t_min, t_max, rec))
+                return false;
+        }
+        else
+        {
+            // object space ray, its distances are world distances times the length of the transformed direction
+            vec3 direction = mat3(instance.world_to_object) * r.direction;
+            float length_scale = length(direction);
+            Ray object_ray(vec3(instance.world_to_object * vec4(r.origin, 1.f)), direction);
+
+            if (!blas.hit(object_ray, t_min * length_scale, t_max * length_scale, rec))
+                return false;
+
+            // the normal keeps facing the ray under any invertible transform
+            rec.t /= length_scale;
+            rec.hit_point.Position = r.cast(rec.t);
+            rec.hit_point.Normal = normalize(instance.normal_to_world * rec.hit_point.Normal);
+            rec.uv_density /= instance.scale;
+        }
+
+        if (rec.light_id >= 0)
+            rec.light_id += instance.first_light;
+        return true;
+    }
+
+    bool TLAS::occludedInstance(const Instance &instance, const Ray &r, float t_min, float t_max) const
+    {
+        const Hittable &blas = *blases[instance.blas];
+        if (instance.identity)
+            return blas.occluded(r, t_min, t_max);
+
+        vec3 direction = mat3(instance.world_to_object) * r.direction;
+        float length_scale = length(direction);
+        Ray object_ray(vec3(instance.world_to_object * vec4(r.origin, 1.f)), direction);
+        return blas.occluded(object_ray, t_min * length_scale, t_max * length_scale);
+    }
+
+    bool TLAS::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        if (nodes.empty())
+            return false;
+
+        TraversalScope counters;
+
+        vec3 inv_direction = 1.f / r.direction;
+        bool dir_is_neg[3] = {inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0};
+
+        int to_visit[MaxStackDepth];
+        int to_visit_offset = 0;
+        int current = 0;
+        bool hit_anything = false;
+
+        while (true)
+        {
+            const LinearBVHNode &node = nodes[current];
+            counters.nodes_visited++;
+
+            if (node.hit(r.origin, inv_direction, t_min, t_max))
+            {
+                if (node.primitive_count > 0)
+                {
+                    for (int i = node.primitives_offset; i < node.primitives_offset + node.primitive_count; i++)
+                    {
+                        if (hitInstance(instances[i], r, t_min, t_max, rec))
+                        {
+                            hit_anything = true;
+                            t_max = rec.t;
+                        }
+                    }
+
+                    if (to_visit_offset == 0)
+                        break;
+                    current = to_visit[--to_visit_offset];
+                }
+                else
+                {
+                    // visit the nearer child first and defer the other one
+                    if (dir_is_neg[node.axis])
+                    {
+                        to_visit[to_visit_offset++] = current + 1;
+                        current = node.second_child_offset;
+                    }
+                    else
+                    {
+                        to_visit[to_visit_offset++] = node.second_child_offset;
+                        current = current + 1;
+                    }
+                }
+            }
+            else
+            {
+                if (to_visit_offset == 0)
+                    break;
+                current = to_visit[--to_visit_offset];
+            }
+        }
+
+        return hit_anything;
+    }
+
+    bool TLAS::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        if (nodes.empty())
+            return false;
+
+        TraversalScope counters;
+
+        vec3 inv_direction = 1.f / r.direction;
+        bool dir_is_neg[3] = {inv_direction.x < 0, inv_direction.y < 0, inv_direction.z < 0};
+
+        int to_visit[MaxStackDepth];
+        int to_visit_offset = 0;
+        int current = 0;
+
+        while (true)
+        {
+            const LinearBVHNode &node = nodes[current];
+            counters.nodes_visited++;
+
+            if (node.hit(r.origin, inv_direction, t_min, t_max))
+            {
+                if (node.primitive_count > 0)
+                {
+                    for (int i = node.primitives_offset; i < node.primitives_offset + node.primitive_count; i++)
+                    {
+                        if (occludedInstance(instances[i], r, t_min, t_max))
+                            return true;
+                    }
+
+                    if (to_visit_offset == 0)
+                        break;
+                    current = to_visit[--to_visit_offset];
+                }
+                else
+                {
+                    if (dir_is_neg[node.axis])
+                    {
+                        to_visit[to_visit_offset++] = current + 1;
+                        current = node.second_child_offset;
+                    }
+                    else
+                    {
+                        to_visit[to_visit_offset++] = node.second_child_offset;
+                        current = current + 1;
+                    }
+                }
+            }
+            else
+            {
+                if (to_visit_offset == 0)
+                    break;
+                current = to_visit[--to_visit_offset];
+            }
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/acc_struct/sah_bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/linear_bvh.h"
+
+namespace MiniEngine::PathTracing
+{
+    // one placement of a bottom level structure
+    struct Instance
+    {
+        int blas;
+        mat4 object_to_world;
+        mat4 world_to_object;
+        mat3 normal_to_world; // inverse transpose of the linear part
+        float scale;          // cube root of the volume scale, converts uv densities
+        bool identity;        // skips the ray transform
+        int first_light;      // LightSampler index of the first emitter of this instance, light ids in the blas are local
+        AABB bounds;          // world space
+
+        Instance(int blas, const mat4 &transform, const AABB &object_bounds, int first_light = 0);
+    };
+
+    // Top level BVH over instances of shared bottom level structures (BVH4, LinearBVH or a plain
+    // TriangleMesh, built in object space). Rays are moved into object space at every instance,
+    // so geometry is stored once however often it is placed and moving an instance only
+    // rebuilds this level.
+    class TLAS : public Hittable
+    {
+    public:
+        vector<shared_ptr<Hittable>> blases;
+        vector<Instance> instances; // reordered so that every leaf references a contiguous range
+        vector<LinearBVHNode> nodes;
+
+        float build_time = 0.f; // seconds
+        float sah_cost = 0.f;
+
+        TLAS() = default;
+        TLAS(vector<shared_ptr<Hittable>> blases, vector<Instance> instances);
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+
+    private:
+        static const int MaxStackDepth = BVHBuilder::MaxDepth + 1; // one deferred child per level
+
+        bool hitInstance(const Instance &instance, const Ray &r, float t_min, float t_max, HitRecord &rec) const;
+        bool occludedInstance(const Instance &instance, const Ray &r, float t_min, float t_max) const;
+    };
+}
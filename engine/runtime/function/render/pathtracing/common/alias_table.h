@@ -0,0 +1,91 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+namespace MiniEngine::PathTracing
+{
+    // Walker / Vose alias table, O(1) sampling of a discrete distribution from a single uniform number.
+    class AliasTable
+    {
+    public:
+        AliasTable() = default;
+        AliasTable(const vector<float> &weights) { build(weights); }
+
+        void build(const vector<float> &weights)
+        {
+            size_t n = weights.size();
+            thresholds.assign(n, 1.f);
+            aliases.resize(n);
+            pmfs.assign(n, 0.f);
+
+            double sum = 0.0;
+            for (float w : weights)
+            {
+                sum += std::max(w, 0.f);
+            }
+            if (n == 0 || sum <= 0.0)
+            {
+                // nothing to prefer, fall back to uniform
+                for (size_t i = 0; i < n; i++)
+                {
+                    pmfs[i] = 1.f / n;
+                    aliases[i] = static_cast<int>(i);
+                }
+                return;
+            }
+
+            vector<double> scaled(n);
+            vector<int> small, large;
+            for (size_t i = 0; i < n; i++)
+            {
+                pmfs[i] = static_cast<float>(std::max(weights[i], 0.f) / sum);
+                scaled[i] = std::max(weights[i], 0.f) / sum * n;
+                aliases[i] = static_cast<int>(i);
+                (scaled[i] < 1.0 ? small : large).push_back(static_cast<int>(i));
+            }
+
+            while (!small.empty() && !large.empty())
+            {
+                int s = small.back();
+                int l = large.back();
+                small.pop_back();
+                large.pop_back();
+
+                thresholds[s] = static_cast<float>(scaled[s]);
+                aliases[s] = l;
+
+                scaled[l] = scaled[l] + scaled[s] - 1.0;
+                (scaled[l] < 1.0 ? small : large).push_back(l);
+            }
+            // whatever is left is 1 up to rounding
+            for (int i : small)
+                thresholds[i] = 1.f;
+            for (int i : large)
+                thresholds[i] = 1.f;
+        }
+
+        // u in [0, 1), returns the index and its probability
+        int sample(float u, float &pmf) const
+        {
+            int n = static_cast<int>(thresholds.size());
+            float scaled = u * n;
+            int i = std::min(static_cast<int>(scaled), n - 1);
+            int index = (scaled - i) < thresholds[i] ? i : aliases[i];
+            pmf = pmfs[index];
+            return index;
+        }
+
+        float pmf(int index) const { return pmfs[index]; }
+        size_t size() const { return pmfs.size(); }
+
+        size_t getMemoryUsage() const
+        {
+            return thresholds.capacity() * sizeof(float) + aliases.capacity() * sizeof(int) + pmfs.capacity() * sizeof(float);
+        }
+
+    private:
+        vector<float> thresholds;
+        vector<int> aliases;
+        vector<float> pmfs;
+    };
+}
@@ -35,7 +35,7 @@ namespace MiniEngine::PathTracing
 
         Ray getRay(f32 s, f32 t) const
         {
-            vec3 rd = lens_radius * vec3(diskRand(1.f), 0);
+            vec3 rd = lens_radius * vec3(randomInDisk(1.f), 0);
             vec3 offset = u * rd.x + v * rd.y;
 
             return Ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset);
@@ -0,0 +1,106 @@
+#include "runtime/function/render/pathtracing/common/film.h"
+
+#include <cstdio>
+
+namespace MiniEngine::PathTracing
+{
+    void Film::resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        clear();
+    }
+
+    void Film::clear()
+    {
+        color.assign(width * height, vec3(0, 0, 0));
+        albedo.assign(width * height, vec3(0, 0, 0));
+        normal.assign(width * height, vec3(0, 0, 0));
+        luminance_sq.assign(width * height, 0.f);
+        sample_counts.assign(width * height, 0);
+    }
+
+    size_t Film::getMemoryUsage() const
+    {
+        return (color.capacity() + albedo.capacity() + normal.capacity()) * sizeof(vec3) +
+               luminance_sq.capacity() * sizeof(float) + sample_counts.capacity() * sizeof(int);
+    }
+
+    float Film::getRelativeError(int x, int y) const
+    {
+        int id = width * y + x;
+        int n = sample_counts[id];
+        if (n < 2)
+            return INF;
+
+        float mean = luminance(color[id]) / n;
+        float variance = std::max(luminance_sq[id] / n - mean * mean, 0.f) * n / (n - 1);
+
+        // the offset keeps near black pixels from demanding samples for invisible noise
+        return sqrt(variance / n) / (mean + 0.01f);
+    }
+
+    void Film::resolve(vector<vec3> &color_out, vector<vec3> &albedo_out, vector<vec3> &normal_out) const
+    {
+        color_out.resize(color.size());
+        albedo_out.resize(albedo.size());
+        normal_out.resize(normal.size());
+        for (size_t i = 0; i < color.size(); i++)
+        {
+            float inv_count = 1.f / float(std::max(sample_counts[i], 1));
+            color_out[i] = color[i] * inv_count;
+            albedo_out[i] = albedo[i] * inv_count;
+            normal_out[i] = normal[i] * inv_count;
+        }
+    }
+
+    void Film::getSampleHeatmap(vector<vec3> &heatmap_out) const
+    {
+        int max_count = 1;
+        for (int count : sample_counts)
+        {
+            max_count = std::max(max_count, count);
+        }
+
+        heatmap_out.resize(sample_counts.size());
+        for (size_t i = 0; i < sample_counts.size(); i++)
+        {
+            // blue -> green -> red
+            float t = float(sample_counts[i]) / float(max_count);
+            heatmap_out[i] = vec3(glm::clamp(2 * t - 1, 0.f, 1.f), 1 - fabs(2 * t - 1), glm::clamp(1 - 2 * t, 0.f, 1.f));
+        }
+    }
+
+    bool Film::writePFM(const std::string &path, int width, int height, const vector<vec3> &image)
+    {
+        static_assert(sizeof(vec3) == 3 * sizeof(float), "vec3 is expected to be tightly packed");
+
+        FILE *file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Failed to open " << path << " for writing" << std::endl;
+            return false;
+        }
+
+        // a negative scale marks little endian data, scanlines go from bottom to top like the film rows
+        fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+        bool ok = fwrite(image.data(), sizeof(vec3), image.size(), file) == image.size();
+        fclose(file);
+
+        if (!ok)
+            std::cerr << "Failed to write " << path << std::endl;
+        return ok;
+    }
+
+    vec3 Film::toneMapACES(const vec3 &color)
+    {
+        const float a = 2.51f;
+        const float b = 0.03f;
+        const float c = 2.43f;
+        const float d = 0.59f;
+        const float e = 0.14f;
+
+        vec3 x = glm::max(color, vec3(0.f));
+        return glm::clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.f, 1.f);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <string>
+
+namespace MiniEngine::PathTracing
+{
+    // Float RGB film keeping running sums of every traced sample, plus the first hit albedo and
+    // normal that the denoiser uses as auxiliary features. Pixels may have different sample
+    // counts (adaptive sampling), so the squared luminance is summed as well for a variance
+    // estimate. Row 0 is the bottom of the image.
+    class Film
+    {
+    public:
+        int width = 0;
+        int height = 0;
+
+        vector<vec3> color;
+        vector<vec3> albedo;
+        vector<vec3> normal;
+        vector<float> luminance_sq;
+        vector<int> sample_counts;
+
+        void resize(int w, int h);
+        void clear();
+        size_t getMemoryUsage() const;
+
+        inline void addSample(int x, int y, const vec3 &sample_color, const vec3 &sample_albedo, const vec3 &sample_normal)
+        {
+            int id = width * y + x;
+            color[id] += sample_color;
+            albedo[id] += sample_albedo;
+            normal[id] += sample_normal;
+
+            float l = luminance(sample_color);
+            luminance_sq[id] += l * l;
+            sample_counts[id]++;
+        }
+
+        inline vec3 getColor(int x, int y) const
+        {
+            int id = width * y + x;
+            return color[id] / float(std::max(sample_counts[id], 1));
+        }
+
+        inline int getSampleCount(int x, int y) const
+        {
+            return sample_counts[width * y + x];
+        }
+
+        // standard error of the pixel mean relative to its brightness, INF until two samples exist
+        float getRelativeError(int x, int y) const;
+
+        // per pixel averages as tightly packed float3 images
+        void resolve(vector<vec3> &color_out, vector<vec3> &albedo_out, vector<vec3> &normal_out) const;
+
+        // sample counts mapped from blue (fewest) to red (most), for checking adaptive sampling
+        void getSampleHeatmap(vector<vec3> &heatmap_out) const;
+
+        static bool writePFM(const std::string &path, int width, int height, const vector<vec3> &image);
+
+        // ACES filmic curve fit by Krzysztof Narkowicz, for linear radiance in [0, inf)
+        static vec3 toneMapACES(const vec3 &color);
+    };
+}
@@ -21,6 +21,16 @@ namespace MiniEngine::PathTracing
         return hit_anything;
     }
 
+    bool HittableList::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        for (const auto &object : objects)
+        {
+            if (object->occluded(r, t_min, t_max))
+                return true;
+        }
+        return false;
+    }
+
     float HittableList::getPDF(const vec3 &o, const vec3 &v) const
     {
         auto weight = 1.0 / objects.size();
@@ -34,8 +44,9 @@ namespace MiniEngine::PathTracing
 
     vec3 HittableList::random(const vec3 &o) const
     {
+        // uniform like getPDF's weights
         auto int_size = static_cast<int>(objects.size());
-        return objects[int(linearRand(0, int_size - 1) + 0.5)]->random(o);
+        return objects[std::min(static_cast<int>(randomFloat() * int_size), int_size - 1)]->random(o);
     }
 
     bool HittableList::aabb(AABB &bounding_box) const
@@ -11,9 +11,12 @@ namespace MiniEngine::PathTracing
     struct HitRecord
     {
         MiniEngine::Vertex hit_point;
-        shared_ptr<Material> mat_ptr;
+        const Material *mat_ptr; // owned by the scene, which outlives every hit record
         float t;
         bool front_face;
+        int light_id = -1; // emitter of the LightSampler that was hit, -1 for anything else
+        float uv_density = 0;   // texture coordinate change per unit of surface length, 0 when unknown
+        float uv_footprint = 0; // width of the ray cone at the hit in uv units, 0 for the sharpest lookup
 
         inline void setFaceNormal(const Ray &r, const vec3 &outward_normal)
         {
@@ -28,6 +31,14 @@ namespace MiniEngine::PathTracing
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const = 0;
         virtual bool aabb(AABB &bounding_box) const = 0;
 
+        // whether anything lies on the ray within (t_min, t_max), for shadow rays. Stops at the
+        // first intersection and fills no record, override it where that is cheaper than hit().
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const
+        {
+            HitRecord rec;
+            return hit(r, t_min, t_max, rec);
+        }
+
         virtual float getArea() const
         {
             return 0.0;
@@ -56,6 +67,7 @@ namespace MiniEngine::PathTracing
         void add(shared_ptr<Hittable> object) { objects.push_back(object); }
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
         virtual bool aabb(AABB &bounding_box) const override;
         virtual float getPDF(const vec3 &o, const vec3 &v) const override;
         virtual vec3 random(const vec3 &o) const override;
@@ -0,0 +1,115 @@
+#include "runtime/function/render/pathtracing/common/light_sampler.h"
+
+namespace MiniEngine::PathTracing
+{
+    void LightSampler::clear()
+    {
+        emitters.clear();
+        power_table = AliasTable();
+        light_bvh.clear();
+    }
+
+    int LightSampler::addTriangle(const vec3 &a, const vec3 &b, const vec3 &c, const vec3 &radiance)
+    {
+        Emitter emitter;
+        emitter.v0 = a;
+        emitter.edge1 = b - a;
+        emitter.edge2 = c - a;
+
+        vec3 n = cross(emitter.edge1, emitter.edge2);
+        emitter.area = 0.5f * length(n);
+        emitter.normal = emitter.area > 0.f ? normalize(n) : vec3(0, 0, 1);
+        emitter.radiance = radiance;
+
+        emitters.push_back(emitter);
+        return emitters.size() - 1;
+    }
+
+    void LightSampler::build(bool use_bvh)
+    {
+        use_light_bvh = use_bvh;
+
+        vector<float> powers(emitters.size());
+        vector<LightBounds> bounds(emitters.size());
+        for (size_t i = 0; i < emitters.size(); i++)
+        {
+            const Emitter &emitter = emitters[i];
+            vec3 v1 = emitter.v0 + emitter.edge1;
+            vec3 v2 = emitter.v0 + emitter.edge2;
+
+            // a lambertian emitter sends pi * area * radiance into its hemisphere
+            powers[i] = PI * emitter.area * luminance(emitter.radiance);
+
+            // padded like TriangleMesh::bounds, so that no box is flat
+            bounds[i].box = AABB(glm::min(emitter.v0, glm::min(v1, v2)) - EPS, glm::max(emitter.v0, glm::max(v1, v2)) + EPS);
+            bounds[i].axis = emitter.normal;
+            bounds[i].cos_theta_o = 1.f;
+            bounds[i].power = powers[i];
+        }
+
+        power_table.build(powers);
+        light_bvh.build(bounds);
+    }
+
+    size_t LightSampler::getMemoryUsage() const
+    {
+        return emitters.capacity() * sizeof(Emitter) + power_table.getMemoryUsage() + light_bvh.getMemoryUsage();
+    }
+
+    int LightSampler::pick(const vec3 &p, const vec3 &n, float u, float &pmf) const
+    {
+        pmf = 0.f;
+        if (emitters.empty())
+            return -1;
+
+        if (use_light_bvh)
+            return light_bvh.sample(p, n, u, pmf);
+        return power_table.sample(u, pmf);
+    }
+
+    float LightSampler::pickPMF(const vec3 &p, const vec3 &n, int light_id) const
+    {
+        if (use_light_bvh)
+            return light_bvh.pmf(p, n, light_id);
+        return power_table.pmf(light_id);
+    }
+
+    bool LightSampler::sample(const vec3 &p, const vec3 &n, float u, const vec2 &u_point, LightSample &ls) const
+    {
+        float pmf;
+        int light_id = pick(p, n, u, pmf);
+        if (light_id < 0 || pmf <= 0.f)
+            return false;
+
+        const Emitter &emitter = emitters[light_id];
+
+        // uniform barycentrics
+        float s = sqrt(u_point.x);
+        ls.position = emitter.v0 + s * (1 - u_point.y) * emitter.edge1 + s * u_point.y * emitter.edge2;
+        ls.normal = emitter.normal;
+        ls.radiance = emitter.radiance;
+        ls.light_id = light_id;
+
+        vec3 to_light = ls.position - p;
+        float distance_squared = dot(to_light, to_light);
+        float cosine = -dot(to_light, emitter.normal) / sqrt(distance_squared);
+        if (cosine <= 0.f || emitter.area <= 0.f || distance_squared <= 0.f)
+            return false;
+
+        ls.pdf = pmf * distance_squared / (cosine * emitter.area);
+        return true;
+    }
+
+    float LightSampler::pdf(const vec3 &p, const vec3 &n, int light_id, const vec3 &light_point) const
+    {
+        const Emitter &emitter = emitters[light_id];
+
+        vec3 to_light = light_point - p;
+        float distance_squared = dot(to_light, to_light);
+        float cosine = -dot(to_light, emitter.normal) / sqrt(distance_squared);
+        if (cosine <= 0.f || emitter.area <= 0.f)
+            return 0.f;
+
+        return pickPMF(p, n, light_id) * distance_squared / (cosine * emitter.area);
+    }
+}
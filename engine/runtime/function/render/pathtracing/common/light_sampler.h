@@ -0,0 +1,59 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+#include "runtime/function/render/pathtracing/common/alias_table.h"
+#include "runtime/function/render/pathtracing/acc_struct/light_bvh.h"
+
+namespace MiniEngine::PathTracing
+{
+    struct LightSample
+    {
+        vec3 position;
+        vec3 normal;
+        vec3 radiance;
+        float pdf; // solid angle density at the shading point, the emitter choice included
+        int light_id;
+    };
+
+    // Every emissive triangle of the scene, chosen either in proportion to its power (alias table)
+    // or by a light BVH that also weighs distance and orientation to the shading point. Emitters
+    // are one sided, like Phong::emitted.
+    class LightSampler
+    {
+    public:
+        struct Emitter
+        {
+            vec3 v0;
+            vec3 edge1;
+            vec3 edge2;
+            vec3 normal;
+            float area;
+            vec3 radiance;
+        };
+
+        vector<Emitter> emitters;
+
+        void clear();
+        int addTriangle(const vec3 &a, const vec3 &b, const vec3 &c, const vec3 &radiance);
+        // call after the last addTriangle, use_light_bvh = false picks by power alone
+        void build(bool use_light_bvh);
+
+        size_t size() const { return emitters.size(); }
+        size_t getMemoryUsage() const;
+
+        // n is the normal of the receiving surface, zero when it scatters to both sides
+        int pick(const vec3 &p, const vec3 &n, float u, float &pmf) const;
+        float pickPMF(const vec3 &p, const vec3 &n, int light_id) const;
+
+        // uniform point on a chosen emitter, false when nothing can light p
+        bool sample(const vec3 &p, const vec3 &n, float u, const vec2 &u_point, LightSample &ls) const;
+
+        // density sample() has for light_point on light_id
+        float pdf(const vec3 &p, const vec3 &n, int light_id, const vec3 &light_point) const;
+
+    private:
+        bool use_light_bvh = false;
+        AliasTable power_table;
+        LightBVH light_bvh;
+    };
+}
@@ -4,33 +4,55 @@
 #include "runtime/function/render/pathtracing/common/onb.h"
 #include "runtime/function/render/pathtracing/common/pdf.h"
 #include "runtime/function/render/render_mesh.h"
-#include "runtime/function/render/render_texture.h"
+#include "runtime/function/render/pathtracing/common/texture_cache.h"
+#include "runtime/function/render/pathtracing/common/microfacet.h"
 
 namespace MiniEngine::PathTracing
 {
     struct HitRecord;
 
-    struct ScatterRecord
+    struct BSDFSample
     {
-        Ray specular_ray;
-        bool is_specular;
-        vec3 attenuation;
-        shared_ptr<PDF> pdf_ptr;
+        vec3 direction;   // unit, world space
+        vec3 weight;      // f * cos / pdf, what the path throughput is multiplied by
+        float pdf;        // solid angle density, meaningless for specular samples
+        bool is_specular; // delta like lobe that light sampling can never produce
     };
 
+    // Materials are evaluated with wo = -r_in.direction and the hit normal facing wo. eval and pdf
+    // only cover the lobes light sampling can reach, specular lobes come from sample() alone.
     class Material
     {
     public:
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const
         {
             return false;
         }
 
-        virtual float scatterPDF(const Ray &r_in, const HitRecord &rec, const Ray &scattered) const
+        // f(wo, wi) * cos(theta_i)
+        virtual vec3 eval(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const
+        {
+            return vec3(0, 0, 0);
+        }
+
+        // density sample() has for wi
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const
         {
             return 0;
         }
 
+        // whether eval can be non zero here, so that sampling the lights pays off
+        virtual bool hasSmoothLobes(const HitRecord &rec) const
+        {
+            return false;
+        }
+
+        // reflectance color, the auxiliary albedo of the denoiser
+        virtual vec3 albedo(const HitRecord &rec) const
+        {
+            return vec3(0, 0, 0);
+        }
+
         virtual vec3 emitted(const Ray &r_in, const HitRecord &rec) const
         {
             return vec3(0, 0, 0);
@@ -40,42 +62,73 @@ namespace MiniEngine::PathTracing
     class Lambertian : public Material
     {
     public:
-        vec3 albedo;
+        vec3 albedo_color;
 
-        Lambertian(const vec3 &a) : albedo(a) {}
+        Lambertian(const vec3 &a) : albedo_color(a) {}
 
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
         {
-            srec.is_specular = false;
-            srec.attenuation = albedo;
-            srec.pdf_ptr = make_shared<CosinePDF>(rec.hit_point.Normal);
+            CosinePDF cosine_pdf(rec.hit_point.Normal);
+            bs.direction = normalize(cosine_pdf.generate());
+            bs.pdf = cosine_pdf.value(bs.direction);
+            if (bs.pdf <= 0)
+                return false;
+
+            // f * cos / pdf = (albedo / pi) * cos / (cos / pi)
+            bs.weight = albedo_color;
+            bs.is_specular = false;
             return true;
         }
 
-        float scatterPDF(const Ray &r_in, const HitRecord &rec, const Ray &scattered) const override
+        virtual vec3 eval(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            auto cosine = dot(rec.hit_point.Normal, wi);
+            return cosine < 0 ? vec3(0, 0, 0) : albedo_color * cosine / PI;
+        }
+
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
         {
-            auto cosine = dot(rec.hit_point.Normal, scattered.direction);
+            auto cosine = dot(rec.hit_point.Normal, wi);
             return cosine < 0 ? 0 : cosine / PI;
         }
+
+        virtual bool hasSmoothLobes(const HitRecord &rec) const override
+        {
+            return true;
+        }
+
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            return albedo_color;
+        }
     };
 
     class Metal : public Material
     {
     public:
-        vec3 albedo;
+        vec3 albedo_color;
         float fuzz;
 
-        Metal(const vec3 &a, float f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+        Metal(const vec3 &a, float f) : albedo_color(a), fuzz(f < 1 ? f : 1) {}
 
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override
+        // the fuzzed mirror has no closed form density, it is sampled like a specular lobe
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
         {
             vec3 reflected = reflect(r_in.direction, rec.hit_point.Normal);
-            srec.specular_ray = Ray(rec.hit_point.Position, reflected + fuzz * sphericalRand(1.f));
-            srec.attenuation = albedo;
-            srec.is_specular = true;
-            srec.pdf_ptr = 0;
+            bs.direction = normalize(reflected + fuzz * randomUnitVector());
+            if (dot(bs.direction, rec.hit_point.Normal) <= 0)
+                return false;
+
+            bs.weight = albedo_color;
+            bs.pdf = 0;
+            bs.is_specular = true;
             return true;
         }
+
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            return albedo_color;
+        }
     };
 
     class Dielectric : public Material
@@ -85,11 +138,8 @@ namespace MiniEngine::PathTracing
 
         Dielectric(float index_of_refraction) : ir(index_of_refraction) {}
 
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
         {
-            srec.is_specular = true;
-            srec.pdf_ptr = nullptr;
-            srec.attenuation = vec3(1.0, 1.0, 1.0);
             float refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
 
             vec3 unit_direction = normalize(r_in.direction);
@@ -97,18 +147,23 @@ namespace MiniEngine::PathTracing
             float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
 
             bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-            vec3 direction;
 
-            if (cannot_refract || reflectance(cos_theta, refraction_ratio) > linearRand(0.f, 1.f))
-                direction = reflect(unit_direction, rec.hit_point.Normal);
+            if (cannot_refract || reflectance(cos_theta, refraction_ratio) > randomFloat())
+                bs.direction = reflect(unit_direction, rec.hit_point.Normal);
             else
-                direction = refract(unit_direction, rec.hit_point.Normal, refraction_ratio);
-
-            srec.specular_ray = Ray(rec.hit_point.Position, direction);
+                bs.direction = refract(unit_direction, rec.hit_point.Normal, refraction_ratio);
 
+            bs.weight = vec3(1.0, 1.0, 1.0);
+            bs.pdf = 0;
+            bs.is_specular = true;
             return true;
         }
 
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            return vec3(1.0, 1.0, 1.0);
+        }
+
     private:
         static float reflectance(float cosine, float ref_idx)
         {
@@ -126,9 +181,9 @@ namespace MiniEngine::PathTracing
 
         Emission(vec3 c) : emit(c) {}
 
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override
+        virtual vec3 albedo(const HitRecord &rec) const override
         {
-            return false;
+            return glm::clamp(emit, 0.f, 1.f);
         }
 
         virtual vec3 emitted(const Ray &r_in, const HitRecord &rec) const override
@@ -140,90 +195,126 @@ namespace MiniEngine::PathTracing
         }
     };
 
+    // Diffuse plus a normalized Phong lobe (Ks, exponent Ns), or a smooth dielectric with an
+    // optional Phong lobe when Ni > 1. The lobes are picked in proportion to their reflectance.
     class Phong : public Material
     {
     public:
         MiniEngine::Material mat;
-        shared_ptr<Texture> diffuse_map;
+        shared_ptr<const MipTexture> diffuse_map; // replaces Kd when set, shared through the TextureCache
+        TextureFilter filter;
 
-        Phong(MiniEngine::Material m, std::string path)
+        Phong(MiniEngine::Material m, shared_ptr<const MipTexture> diffuse_texture, TextureFilter texture_filter)
+            : mat(m), diffuse_map(diffuse_texture), filter(texture_filter)
         {
-            this->mat = m;
-            diffuse_map = make_shared<Image>((path + "/" + mat.map_Kd).c_str());
         }
 
-        virtual bool scatter(const Ray &r_in, const HitRecord &rec, ScatterRecord &srec) const override
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
         {
             if (is_emitted(mat))
             {
                 return false;
             }
 
-            if (is_specular(mat) && linearRand(0.f, 1.f) < 0.5f)
-            {
-                vec3 reflected = reflect(r_in.direction, rec.hit_point.Normal);
-                vec3 noise = 1.f / log(mat.Ns) * ballRand(1.f);
-
-                vec3 normal = normalize(rec.hit_point.Normal);
-                vec3 tangent = normalize(cross(normal, cross(reflected, normal)));
-                vec3 bi_tangent = normalize(cross(normal, tangent));
-
-                f32 noise_n = dot(noise, normal);
-                f32 noise_t = dot(noise, tangent);
-                f32 noise_bt = dot(noise, bi_tangent);
-
-                noise_t = noise_t / dot(normalize(reflected), normal);
-                noise_bt = noise_bt * dot(normalize(reflected), normal);
-
-                noise = normal * noise_n + tangent * noise_t + bi_tangent * noise_bt;
-
-                srec.specular_ray = Ray(rec.hit_point.Position, reflected + noise);
-                srec.attenuation = mat.Ks;
-                srec.is_specular = true;
-                srec.pdf_ptr = nullptr;
+            const vec3 &normal = rec.hit_point.Normal;
+            vec3 kd = diffuseColor(rec);
+            float glossy_probability = glossyProbability(kd);
 
-                return true;
+            if (randomFloat() < glossy_probability)
+            {
+                // normalized Phong lobe around the mirror direction
+                ONB onb;
+                onb.buildONB(reflect(normalize(r_in.direction), normal));
+
+                vec2 u = random2D();
+                float cos_alpha = pow(u.x, 1.f / (exponent() + 1.f));
+                float sin_alpha = sqrt(fmax(0.f, 1.f - cos_alpha * cos_alpha));
+                float phi = 2 * PI * u.y;
+                bs.direction = normalize(onb.local(cos(phi) * sin_alpha, sin(phi) * sin_alpha, cos_alpha));
             }
-
-            if (is_transparent(mat))
+            else if (is_transparent(mat))
             {
                 float refraction_ratio = rec.front_face ? (1.0 / mat.Ni) : mat.Ni;
 
                 vec3 unit_direction = normalize(r_in.direction);
-                float cos_theta = fmin(dot(-unit_direction, rec.hit_point.Normal), 1.0);
+                float cos_theta = fmin(dot(-unit_direction, normal), 1.0);
                 float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
 
                 bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-                vec3 direction;
 
-                if (cannot_refract || reflectance(cos_theta, refraction_ratio) > linearRand(0.f, 1.f))
-                    direction = reflect(unit_direction, rec.hit_point.Normal);
+                if (cannot_refract || reflectance(cos_theta, refraction_ratio) > randomFloat())
+                    bs.direction = reflect(unit_direction, normal);
                 else
-                    direction = refract(unit_direction, rec.hit_point.Normal, refraction_ratio);
-
-                srec.is_specular = true;
-                srec.pdf_ptr = nullptr;
-                srec.attenuation = mat.Tr;
-                srec.specular_ray = Ray(rec.hit_point.Position, direction);
+                    bs.direction = refract(unit_direction, normal, refraction_ratio);
 
+                bs.weight = mat.Tr / (1.f - glossy_probability);
+                bs.pdf = 0;
+                bs.is_specular = true;
                 return true;
             }
-
-            auto attenuation =  diffuse_map->value(rec.hit_point.Texcoord.s, rec.hit_point.Texcoord.t, rec.hit_point.Position);
-            if (attenuation[0]<0)
-            {
-                srec.attenuation = mat.Kd;
-            }
             else
             {
-                srec.attenuation = attenuation;
+                CosinePDF cosine_pdf(normal);
+                bs.direction = normalize(cosine_pdf.generate());
             }
 
-            srec.is_specular = false;
-            srec.pdf_ptr = make_shared<CosinePDF>(rec.hit_point.Normal);
+            // both smooth lobes could have produced the direction, weigh by their combined density
+            bs.pdf = pdf(r_in, rec, bs.direction);
+            if (bs.pdf <= 0)
+                return false;
+
+            bs.weight = eval(r_in, rec, bs.direction) / bs.pdf;
+            bs.is_specular = false;
             return true;
         }
 
+        virtual vec3 eval(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            const vec3 &normal = rec.hit_point.Normal;
+            float cos_i = dot(normal, wi);
+            if (cos_i <= 0 || is_emitted(mat))
+                return vec3(0, 0, 0);
+
+            vec3 f(0, 0, 0);
+            if (!is_transparent(mat))
+                f += diffuseColor(rec) / PI;
+            if (is_specular(mat))
+                f += mat.Ks * (exponent() + 2.f) / (2 * PI) * phongLobe(r_in, normal, wi);
+
+            return f * cos_i;
+        }
+
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            const vec3 &normal = rec.hit_point.Normal;
+            float glossy_probability = glossyProbability(diffuseColor(rec));
+
+            float result = 0;
+            if (!is_transparent(mat))
+            {
+                float cos_i = dot(normal, wi);
+                result += (1 - glossy_probability) * (cos_i <= 0 ? 0 : cos_i / PI);
+            }
+            if (glossy_probability > 0)
+                result += glossy_probability * (exponent() + 1.f) / (2 * PI) * phongLobe(r_in, normal, wi);
+
+            return result;
+        }
+
+        virtual bool hasSmoothLobes(const HitRecord &rec) const override
+        {
+            return !is_emitted(mat) && (!is_transparent(mat) || is_specular(mat));
+        }
+
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            if (is_emitted(mat))
+                return glm::clamp(mat.Ke, 0.f, 1.f);
+            if (is_transparent(mat))
+                return mat.Tr;
+            return glm::clamp(diffuseColor(rec) + mat.Ks, 0.f, 1.f);
+        }
+
         virtual vec3 emitted(const Ray &r_in, const HitRecord &rec) const override
         {
             if (is_emitted(mat) && rec.front_face)
@@ -232,12 +323,6 @@ namespace MiniEngine::PathTracing
                 return vec3(0, 0, 0);
         }
 
-        float scatterPDF(const Ray &r_in, const HitRecord &rec, const Ray &scattered) const override
-        {
-            auto cosine = dot(rec.hit_point.Normal, scattered.direction);
-            return cosine < 0 ? 0 : cosine / PI;
-        }
-
         inline bool is_transparent(MiniEngine::Material mat) const
         {
             if (mat.Ni > 1)
@@ -266,6 +351,35 @@ namespace MiniEngine::PathTracing
         }
 
     private:
+        vec3 diffuseColor(const HitRecord &rec) const
+        {
+            return diffuse_map ? diffuse_map->sample(rec.hit_point.Texcoord, rec.uv_footprint, filter) : mat.Kd;
+        }
+
+        float exponent() const
+        {
+            return fmax(mat.Ns, 0.f);
+        }
+
+        // chance of sampling the Phong lobe, the rest goes to the diffuse or the dielectric lobe
+        float glossyProbability(const vec3 &kd) const
+        {
+            if (!is_specular(mat))
+                return 0;
+            if (is_transparent(mat))
+                return 0.5f;
+
+            float glossy = luminance(mat.Ks);
+            float diffuse = luminance(kd);
+            return glossy + diffuse > 0 ? glossy / (glossy + diffuse) : 0;
+        }
+
+        float phongLobe(const Ray &r_in, const vec3 &normal, const vec3 &wi) const
+        {
+            float cos_alpha = dot(reflect(normalize(r_in.direction), normal), wi);
+            return cos_alpha <= 0 ? 0 : pow(cos_alpha, exponent());
+        }
+
         static float reflectance(float cosine, float ref_idx)
         {
             // Use Schlick's approximation for reflectance.
@@ -275,4 +389,378 @@ namespace MiniEngine::PathTracing
         }
     };
 
+    // GGX reflection with Schlick Fresnel from the base color, the metallic workflow of the
+    // rasterizer. What single scattering loses at high roughness comes back through the
+    // Kulla-Conty lobe, sampled with cosine directions in proportion to its energy.
+    class GGXConductor : public Material
+    {
+    public:
+        vec3 base_color; // F0
+        float roughness;
+        shared_ptr<const MipTexture> base_color_map; // replaces base_color when set
+        TextureFilter filter;
+
+        GGXConductor(const vec3 &color, float r, shared_ptr<const MipTexture> texture = nullptr, TextureFilter texture_filter = TextureFilter::Bilinear)
+            : base_color(color), roughness(r), base_color_map(texture), filter(texture_filter)
+        {
+        }
+
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            vec3 wo = onb.toLocal(-r_in.direction);
+            if (wo.z <= 0)
+                return false;
+
+            vec3 wi;
+            if (randomFloat() < multipleScatteringProbability(wo))
+                wi = cosineRand();
+            else
+                wi = reflect(-wo, GGX::sampleVisibleNormal(wo, GGX::alphaFromRoughness(roughness), random2D()));
+
+            bs.pdf = pdfLocal(wo, wi);
+            if (bs.pdf <= 0)
+                return false;
+
+            bs.direction = onb.local(wi);
+            bs.weight = evalLocal(wo, wi, color(rec)) / bs.pdf;
+            bs.is_specular = false;
+            return true;
+        }
+
+        virtual vec3 eval(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            return evalLocal(onb.toLocal(-r_in.direction), onb.toLocal(wi), color(rec));
+        }
+
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            return pdfLocal(onb.toLocal(-r_in.direction), onb.toLocal(wi));
+        }
+
+        virtual bool hasSmoothLobes(const HitRecord &rec) const override
+        {
+            return true;
+        }
+
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            return color(rec);
+        }
+
+    private:
+        vec3 color(const HitRecord &rec) const
+        {
+            return base_color_map ? base_color_map->sample(rec.hit_point.Texcoord, rec.uv_footprint, filter) : base_color;
+        }
+
+        // the energy share of the compensation lobe, 1 - E(mu_o) at F0 = 1
+        float multipleScatteringProbability(const vec3 &wo) const
+        {
+            return glm::clamp(1.f - GGXAlbedoTable::get().albedo(wo.z, roughness, 1.f), 0.f, 1.f);
+        }
+
+        vec3 evalLocal(const vec3 &wo, const vec3 &wi, const vec3 &f0) const
+        {
+            if (wo.z <= 0 || wi.z <= 0)
+                return vec3(0, 0, 0);
+
+            float alpha = GGX::alphaFromRoughness(roughness);
+            vec3 m = normalize(wo + wi);
+            vec3 single = fresnelSchlick(f0, dot(wo, m)) * GGX::D(m, alpha) * GGX::G2(wo, wi, alpha) / (4 * wo.z * wi.z);
+
+            const GGXAlbedoTable &table = GGXAlbedoTable::get();
+            vec3 multiple = multipleScattering(table.albedo(wo.z, roughness, 1.f), table.albedo(wi.z, roughness, 1.f),
+                                               table.averageAlbedo(roughness, 1.f), averageFresnelSchlick(f0));
+
+            return (single + multiple) * wi.z;
+        }
+
+        float pdfLocal(const vec3 &wo, const vec3 &wi) const
+        {
+            if (wo.z <= 0 || wi.z <= 0)
+                return 0;
+
+            float alpha = GGX::alphaFromRoughness(roughness);
+            vec3 m = normalize(wo + wi);
+            float specular = GGX::visibleNormalPDF(wo, m, alpha) / (4 * dot(wo, m));
+
+            float p = multipleScatteringProbability(wo);
+            return (1 - p) * specular + p * wi.z / PI;
+        }
+    };
+
+    // GGX dielectric interface, rough reflection and refraction (Walter et al. 2007) picked by the
+    // Fresnel term of the sampled visible normal. Radiance is scaled by 1 / eta^2 on refraction.
+    // There is no energy compensation for the transmitted lobe, rough glass stays a little dark.
+    class GGXDielectric : public Material
+    {
+    public:
+        float ir;
+        float roughness;
+        vec3 transmittance;
+
+        GGXDielectric(float index_of_refraction, float r, const vec3 &tr = vec3(1, 1, 1))
+            : ir(index_of_refraction), roughness(r), transmittance(tr)
+        {
+        }
+
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            vec3 wo = onb.toLocal(-r_in.direction);
+            if (wo.z <= 0)
+                return false;
+
+            float eta = rec.front_face ? ir : 1.f / ir;
+            vec3 m = GGX::sampleVisibleNormal(wo, GGX::alphaFromRoughness(roughness), random2D());
+
+            // a pair that ends up on the wrong side of the macro surface belongs to the other lobe
+            vec3 wi;
+            if (randomFloat() < fresnelDielectric(dot(wo, m), eta))
+            {
+                wi = reflect(-wo, m);
+                if (wi.z <= 0)
+                    return false;
+            }
+            else
+            {
+                wi = refract(-wo, m, 1.f / eta);
+                if (wi.z >= 0)
+                    return false;
+            }
+
+            bs.pdf = pdfLocal(wo, wi, eta);
+            if (bs.pdf <= 0)
+                return false;
+
+            bs.direction = onb.local(wi);
+            bs.weight = evalLocal(wo, wi, eta) / bs.pdf;
+            bs.is_specular = false;
+            return true;
+        }
+
+        virtual vec3 eval(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            return evalLocal(onb.toLocal(-r_in.direction), onb.toLocal(wi), rec.front_face ? ir : 1.f / ir);
+        }
+
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            return pdfLocal(onb.toLocal(-r_in.direction), onb.toLocal(wi), rec.front_face ? ir : 1.f / ir);
+        }
+
+        virtual bool hasSmoothLobes(const HitRecord &rec) const override
+        {
+            return true;
+        }
+
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            return transmittance;
+        }
+
+    private:
+        // microfacet normal of a refraction pair, facing the side of wo
+        static vec3 refractionNormal(const vec3 &wo, const vec3 &wi, float eta)
+        {
+            vec3 m = normalize(wo + eta * wi);
+            return m.z < 0 ? -m : m;
+        }
+
+        // eta = n on the far side / n on the side of wo
+        vec3 evalLocal(const vec3 &wo, const vec3 &wi, float eta) const
+        {
+            if (wo.z <= 0 || wi.z == 0)
+                return vec3(0, 0, 0);
+
+            float alpha = GGX::alphaFromRoughness(roughness);
+            if (wi.z > 0)
+            {
+                vec3 m = normalize(wo + wi);
+                float f = fresnelDielectric(dot(wo, m), eta) * GGX::D(m, alpha) * GGX::G2(wo, wi, alpha) / (4 * wo.z * wi.z);
+                return vec3(f * wi.z);
+            }
+
+            vec3 m = refractionNormal(wo, wi, eta);
+            float cos_om = dot(wo, m), cos_im = dot(wi, m);
+            if (cos_om <= 0 || cos_im >= 0)
+                return vec3(0, 0, 0);
+
+            float denom = cos_im + cos_om / eta;
+            float f = (1 - fresnelDielectric(cos_om, eta)) * GGX::D(m, alpha) * GGX::G2(wo, wi, alpha) *
+                      fabs(cos_im * cos_om / (denom * denom * wo.z * wi.z)) / (eta * eta);
+            return transmittance * f * fabs(wi.z);
+        }
+
+        float pdfLocal(const vec3 &wo, const vec3 &wi, float eta) const
+        {
+            if (wo.z <= 0 || wi.z == 0)
+                return 0;
+
+            float alpha = GGX::alphaFromRoughness(roughness);
+            if (wi.z > 0)
+            {
+                vec3 m = normalize(wo + wi);
+                return fresnelDielectric(dot(wo, m), eta) * GGX::visibleNormalPDF(wo, m, alpha) / (4 * dot(wo, m));
+            }
+
+            vec3 m = refractionNormal(wo, wi, eta);
+            float cos_om = dot(wo, m), cos_im = dot(wi, m);
+            if (cos_om <= 0 || cos_im >= 0)
+                return 0;
+
+            // change of variables from the microfacet normal to the refracted direction
+            float denom = cos_im + cos_om / eta;
+            return (1 - fresnelDielectric(cos_om, eta)) * GGX::visibleNormalPDF(wo, m, alpha) * fabs(cos_im) / (denom * denom);
+        }
+    };
+
+    // GGX dielectric coat over a Lambertian base. The base only receives what the coat does not
+    // reflect, (1 - E(mu_o)) (1 - E(mu_i)) / (1 - Eavg), so a white plastic reflects everything.
+    class GGXPlastic : public Material
+    {
+    public:
+        vec3 diffuse_color;
+        float roughness;
+        float ir;
+        shared_ptr<const MipTexture> diffuse_map; // replaces diffuse_color when set
+        TextureFilter filter;
+
+        GGXPlastic(const vec3 &kd, float r, float index_of_refraction = 1.5f, shared_ptr<const MipTexture> texture = nullptr,
+                   TextureFilter texture_filter = TextureFilter::Bilinear)
+            : diffuse_color(kd), roughness(r), ir(index_of_refraction), diffuse_map(texture), filter(texture_filter)
+        {
+        }
+
+        virtual bool sample(const Ray &r_in, const HitRecord &rec, BSDFSample &bs) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            vec3 wo = onb.toLocal(-r_in.direction);
+            if (wo.z <= 0)
+                return false;
+
+            vec3 kd = color(rec);
+            vec3 wi;
+            if (randomFloat() < specularProbability(wo, kd))
+                wi = reflect(-wo, GGX::sampleVisibleNormal(wo, GGX::alphaFromRoughness(roughness), random2D()));
+            else
+                wi = cosineRand();
+
+            bs.pdf = pdfLocal(wo, wi, kd);
+            if (bs.pdf <= 0)
+                return false;
+
+            bs.direction = onb.local(wi);
+            bs.weight = evalLocal(wo, wi, kd) / bs.pdf;
+            bs.is_specular = false;
+            return true;
+        }
+
+        virtual vec3 eval(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            return evalLocal(onb.toLocal(-r_in.direction), onb.toLocal(wi), color(rec));
+        }
+
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const vec3 &wi) const override
+        {
+            ONB onb;
+            onb.buildONB(rec.hit_point.Normal);
+            return pdfLocal(onb.toLocal(-r_in.direction), onb.toLocal(wi), color(rec));
+        }
+
+        virtual bool hasSmoothLobes(const HitRecord &rec) const override
+        {
+            return true;
+        }
+
+        virtual vec3 albedo(const HitRecord &rec) const override
+        {
+            return color(rec);
+        }
+
+    private:
+        vec3 color(const HitRecord &rec) const
+        {
+            return diffuse_map ? diffuse_map->sample(rec.hit_point.Texcoord, rec.uv_footprint, filter) : diffuse_color;
+        }
+
+        float f0() const
+        {
+            float r = (ir - 1) / (ir + 1);
+            return r * r;
+        }
+
+        // the coat in proportion to the energy it reflects towards wo
+        float specularProbability(const vec3 &wo, const vec3 &kd) const
+        {
+            float coat = GGXAlbedoTable::get().albedo(wo.z, roughness, f0());
+            float base = luminance(kd) * (1 - coat);
+            return coat + base > 0 ? coat / (coat + base) : 1;
+        }
+
+        vec3 evalLocal(const vec3 &wo, const vec3 &wi, const vec3 &kd) const
+        {
+            if (wo.z <= 0 || wi.z <= 0)
+                return vec3(0, 0, 0);
+
+            float alpha = GGX::alphaFromRoughness(roughness);
+            vec3 m = normalize(wo + wi);
+            float specular = (f0() + (1 - f0()) * schlickWeight(dot(wo, m))) * GGX::D(m, alpha) * GGX::G2(wo, wi, alpha) / (4 * wo.z * wi.z);
+
+            const GGXAlbedoTable &table = GGXAlbedoTable::get();
+            float e_o = table.albedo(wo.z, roughness, f0());
+            float e_i = table.albedo(wi.z, roughness, f0());
+            float e_avg = table.averageAlbedo(roughness, f0());
+            vec3 diffuse = kd / PI * (1 - e_o) * (1 - e_i) / (1 - e_avg);
+
+            return (vec3(specular) + diffuse) * wi.z;
+        }
+
+        float pdfLocal(const vec3 &wo, const vec3 &wi, const vec3 &kd) const
+        {
+            if (wo.z <= 0 || wi.z <= 0)
+                return 0;
+
+            float alpha = GGX::alphaFromRoughness(roughness);
+            vec3 m = normalize(wo + wi);
+            float specular = GGX::visibleNormalPDF(wo, m, alpha) / (4 * dot(wo, m));
+
+            float p = specularProbability(wo, kd);
+            return p * specular + (1 - p) * wi.z / PI;
+        }
+    };
+
+    inline bool isEmissive(const MiniEngine::Material &m)
+    {
+        return m.Ke[0] > 0 || m.Ke[1] > 0 || m.Ke[2] > 0;
+    }
+
+    // Phong for classic mtl files. With the PBR extension (Pr roughness, Pm metallic) metals become
+    // GGXConductor, transparent materials GGXDielectric and everything else GGXPlastic.
+    inline shared_ptr<Material> makeMaterial(const MiniEngine::Material &m, shared_ptr<const MipTexture> diffuse_texture, TextureFilter filter)
+    {
+        if (isEmissive(m) || (m.Pr <= 0 && m.Pm <= 0))
+            return make_shared<Phong>(m, diffuse_texture, filter);
+
+        if (m.Pm >= 0.5f)
+            return make_shared<GGXConductor>(m.Kd, m.Pr, diffuse_texture, filter);
+        if (m.Ni > 1)
+            return make_shared<GGXDielectric>(m.Ni, m.Pr, m.Tr);
+        return make_shared<GGXPlastic>(m.Kd, m.Pr, 1.5f, diffuse_texture, filter);
+    }
+
 }
\ No newline at end of file
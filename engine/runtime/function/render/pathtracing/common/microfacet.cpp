@@ -0,0 +1,147 @@
+#include "runtime/function/render/pathtracing/common/microfacet.h"
+
+namespace MiniEngine::PathTracing
+{
+    // base 2 van der Corput sequence
+    static float radicalInverse(uint32_t bits)
+    {
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return bits * 2.3283064365386963e-10f;
+    }
+
+    vec3 GGX::sampleVisibleNormal(const vec3 &wo, float alpha, const vec2 &u)
+    {
+        // stretch to the hemisphere configuration
+        vec3 vh = normalize(vec3(alpha * wo.x, alpha * wo.y, wo.z));
+
+        float length2 = vh.x * vh.x + vh.y * vh.y;
+        vec3 t1 = length2 > 0 ? vec3(-vh.y, vh.x, 0) / sqrt(length2) : vec3(1, 0, 0);
+        vec3 t2 = cross(vh, t1);
+
+        // point on the projected area, the half disk below vh is squeezed by its foreshortening
+        float r = sqrt(u.x);
+        float phi = 2 * PI * u.y;
+        float p1 = r * cos(phi);
+        float p2 = r * sin(phi);
+        float s = 0.5f * (1.f + vh.z);
+        p2 = (1.f - s) * sqrt(fmax(0.f, 1.f - p1 * p1)) + s * p2;
+
+        vec3 nh = p1 * t1 + p2 * t2 + sqrt(fmax(0.f, 1.f - p1 * p1 - p2 * p2)) * vh;
+
+        // unstretch
+        return normalize(vec3(alpha * nh.x, alpha * nh.y, fmax(0.f, nh.z)));
+    }
+
+    const GGXAlbedoTable &GGXAlbedoTable::get()
+    {
+        static const GGXAlbedoTable table;
+        return table;
+    }
+
+    GGXAlbedoTable::GGXAlbedoTable()
+    {
+        // Hammersley points over the visible normals, f * cos / pdf of a VNDF sample is G2 / G1
+        const int sample_count = 512;
+
+        for (int j = 0; j < Size; j++)
+        {
+            float roughness = (j + 0.5f) / Size;
+            float alpha = GGX::alphaFromRoughness(roughness);
+
+            for (int i = 0; i < Size; i++)
+            {
+                float cos_o = (i + 0.5f) / Size;
+                vec3 wo(sqrt(1.f - cos_o * cos_o), 0.f, cos_o);
+
+                double s = 0, b = 0;
+                for (int k = 0; k < sample_count; k++)
+                {
+                    vec2 u((k + 0.5f) / sample_count, radicalInverse(k));
+
+                    vec3 m = GGX::sampleVisibleNormal(wo, alpha, u);
+                    vec3 wi = reflect(-wo, m);
+                    if (wi.z <= 0)
+                        continue;
+
+                    float weight = GGX::G2(wo, wi, alpha) / GGX::G1(wo, alpha);
+                    float fresnel = schlickWeight(dot(wo, m));
+                    s += weight * (1.f - fresnel);
+                    b += weight * fresnel;
+                }
+
+                scale[j * Size + i] = static_cast<float>(s / sample_count);
+                bias[j * Size + i] = static_cast<float>(b / sample_count);
+            }
+
+            // Eavg = 2 * integral of E(mu) mu dmu, midpoint rule over the table cells
+            double s = 0, b = 0;
+            for (int i = 0; i < Size; i++)
+            {
+                float cos_o = (i + 0.5f) / Size;
+                s += 2.0 * scale[j * Size + i] * cos_o / Size;
+                b += 2.0 * bias[j * Size + i] * cos_o / Size;
+            }
+            average_scale[j] = static_cast<float>(s);
+            average_bias[j] = static_cast<float>(b);
+        }
+    }
+
+    void GGXAlbedoTable::lookup(float cos_o, float roughness, float &s, float &b) const
+    {
+        // samples sit at cell centers, clamp to the outer ones
+        float x = glm::clamp(cos_o * Size - 0.5f, 0.f, Size - 1.f);
+        float y = glm::clamp(roughness * Size - 0.5f, 0.f, Size - 1.f);
+        int x0 = std::min(static_cast<int>(x), Size - 2), y0 = std::min(static_cast<int>(y), Size - 2);
+        float fx = x - x0, fy = y - y0;
+
+        auto blend = [&](const std::array<float, Size * Size> &t) {
+            const float *row0 = &t[y0 * Size + x0];
+            const float *row1 = row0 + Size;
+            return (1 - fy) * ((1 - fx) * row0[0] + fx * row0[1]) + fy * ((1 - fx) * row1[0] + fx * row1[1]);
+        };
+        s = blend(scale);
+        b = blend(bias);
+    }
+
+    void GGXAlbedoTable::lookupAverage(float roughness, float &s, float &b) const
+    {
+        float y = glm::clamp(roughness * Size - 0.5f, 0.f, Size - 1.f);
+        int y0 = std::min(static_cast<int>(y), Size - 2);
+        float fy = y - y0;
+
+        s = (1 - fy) * average_scale[y0] + fy * average_scale[y0 + 1];
+        b = (1 - fy) * average_bias[y0] + fy * average_bias[y0 + 1];
+    }
+
+    float GGXAlbedoTable::albedo(float cos_o, float roughness, float f0) const
+    {
+        float s, b;
+        lookup(cos_o, roughness, s, b);
+        return f0 * s + b;
+    }
+
+    vec3 GGXAlbedoTable::albedo(float cos_o, float roughness, const vec3 &f0) const
+    {
+        float s, b;
+        lookup(cos_o, roughness, s, b);
+        return f0 * s + vec3(b);
+    }
+
+    float GGXAlbedoTable::averageAlbedo(float roughness, float f0) const
+    {
+        float s, b;
+        lookupAverage(roughness, s, b);
+        return f0 * s + b;
+    }
+
+    vec3 GGXAlbedoTable::averageAlbedo(float roughness, const vec3 &f0) const
+    {
+        float s, b;
+        lookupAverage(roughness, s, b);
+        return f0 * s + vec3(b);
+    }
+}
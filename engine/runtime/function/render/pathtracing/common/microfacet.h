@@ -0,0 +1,134 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <array>
+
+namespace MiniEngine::PathTracing
+{
+    // GGX microfacet distribution with the height correlated Smith masking. Directions are unit
+    // vectors in the shading frame, the normal is +z.
+    namespace GGX
+    {
+        // roughness is perceptual like in the rasterizer, alpha = roughness^2. The lower bound
+        // keeps D finite, near mirror lobes are still sampled exactly enough.
+        inline float alphaFromRoughness(float roughness)
+        {
+            float r = glm::clamp(roughness, 0.f, 1.f);
+            return fmax(r * r, 1e-3f);
+        }
+
+        inline float D(const vec3 &m, float alpha)
+        {
+            if (m.z <= 0)
+                return 0;
+            float a2 = alpha * alpha;
+            float d = m.z * m.z * (a2 - 1.f) + 1.f;
+            return a2 / (PI * d * d);
+        }
+
+        inline float lambda(const vec3 &w, float alpha)
+        {
+            float cos2 = w.z * w.z;
+            if (cos2 >= 1.f)
+                return 0;
+            float tan2 = (1.f - cos2) / fmax(cos2, 1e-8f);
+            return 0.5f * (-1.f + sqrt(1.f + alpha * alpha * tan2));
+        }
+
+        inline float G1(const vec3 &w, float alpha)
+        {
+            return 1.f / (1.f + lambda(w, alpha));
+        }
+
+        inline float G2(const vec3 &wo, const vec3 &wi, float alpha)
+        {
+            return 1.f / (1.f + lambda(wo, alpha) + lambda(wi, alpha));
+        }
+
+        // microfacet normal from the distribution of normals visible from wo (Heitz 2018)
+        vec3 sampleVisibleNormal(const vec3 &wo, float alpha, const vec2 &u);
+
+        // density of sampleVisibleNormal for m
+        inline float visibleNormalPDF(const vec3 &wo, const vec3 &m, float alpha)
+        {
+            float cos_om = dot(wo, m);
+            if (cos_om <= 0 || wo.z <= 0)
+                return 0;
+            return G1(wo, alpha) * cos_om * D(m, alpha) / wo.z;
+        }
+    }
+
+    inline float schlickWeight(float cosine)
+    {
+        float m = glm::clamp(1.f - cosine, 0.f, 1.f);
+        float m2 = m * m;
+        return m2 * m2 * m;
+    }
+
+    inline vec3 fresnelSchlick(const vec3 &f0, float cosine)
+    {
+        return f0 + (vec3(1.f) - f0) * schlickWeight(cosine);
+    }
+
+    // hemispherical average of the Schlick Fresnel, 2 * integral of F(mu) mu dmu
+    inline vec3 averageFresnelSchlick(const vec3 &f0)
+    {
+        return f0 + (vec3(1.f) - f0) / 21.f;
+    }
+
+    // unpolarized Fresnel reflectance of a dielectric interface, eta = n_transmitted / n_incident
+    inline float fresnelDielectric(float cos_i, float eta)
+    {
+        cos_i = glm::clamp(cos_i, 0.f, 1.f);
+        float sin2_t = (1.f - cos_i * cos_i) / (eta * eta);
+        if (sin2_t >= 1.f)
+            return 1.f;
+
+        float cos_t = sqrt(1.f - sin2_t);
+        float r_parallel = (eta * cos_i - cos_t) / (eta * cos_i + cos_t);
+        float r_perpendicular = (cos_i - eta * cos_t) / (cos_i + eta * cos_t);
+        return 0.5f * (r_parallel * r_parallel + r_perpendicular * r_perpendicular);
+    }
+
+    // Directional albedo of single scattering GGX reflection, tabulated over cos(theta_o) and
+    // roughness like the E and Eavg LUTs of the Kulla-Conty material in rtr. With Schlick
+    // Fresnel the albedo is linear in F0, so E(F0) = F0 * scale + bias and E(1) is the energy
+    // multiple scattering has to make up for.
+    class GGXAlbedoTable
+    {
+    public:
+        static const int Size = 32;
+
+        // built once, on first use
+        static const GGXAlbedoTable &get();
+
+        float albedo(float cos_o, float roughness, float f0) const;
+        vec3 albedo(float cos_o, float roughness, const vec3 &f0) const;
+        float averageAlbedo(float roughness, float f0) const;
+        vec3 averageAlbedo(float roughness, const vec3 &f0) const;
+
+    private:
+        std::array<float, Size * Size> scale;
+        std::array<float, Size * Size> bias;
+        std::array<float, Size> average_scale;
+        std::array<float, Size> average_bias;
+
+        GGXAlbedoTable();
+
+        void lookup(float cos_o, float roughness, float &s, float &b) const;
+        void lookupAverage(float roughness, float &s, float &b) const;
+    };
+
+    // Kulla-Conty multiple scattering lobe for a GGX reflector with directional albedo e_o, e_i
+    // (at F0 = 1), average albedo e_avg and average Fresnel f_avg. It is diffuse like, so it
+    // returns f and leaves the cosine to the caller.
+    inline vec3 multipleScattering(float e_o, float e_i, float e_avg, const vec3 &f_avg)
+    {
+        if (e_avg >= 1.f)
+            return vec3(0.f);
+        float f_ms = (1.f - e_o) * (1.f - e_i) / (PI * (1.f - e_avg));
+        vec3 f_add = f_avg * e_avg / (vec3(1.f) - f_avg * (1.f - e_avg));
+        return f_ms * f_add;
+    }
+}
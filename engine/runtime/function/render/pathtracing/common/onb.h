@@ -21,6 +21,12 @@ namespace MiniEngine::PathTracing
             return a.x * axis[0] + a.y * axis[1] + a.z * axis[2];
         }
 
+        // world direction in this basis
+        vec3 toLocal(const vec3 &a) const
+        {
+            return vec3(dot(a, axis[0]), dot(a, axis[1]), dot(a, axis[2]));
+        }
+
         void buildONB(const vec3 &n)
         {
             axis[2] = normalize(n);
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "runtime/function/render/pathtracing/common/util.h"
-#include "runtime/function/render/pathtracing/common/hittable.h"
 
 namespace MiniEngine::PathTracing
 {
@@ -19,6 +18,7 @@ namespace MiniEngine::PathTracing
     public:
         ONB onb;
 
+        CosinePDF() {}
         CosinePDF(const vec3 &normal)
         {
             onb.buildONB(normal);
@@ -35,51 +35,4 @@ namespace MiniEngine::PathTracing
             return onb.local(cosineRand());
         }
     };
-
-    class HittablePDF : public PDF
-    {
-    public:
-        vec3 o;
-        shared_ptr<Hittable> ptr;
-
-        HittablePDF(shared_ptr<Hittable> p, const vec3 &origin) : ptr(p), o(origin) {}
-
-        virtual float value(const vec3 &direction) const override
-        {
-            return ptr->getPDF(o, direction);
-        }
-
-        virtual vec3 generate() const override
-        {
-            return ptr->random(o);
-        }
-    };
-
-    class MixturePDF : public PDF
-    {
-    public:
-        shared_ptr<PDF> p[2];
-        float weight;
-
-        MixturePDF(shared_ptr<PDF> p0, shared_ptr<PDF> p1, float w)
-        {
-            p[0] = p0;
-            p[1] = p1;
-            weight = w;
-        }
-
-        virtual float value(const vec3 &direction) const override
-        {
-            return (1.0 - weight) * p[0]->value(direction) + weight * p[1]->value(direction);
-        }
-
-        virtual vec3 generate() const override
-        {
-            if (linearRand(0.f,1.f) < (1.0 - weight))
-                return p[0]->generate();
-            else
-                return p[1]->generate();
-        }
-
-    };
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "runtime/function/render/pathtracing/common/render_statistics.h"
+
+#include <iomanip>
+
+namespace MiniEngine::PathTracing
+{
+    void RenderStatistics::print(std::ostream &out) const
+    {
+        auto megabytes = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+        auto perSample = [&](long long count) { return camera_samples > 0 ? double(count) / camera_samples : 0.0; };
+        float trace_seconds = std::max(trace_time, 1e-6f);
+
+        std::ios_base::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(2);
+
+        out << "Memory                      MB\n"
+            << "  primitives        " << std::setw(12) << megabytes(primitive_bytes) << "\n"
+            << "  bvh nodes         " << std::setw(12) << megabytes(bvh_bytes) << "\n"
+            << "  lights            " << std::setw(12) << megabytes(light_bytes) << "\n"
+            << "  textures          " << std::setw(12) << megabytes(texture_bytes) << "  (" << textures << " files)\n"
+            << "  films             " << std::setw(12) << megabytes(film_bytes) << "\n"
+            << "  total             " << std::setw(12) << megabytes(getTotalBytes()) << "  (" << materials << " materials)\n";
+
+        out << "Work                     count     per sample\n"
+            << "  camera samples    " << std::setw(12) << camera_samples << "\n"
+            << "  rays              " << std::setw(12) << rays << std::setw(15) << perSample(rays) << "  (" << rays / trace_seconds / 1e6 << " M/s)\n"
+            << "  nodes visited     " << std::setw(12) << nodes_visited << std::setw(15) << perSample(nodes_visited) << "\n"
+            << "  triangle tests    " << std::setw(12) << triangle_tests << std::setw(15) << perSample(triangle_tests) << "\n"
+            << "  path vertices     " << std::setw(12) << path_vertices << std::setw(15) << getAveragePathLength() << "\n"
+            << "  roulette kills    " << std::setw(12) << roulette_terminations << std::setw(15) << perSample(roulette_terminations) << "\n";
+
+        out << "Time                         s\n"
+            << "  transfer          " << std::setw(12) << transfer_time << "\n"
+            << "  build             " << std::setw(12) << build_time << "\n"
+            << "  trace             " << std::setw(12) << trace_time << "\n"
+            << "  denoise           " << std::setw(12) << denoise_time << "\n"
+            << "  write             " << std::setw(12) << write_time << "\n"
+            << "  total             " << std::setw(12) << total_time << std::endl;
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    json11::Json RenderStatistics::toJson() const
+    {
+        // json11 numbers are doubles, exact for any count a render reaches
+        return json11::Json::object{
+            {"memory", json11::Json::object{
+                           {"primitive_bytes", double(primitive_bytes)},
+                           {"bvh_bytes", double(bvh_bytes)},
+                           {"light_bytes", double(light_bytes)},
+                           {"texture_bytes", double(texture_bytes)},
+                           {"film_bytes", double(film_bytes)},
+                           {"total_bytes", double(getTotalBytes())},
+                           {"materials", materials},
+                           {"textures", textures},
+                       }},
+            {"counters", json11::Json::object{
+                             {"camera_samples", double(camera_samples)},
+                             {"rays", double(rays)},
+                             {"nodes_visited", double(nodes_visited)},
+                             {"triangle_tests", double(triangle_tests)},
+                             {"path_vertices", double(path_vertices)},
+                             {"average_path_length", getAveragePathLength()},
+                             {"roulette_terminations", double(roulette_terminations)},
+                         }},
+            {"time", json11::Json::object{
+                         {"transfer", transfer_time},
+                         {"build", build_time},
+                         {"trace", trace_time},
+                         {"denoise", denoise_time},
+                         {"write", write_time},
+                         {"total", total_time},
+                     }},
+        };
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <json11.hpp>
+
+#include <ostream>
+
+namespace MiniEngine::PathTracing
+{
+    // BVH traversal counts of the calling thread, summed over every query it made
+    struct TraversalCounters
+    {
+        long long nodes_visited = 0;
+        long long triangle_tests = 0;
+
+        static TraversalCounters &local()
+        {
+            static thread_local TraversalCounters counters;
+            return counters;
+        }
+    };
+
+    // Counts one query into locals and adds them to the thread's counters once it returns, so
+    // the traversal loops pay for a register increment and not a thread local access.
+    struct TraversalScope
+    {
+        long long nodes_visited = 0;
+        long long triangle_tests = 0;
+
+        ~TraversalScope()
+        {
+            TraversalCounters &counters = TraversalCounters::local();
+            counters.nodes_visited += nodes_visited;
+            counters.triangle_tests += triangle_tests;
+        }
+    };
+
+    // where the memory and the time of one render went
+    struct RenderStatistics
+    {
+        // bytes
+        size_t primitive_bytes = 0; // triangles, the 4 wide blocks of BVH4 included
+        size_t bvh_bytes = 0;       // nodes of every level and the instances
+        size_t light_bytes = 0;     // emitters with their alias table or light BVH
+        size_t texture_bytes = 0;   // decoded images with their mip chains
+        size_t film_bytes = 0;      // sample sums, display pixels and the adaptive mask
+        int materials = 0;
+        int textures = 0;
+
+        // events
+        long long camera_samples = 0;
+        long long rays = 0;          // closest hit and shadow rays
+        long long nodes_visited = 0; // BVH nodes whose box was tested
+        long long triangle_tests = 0;
+        long long path_vertices = 0; // surface hits over all camera paths
+        long long roulette_terminations = 0;
+
+        // seconds
+        float transfer_time = 0.f; // model to triangles, materials and textures
+        float build_time = 0.f;    // acceleration structures and the light sampler
+        float trace_time = 0.f;
+        float denoise_time = 0.f;
+        float write_time = 0.f;
+        float total_time = 0.f;
+
+        size_t getTotalBytes() const
+        {
+            return primitive_bytes + bvh_bytes + light_bytes + texture_bytes + film_bytes;
+        }
+
+        // surface hits per camera path
+        float getAveragePathLength() const
+        {
+            return camera_samples > 0 ? float(double(path_vertices) / camera_samples) : 0.f;
+        }
+
+        void print(std::ostream &out) const;
+        json11::Json toJson() const;
+    };
+}
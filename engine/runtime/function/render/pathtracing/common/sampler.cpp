@@ -0,0 +1,134 @@
+#include "runtime/function/render/pathtracing/common/sampler.h"
+
+#include <algorithm>
+
+namespace MiniEngine::PathTracing
+{
+    namespace
+    {
+        const float OneMinusEpsilon = 0x1.fffffep-1f;
+
+        thread_local Sampler thread_sampler;
+
+        inline uint32_t mixBits(uint32_t x)
+        {
+            // lowbias32, Chris Wellons
+            x ^= x >> 16;
+            x *= 0x7feb352du;
+            x ^= x >> 15;
+            x *= 0x846ca68bu;
+            x ^= x >> 16;
+            return x;
+        }
+
+        inline uint32_t hashCombine(uint32_t seed, uint32_t v)
+        {
+            return mixBits(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+        }
+
+        inline uint32_t reverseBits(uint32_t x)
+        {
+            x = (x << 16) | (x >> 16);
+            x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+            x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+            x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+            x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+            return x;
+        }
+
+        // Owen scrambling as a hash on reversed bits, Burley 2020 "Practical Hash-based Owen Scrambling"
+        inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+        {
+            x = reverseBits(x);
+            x += seed;
+            x ^= x * 0x6c50b47cu;
+            x ^= x * 0xb82f1e52u;
+            x ^= x * 0xc7afe638u;
+            x ^= x * 0x8d22f6e6u;
+            return reverseBits(x);
+        }
+
+        // first two Sobol dimensions: van der Corput and the (x + 1) polynomial
+        inline uint32_t sobolDimension0(uint32_t index)
+        {
+            return reverseBits(index);
+        }
+
+        inline uint32_t sobolDimension1(uint32_t index)
+        {
+            uint32_t result = 0;
+            for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+            {
+                if (index & 1)
+                    result ^= v;
+            }
+            return result;
+        }
+
+        inline float toUnitFloat(uint32_t x)
+        {
+            return std::min(x * 0x1p-32f, OneMinusEpsilon);
+        }
+    }
+
+    Sampler &Sampler::current()
+    {
+        return thread_sampler;
+    }
+
+    void Sampler::startPixelSample(const glm::ivec2 &pixel, uint32_t sample, uint32_t seed, SamplerType sampler_type)
+    {
+        type = sampler_type;
+        pixel_hash = hashCombine(hashCombine(mixBits(seed), pixel.x), pixel.y);
+        sample_index = sample;
+        dimension = 0;
+
+        if (type == SamplerType::Independent)
+        {
+            rng.seed((static_cast<uint64_t>(pixel_hash) << 32) | sample_index, pixel_hash);
+        }
+    }
+
+    float Sampler::get1D()
+    {
+        if (type == SamplerType::Independent)
+            return independent1D();
+
+        return sobol1D(dimension++);
+    }
+
+    glm::vec2 Sampler::get2D()
+    {
+        if (type == SamplerType::Independent)
+        {
+            float x = independent1D();
+            float y = independent1D();
+            return glm::vec2(x, y);
+        }
+
+        glm::vec2 sample = sobol2D(dimension);
+        dimension += 2;
+        return sample;
+    }
+
+    float Sampler::independent1D()
+    {
+        return std::min(rng.uniformDistribution(0.f, 1.f), OneMinusEpsilon);
+    }
+
+    float Sampler::sobol1D(uint32_t dim)
+    {
+        // every dimension gets its own index shuffle (padding), so dimensions stay uncorrelated
+        uint32_t hash = hashCombine(pixel_hash, dim);
+        uint32_t index = nestedUniformScramble(sample_index, hash);
+        return toUnitFloat(nestedUniformScramble(sobolDimension0(index), hashCombine(hash, 1)));
+    }
+
+    glm::vec2 Sampler::sobol2D(uint32_t dim)
+    {
+        uint32_t hash = hashCombine(pixel_hash, dim);
+        uint32_t index = nestedUniformScramble(sample_index, hash);
+        return glm::vec2(toUnitFloat(nestedUniformScramble(sobolDimension0(index), hashCombine(hash, 1))),
+                         toUnitFloat(nestedUniformScramble(sobolDimension1(index), hashCombine(hash, 2))));
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "runtime/core/math/random.h"
+
+namespace MiniEngine::PathTracing
+{
+    enum class SamplerType
+    {
+        Independent, // PCG stream per pixel sample
+        Sobol        // Owen scrambled, padded 2D Sobol
+    };
+
+    // Per thread sample generator. Every pixel sample reseeds it from (pixel, sample index, seed),
+    // so the image does not depend on which worker traced which pixel.
+    class Sampler
+    {
+    public:
+        void startPixelSample(const glm::ivec2 &pixel, uint32_t sample_index, uint32_t seed, SamplerType type);
+
+        // uniform in [0, 1)
+        float get1D();
+        glm::vec2 get2D();
+
+        // the sampler of the calling thread
+        static Sampler &current();
+
+    private:
+        PCGRNG rng;
+        SamplerType type = SamplerType::Independent;
+        uint32_t pixel_hash = 0;
+        uint32_t sample_index = 0;
+        uint32_t dimension = 0;
+
+        float independent1D();
+        float sobol1D(uint32_t dim);
+        glm::vec2 sobol2D(uint32_t dim);
+    };
+}
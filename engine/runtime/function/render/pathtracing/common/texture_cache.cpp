@@ -0,0 +1,148 @@
+#include "runtime/function/render/pathtracing/common/texture_cache.h"
+
+#include <stb_image.h>
+
+namespace MiniEngine::PathTracing
+{
+    static float decodeSRGB(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static std::array<float, 256> buildSRGBTable()
+    {
+        std::array<float, 256> table;
+        for (int i = 0; i < 256; i++)
+        {
+            table[i] = decodeSRGB(i / 255.f);
+        }
+        return table;
+    }
+
+    const std::array<float, 256> MipTexture::srgb_to_linear = buildSRGBTable();
+
+    uint8_t MipTexture::toSRGB(float value)
+    {
+        float c = glm::clamp(value, 0.f, 1.f);
+        c = c <= 0.0031308f ? 12.92f * c : 1.055f * pow(c, 1.f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(c * 255.f + 0.5f);
+    }
+
+    MipTexture::MipTexture(const unsigned char *data, int width, int height)
+    {
+        Level base;
+        base.width = width;
+        base.height = height;
+        base.texels.assign(data, data + 3 * width * height);
+        levels.push_back(std::move(base));
+
+        // 2x2 box filter down to a single texel, the last row or column is repeated on odd sizes
+        while (levels.back().width > 1 || levels.back().height > 1)
+        {
+            const Level &fine = levels.back();
+            Level coarse;
+            coarse.width = std::max(fine.width / 2, 1);
+            coarse.height = std::max(fine.height / 2, 1);
+            coarse.texels.resize(3 * coarse.width * coarse.height);
+
+            for (int j = 0; j < coarse.height; j++)
+            {
+                for (int i = 0; i < coarse.width; i++)
+                {
+                    int i0 = std::min(2 * i, fine.width - 1), i1 = std::min(2 * i + 1, fine.width - 1);
+                    int j0 = std::min(2 * j, fine.height - 1), j1 = std::min(2 * j + 1, fine.height - 1);
+                    vec3 average = 0.25f * (texel(fine, i0, j0) + texel(fine, i1, j0) + texel(fine, i0, j1) + texel(fine, i1, j1));
+
+                    uint8_t *t = &coarse.texels[3 * (coarse.width * j + i)];
+                    t[0] = toSRGB(average.r), t[1] = toSRGB(average.g), t[2] = toSRGB(average.b);
+                }
+            }
+            levels.push_back(std::move(coarse));
+        }
+    }
+
+    vec3 MipTexture::bilinear(int level, const vec2 &uv) const
+    {
+        const Level &l = levels[level];
+
+        // texel centers sit at half integers
+        float x = (uv.x - floor(uv.x)) * l.width - 0.5f;
+        float y = (uv.y - floor(uv.y)) * l.height - 0.5f;
+        float x0 = floor(x), y0 = floor(y);
+        float fx = x - x0, fy = y - y0;
+
+        int i0 = static_cast<int>(x0), j0 = static_cast<int>(y0);
+        int i1 = i0 + 1, j1 = j0 + 1;
+        i0 = i0 < 0 ? l.width - 1 : i0;
+        j0 = j0 < 0 ? l.height - 1 : j0;
+        i1 = i1 >= l.width ? 0 : i1;
+        j1 = j1 >= l.height ? 0 : j1;
+
+        return (1 - fy) * ((1 - fx) * texel(l, i0, j0) + fx * texel(l, i1, j0)) +
+               fy * ((1 - fx) * texel(l, i0, j1) + fx * texel(l, i1, j1));
+    }
+
+    vec3 MipTexture::sample(const vec2 &uv, float footprint, TextureFilter filter) const
+    {
+        if (filter == TextureFilter::Bilinear || footprint <= 0.f)
+            return bilinear(0, uv);
+
+        // the level where the footprint covers about one texel
+        float lod = log2(footprint * sqrt(float(getWidth()) * float(getHeight())));
+        int last = static_cast<int>(levels.size()) - 1;
+        if (lod <= 0.f)
+            return bilinear(0, uv);
+        if (lod >= last)
+            return bilinear(last, uv);
+
+        int level = static_cast<int>(lod);
+        float t = lod - level;
+        return (1 - t) * bilinear(level, uv) + t * bilinear(level + 1, uv);
+    }
+
+    size_t MipTexture::getMemoryUsage() const
+    {
+        size_t bytes = 0;
+        for (const Level &level : levels)
+        {
+            bytes += level.texels.capacity();
+        }
+        return bytes;
+    }
+
+    shared_ptr<const MipTexture> TextureCache::get(const std::string &path)
+    {
+        auto found = textures.find(path);
+        if (found != textures.end())
+            return found->second;
+
+        shared_ptr<const MipTexture> texture;
+
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(true);
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 3);
+        if (data)
+        {
+            texture = make_shared<MipTexture>(data, width, height);
+            stbi_image_free(data);
+        }
+        else
+        {
+            std::cerr << "ERROR: Could not load texture image file '" << path << "'." << std::endl;
+        }
+
+        textures[path] = texture;
+        return texture;
+    }
+
+    size_t TextureCache::getMemoryUsage() const
+    {
+        size_t bytes = 0;
+        for (const auto &texture : textures)
+        {
+            if (texture.second)
+                bytes += texture.second->getMemoryUsage();
+        }
+        return bytes;
+    }
+}
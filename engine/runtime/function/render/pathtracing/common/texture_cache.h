@@ -0,0 +1,71 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/util.h"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+
+namespace MiniEngine::PathTracing
+{
+    enum class TextureFilter
+    {
+        Bilinear,  // finest level only
+        Trilinear, // level picked by the footprint of the ray cone
+    };
+
+    // RGB texture with its box filtered mip pyramid. Texels stay 8 bit sRGB and are decoded
+    // through a lookup table, mip levels are averaged in linear space. Repeat wrap mode, rows
+    // bottom up like the rasterizer textures.
+    class MipTexture
+    {
+    public:
+        struct Level
+        {
+            int width;
+            int height;
+            vector<uint8_t> texels; // 3 per texel
+        };
+
+        vector<Level> levels;
+
+        MipTexture(const unsigned char *data, int width, int height);
+
+        // footprint is the width of the lookup in uv units, 0 for the sharpest level
+        vec3 sample(const vec2 &uv, float footprint, TextureFilter filter) const;
+
+        int getWidth() const { return levels[0].width; }
+        int getHeight() const { return levels[0].height; }
+        size_t getMemoryUsage() const;
+
+        static float toLinear(uint8_t value) { return srgb_to_linear[value]; }
+        static uint8_t toSRGB(float value);
+
+    private:
+        static const std::array<float, 256> srgb_to_linear;
+
+        vec3 texel(const Level &level, int i, int j) const
+        {
+            const uint8_t *t = &level.texels[3 * (level.width * j + i)];
+            return vec3(srgb_to_linear[t[0]], srgb_to_linear[t[1]], srgb_to_linear[t[2]]);
+        }
+
+        vec3 bilinear(int level, const vec2 &uv) const;
+    };
+
+    // Every texture the path tracer has loaded, by file path, so materials sharing a file share
+    // the decoded pyramid as well. Not thread safe, it is filled before rendering starts.
+    class TextureCache
+    {
+    public:
+        // nullptr when the file cannot be read, failures are remembered too
+        shared_ptr<const MipTexture> get(const std::string &path);
+
+        void clear() { textures.clear(); }
+        size_t size() const { return textures.size(); }
+        size_t getMemoryUsage() const;
+
+    private:
+        std::unordered_map<std::string, shared_ptr<const MipTexture>> textures;
+    };
+}
@@ -10,10 +10,10 @@
 #include <iostream>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/random.hpp>
 
 #include "runtime/core/math/math.h"
 #include "runtime/function/render/pathtracing/common/ray.h"
+#include "runtime/function/render/pathtracing/common/sampler.h"
 
 namespace MiniEngine::PathTracing
 {
@@ -45,10 +45,66 @@ namespace MiniEngine::PathTracing
         return (isnan(v.x)) && (isnan(v.y)) && (isnan(v.z));
     }
 
+    inline float luminance(const vec3 &c)
+    {
+        return dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    // Veach's power heuristic (beta = 2), the MIS weight of a sample drawn with density f_pdf
+    // that could also have come from a strategy with density g_pdf
+    inline float powerHeuristic(float f_pdf, float g_pdf)
+    {
+        float f = f_pdf * f_pdf;
+        float g = g_pdf * g_pdf;
+        return f + g > 0.f ? f / (f + g) : 0.f;
+    }
+
+    // Random Functions, all drawn from the sampler of the calling thread
+
+    inline float randomFloat()
+    {
+        return Sampler::current().get1D();
+    }
+
+    inline float randomFloat(float min, float max)
+    {
+        return min + (max - min) * randomFloat();
+    }
+
+    inline vec2 random2D()
+    {
+        return Sampler::current().get2D();
+    }
+
+    inline vec3 randomUnitVector()
+    {
+        vec2 r = random2D();
+        auto z = 1 - 2 * r.x;
+        auto radius = sqrt(fmax(0.f, 1 - z * z));
+        auto phi = 2 * PI * r.y;
+
+        return vec3(radius * cos(phi), radius * sin(phi), z);
+    }
+
+    inline vec3 randomInBall(float radius)
+    {
+        vec3 direction = randomUnitVector();
+        return radius * cbrt(randomFloat()) * direction;
+    }
+
+    inline vec2 randomInDisk(float radius)
+    {
+        vec2 r = random2D();
+        auto phi = 2 * PI * r.y;
+
+        return radius * sqrt(r.x) * vec2(cos(phi), sin(phi));
+    }
+
     inline vec3 cosineRand()
     {
-        auto r1 = linearRand(0.f, 1.f);
-        auto r2 = linearRand(0.f, 1.f);
+        vec2 r = random2D();
+        auto r1 = r.x;
+        auto r2 = r.y;
         auto z = sqrt(1 - r2);
 
         auto phi = 2 * PI * r1;
@@ -1,6 +1,9 @@
 #include "runtime/function/render/pathtracing/path_tracer.h"
 #include "runtime/function/render/pathtracing/common/util.h"
-#include "runtime/function/render/pathtracing/acc_struct/bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/linear_bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh4.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh_cache.h"
+#include "runtime/function/render/pathtracing/acc_struct/tlas.h"
 #include "runtime/function/render/pathtracing/primitive/sphere.h"
 #include "runtime/function/render/pathtracing/primitive/rectangle.h"
 #include "runtime/function/render/pathtracing/primitive/box.h"
@@ -10,8 +13,10 @@
 #include "runtime/function/render/pathtracing/common/pdf.h"
 #include "thirdparty/oidn/include/OpenImageDenoise/oidn.hpp"
 #include "thirdparty/tbb/include/tbb/parallel_for.h"
+#include "thirdparty/tbb/include/tbb/blocked_range2d.h"
 
-#define MaxLights 8
+#include <thread>
+#include <fstream>
 
 namespace MiniEngine::PathTracing
 {
@@ -19,16 +24,35 @@ namespace MiniEngine::PathTracing
     {
         init_info = make_shared<RenderingInitInfo>();
         init_info->BounceLimit = 4;
+        init_info->RouletteDepth = 3;
+        init_info->Seed = 0;
+        init_info->LowDiscrepancy = false;
+        init_info->MipMapping = true;
         init_info->ImportSample = true;
+        init_info->LightBVH = true;
         init_info->BVH = true;
+        init_info->SAH = true;
+        init_info->LeafSize = 4;
+        init_info->TraversalCost = 1.f;
+        init_info->CacheBVH = true;
+        init_info->SIMD = true;
         init_info->Denoise = true;
+        init_info->ToneMapping = false;
         init_info->MultiThread = true;
         init_info->Output = false;
+        init_info->OutputHDR = false;
         init_info->Resolution = glm::ivec2(1280, 720);
         init_info->SampleCount = 128;
+        init_info->Adaptive = false;
+        init_info->AdaptiveMinSamples = 16;
+        init_info->AdaptiveThreshold = 0.1f;
+        init_info->SampleHeatmap = false;
+        init_info->Progressive = false;
+        init_info->FrameBudget = 50.f;
+        published_settings = *init_info;
     }
 
-    void PathTracer::initializeRenderer()
+    void PathTracer::initializeRenderer(bool create_texture)
     {
         width = init_info->Resolution.x;
         height = init_info->Resolution.y;
@@ -41,6 +65,9 @@ namespace MiniEngine::PathTracing
         pixels = new unsigned char[3 * width * height];
         memset(pixels, 0, sizeof(char) * width * height * 3);
 
+        if (!create_texture)
+            return;
+
         if (result)
         {
             glDeleteTextures(1, &result);
@@ -56,191 +83,281 @@ namespace MiniEngine::PathTracing
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
     }
 
-    vec3 PathTracer::getColor(const Ray &r, const Hittable &mesh, shared_ptr<HittableList> &lights, int depth, bool importance_sampling)
+    vec3 PathTracer::getColor(Ray r, const Hittable &mesh, const LightSampler &lights, int max_depth, int roulette_depth, bool importance_sampling, float spread_angle, PathRecord &path)
     {
-        HitRecord rec;
+        vec3 radiance(0, 0, 0);
+        vec3 throughput(1, 1, 1);
 
-        if (depth <= 0)
-        {
-            return vec3(0, 0, 0);
-        }
+        path = PathRecord();
 
-        if (!mesh.hit(r, EPS, INF, rec))
-        {
-            return vec3(0, 0, 0);
-        }
+        // the previous vertex, for weighing emitters that the BSDF sample ran into
+        vec3 prev_position(0, 0, 0);
+        vec3 prev_normal(0, 0, 0);
+        float prev_pdf = 0;
+        bool prev_specular = true;
 
-        ScatterRecord srec;
-        vec3 emitted = rec.mat_ptr->emitted(r, rec);
+        // ray cone for texture filtering, starting at a point on the pinhole
+        float cone_width = 0;
+        float cone_spread = spread_angle;
 
-        if (!rec.mat_ptr->scatter(r, rec, srec))
+        for (int depth = 0; depth < max_depth; depth++)
         {
-            return emitted;
-        }
+            HitRecord rec;
+            path.ray_count++;
+            if (!mesh.hit(r, EPS, INF, rec))
+                break;
+            path.length++;
 
-        if (srec.is_specular)
-        {
-            return srec.attenuation * getColor(srec.specular_ray, mesh, lights, depth - 1, importance_sampling);
-        }
+            cone_width += cone_spread * rec.t;
+            float cosine = fmax(fabs(dot(r.direction, rec.hit_point.Normal)), 0.01f);
+            rec.uv_footprint = cone_width / cosine * rec.uv_density;
 
-        Ray scattered;
-        float pdf;
-        if (importance_sampling)
-        {
-            auto light_ptr = make_shared<HittablePDF>(lights, rec.hit_point.Position);
-            MixturePDF p(light_ptr, srec.pdf_ptr, 0.5);
+            vec3 emitted = rec.mat_ptr->emitted(r, rec);
+            if (emitted != vec3(0, 0, 0))
+            {
+                // light sampling could have produced this direction as well
+                float weight = 1;
+                if (importance_sampling && !prev_specular && rec.light_id >= 0)
+                    weight = powerHeuristic(prev_pdf, lights.pdf(prev_position, prev_normal, rec.light_id, rec.hit_point.Position));
+                radiance += throughput * emitted * weight;
+            }
+
+            if (depth == 0)
+            {
+                path.normal = rec.hit_point.Normal;
+                path.albedo = rec.mat_ptr->albedo(rec);
+            }
 
-            scattered = Ray(rec.hit_point.Position, p.generate());
-            pdf = p.value(scattered.direction);
+            // next event estimation, one shadow ray to a point on an emitter. Not at the last vertex,
+            // the BSDF sample could not reach a light from there either.
+            const vec3 &position = rec.hit_point.Position;
+            const vec3 &normal = rec.hit_point.Normal;
+            if (importance_sampling && depth + 1 < max_depth && rec.mat_ptr->hasSmoothLobes(rec))
+            {
+                LightSample ls;
+                float u = randomFloat();
+                vec2 u_point = random2D();
+                if (lights.sample(position, normal, u, u_point, ls))
+                {
+                    vec3 to_light = ls.position - position;
+                    float distance = length(to_light);
+                    vec3 direction = to_light / distance;
+
+                    vec3 f = rec.mat_ptr->eval(r, rec, direction);
+                    if (f != vec3(0, 0, 0))
+                    {
+                        path.ray_count++;
+                        if (!mesh.occluded(Ray(position, direction), EPS, distance - EPS))
+                        {
+                            float weight = powerHeuristic(ls.pdf, rec.mat_ptr->pdf(r, rec, direction));
+                            radiance += throughput * f * ls.radiance * weight / ls.pdf;
+                        }
+                    }
+                }
+            }
+
+            BSDFSample bs;
+            if (!rec.mat_ptr->sample(r, rec, bs))
+                break;
+
+            throughput *= bs.weight;
+            prev_position = position;
+            prev_normal = normal;
+            prev_pdf = bs.pdf;
+            prev_specular = bs.is_specular;
+            r = Ray(position, bs.direction);
+
+            // mirrors keep the cone, a rough lobe widens it to the solid angle 1 / pdf a sample stands for
+            if (!bs.is_specular)
+                cone_spread = fmax(cone_spread, sqrt(1.f / (PI * bs.pdf)));
+
+            // Russian roulette, survivors are reweighted so the estimate stays unbiased
+            if (depth + 1 >= roulette_depth)
+            {
+                float survive = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), 0.95f);
+                if (randomFloat() >= survive)
+                {
+                    path.roulette_terminated = true;
+                    break;
+                }
+                throughput /= survive;
+            }
         }
-        else
+
+        return radiance;
+    }
+
+    void PathTracer::publishView(const MiniEngine::Camera &camera)
+    {
+        std::lock_guard<std::mutex> lock(view_mutex);
+        published_view = ViewState::from(camera);
+    }
+
+    PathTracer::ViewState PathTracer::getPublishedView() const
+    {
+        std::lock_guard<std::mutex> lock(view_mutex);
+        return published_view;
+    }
+
+    void PathTracer::publishSettings()
+    {
         {
-            scattered = Ray(rec.hit_point.Position, srec.pdf_ptr->generate());
-            pdf = srec.pdf_ptr->value(scattered.direction);
+            std::lock_guard<std::mutex> lock(view_mutex);
+            published_settings = *init_info;
         }
+        scene_changed = true;
+    }
 
-        return emitted + srec.attenuation * rec.mat_ptr->scatterPDF(r, rec, scattered) * getColor(scattered, mesh, lights, depth - 1, importance_sampling) / pdf;
+    RenderingInitInfo PathTracer::getPublishedSettings() const
+    {
+        std::lock_guard<std::mutex> lock(view_mutex);
+        return published_settings;
     }
 
-    void PathTracer::startTracing(shared_ptr<Model> m_model, shared_ptr<MiniEngine::Camera> m_camera)
+    void PathTracer::startTracing(shared_ptr<Model> m_model)
     {
+        settings = getPublishedSettings();
         state = 0;
+        trace_time = 0.f;
+        ray_count = 0;
+        sample_count = 0;
+        frame_count = 0;
+        resetStatistics();
         std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-        transferModelData(m_model);
+        if (settings.Progressive)
+        {
+            traceProgressive(m_model);
+            return;
+        }
 
         // Image
-        const int samples = init_info->SampleCount;
-        const int max_depth = init_info->BounceLimit;
-        const bool importance_sampling = init_info->ImportSample;
+        const int samples = settings.SampleCount;
 
-        // Light
-        if (!getMainLightNumber()){
+        shared_ptr<Hittable> scene = buildScene(m_model);
+        if (!scene)
             return;
-        }
-        auto lights = make_shared<HittableList>(light_data);
-
-        // Model
-        HittableList mesh;
-        if (init_info->BVH)
-        {
-            state = 1;
-            mesh.add(make_shared<BVH>(mesh_data));
-        }
-        else
-        {
-            mesh = mesh_data;
-        }
 
-        // Camera
-        vec3 direction(cos(glm::radians(m_camera->Yaw))*cos(glm::radians(m_camera->Pitch)),sin(glm::radians(m_camera->Pitch)),sin(glm::radians(m_camera->Yaw))*cos(glm::radians(m_camera->Pitch)));
-        vec3 lookfrom(m_camera->Position);
-        vec3 lookat(m_camera->Position + direction);
-        vec3 vup(0, 1, 0);
-        auto aperture = m_camera->Aperture;
-        auto fov = m_camera->Zoom;
-        auto aspect_ratio = (float)init_info->Resolution.x/(float)init_info->Resolution.y;
+        const ViewState view = getPublishedView();
+        Camera cam = setupCamera(view, *scene);
+        const TraceContext context = makeContext(*scene, cam, view.fov);
 
-        Camera laser(lookfrom, lookat, vup, fov, 0.f, 1.f, aspect_ratio);
-                
-        f32 dist_to_focus;
-        if (!m_camera->FocusMode)
-        { 
-            Ray r = laser.getRay(0.5f, 0.5f);
-            HitRecord rec;
-            mesh.hit(r, EPS, INF, rec);
-            dist_to_focus = rec.t;
-        }
-        else
+        state = 2;
+        progress = 0.f;
+        // Render, progressive passes of 1, 2, 4, ... samples over 2D tiles
+        film.resize(width, height);
+        pixel_active.assign(width * height, 1);
         {
-            dist_to_focus = m_camera->FocusDistance;
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.film_bytes = getFilmMemoryUsage();
         }
+        std::atomic<long long> traced_samples{0};
+        std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::now();
+        const long long total_samples = static_cast<long long>(width) * height * samples;
 
-        Camera cam(lookfrom, lookat, vup, fov, aperture, dist_to_focus, aspect_ratio);
-
-        state = 2;
-        // Render
-        for (int j = height - 1; j >= 0; --j)
+        int samples_done = 0;
+        int pass_samples = 1;
+        while (samples_done < samples)
         {
-            progress = Math::clamp(float(height-j) / float(height-1) * 100, 0, 100);
+            const int pass_end = std::min(samples_done + pass_samples, samples);
 
-            if (init_info->MultiThread)
+            auto render_tile = [&](const tbb::blocked_range2d<int> &tile)
             {
-                // multi thread
-                tbb::parallel_for(0, width,
-                                [this, j, samples, max_depth, importance_sampling , &cam, &mesh, &lights](int i)
-                                {
-                    vec3 pixel_color(0, 0, 0);
-                    for (int s = 0; s < samples; ++s)
+                WorkCounters work;
+                for (int j = tile.rows().begin(); j < tile.rows().end(); ++j)
+                {
+                    for (int i = tile.cols().begin(); i < tile.cols().end(); ++i)
                     {
-                        if (should_stop_tracing)
+                        if (should_stop_tracing.load(std::memory_order_relaxed))
+                        {
+                            addWork(work);
                             return;
+                        }
+
+                        if (!pixel_active[width * j + i])
+                            continue;
 
-                        f32 u = (i + linearRand(0.f, 1.f)) / (width - 1);
-                        f32 v = (j + linearRand(0.f, 1.f)) / (height - 1);
-                        Ray r = cam.getRay(u, v);
-                        vec3 sample_color = getColor(r, mesh, lights, max_depth, importance_sampling);
-                        if (isInfinity(sample_color) || isNan(sample_color))
-                            sample_color={0,0,0};
-                        pixel_color += sample_color;
+                        for (int s = samples_done; s < pass_end; ++s)
+                        {
+                            traceSample(context, i, j, s, work);
+                        }
+                        writeDisplayColor(ivec2(i, j), film.getColor(i, j));
                     }
-                    pixel_color *= 1.0 / samples;
-                    writeColor(pixels, ivec2(width, height), ivec2(i, j), pixel_color, 2.2); });
-                if (should_stop_tracing)
-                    return;
+                }
+
+                addWork(work);
+                long long tile_samples = static_cast<long long>(tile.rows().size() * tile.cols().size()) * (pass_end - samples_done);
+                progress = 100.f * float(traced_samples.fetch_add(tile_samples) + tile_samples) / float(total_samples);
+            };
+
+            if (settings.MultiThread)
+            {
+                // multi thread, one task per tile
+                tbb::parallel_for(tbb::blocked_range2d<int>(0, height, TileSize, 0, width, TileSize), render_tile, tbb::simple_partitioner());
             }
             else
             {
                 // single thread
-                for (int i = 0; i < width; ++i)
+                for (int j = 0; j < height; j += TileSize)
                 {
-                    vec3 pixel_color(0, 0, 0);
-                    for (int s = 0; s < samples; ++s)
+                    for (int i = 0; i < width; i += TileSize)
                     {
-                        if (should_stop_tracing)
-                            return;
-
-                        f32 u = (i + linearRand(0.f, 1.f)) / (width - 1);
-                        f32 v = (j + linearRand(0.f, 1.f)) / (height - 1);
-                        Ray r = cam.getRay(u, v);
-                        vec3 sample_color = getColor(r, mesh, lights, max_depth, importance_sampling);
-                        if (isInfinity(sample_color) || isNan(sample_color))
-                            sample_color={0,0,0};
-                        pixel_color += sample_color;
+                        render_tile(tbb::blocked_range2d<int>(j, std::min(j + TileSize, height), i, std::min(i + TileSize, width)));
                     }
-                    pixel_color *= 1.0 / samples;
-                    writeColor(pixels, ivec2(width, height), ivec2(i, j), pixel_color, 2.2);
                 }
             }
-        }
 
+            if (should_stop_tracing)
+                return;
 
-        if (init_info->Denoise)
-        {
-            state = 3;
-            // Denoise
-            float *denoise_buffer = new float[3 * width * height];
+            samples_done = pass_end;
+            pass_samples = std::min(2 * pass_samples, MaxPassSamples);
+
+            if (preview_callback)
+                preview_callback(samples_done);
 
-            for (int j = height - 1; j >= 0; --j)
+            // adaptive sampling, the rest of the budget only goes to pixels above the error threshold
+            if (settings.Adaptive && samples_done >= settings.AdaptiveMinSamples && samples_done < samples)
             {
-                for (int i = 0; i < width; ++i)
-                {
-                    vec3 swap_color = readColor(pixels, ivec2(width, height), ivec2(i, j), 2.2);
-                    denoise_buffer[3 * (width * j + i) + 0] = swap_color.x;
-                    denoise_buffer[3 * (width * j + i) + 1] = swap_color.y;
-                    denoise_buffer[3 * (width * j + i) + 2] = swap_color.z;
-                }
+                if (updateActivePixels(settings.AdaptiveThreshold) == 0)
+                    break;
             }
+        }
+        progress = 100.f;
 
+        trace_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - trace_start).count();
+        sample_count = 0;
+        for (int count : film.sample_counts)
+        {
+            sample_count += count;
+        }
+        {
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.trace_time = trace_time;
+            statistics.camera_samples = sample_count;
+            ray_count = statistics.rays;
+        }
+
+        // final linear image, denoised in place
+        vector<vec3> color_buffer, albedo_buffer, normal_buffer;
+        film.resolve(color_buffer, albedo_buffer, normal_buffer);
+
+        if (settings.Denoise)
+        {
+            state = 3;
+            std::chrono::steady_clock::time_point denoise_start = std::chrono::steady_clock::now();
+            // Denoise
             // Create an Intel Open Image Denoise device
             oidn::DeviceRef device = oidn::newDevice();
             device.commit();
 
-            // Create a filter for denoising a beauty (color) image using optional auxiliary images too
-            oidn::FilterRef filter = device.newFilter("RT");                           // generic ray tracing filter
-            filter.setImage("color", denoise_buffer, oidn::Format::Float3, width, height);  // beauty
-            filter.setImage("output", denoise_buffer, oidn::Format::Float3, width, height); // denoised beauty
-            filter.set("hdr", false);
+            // Create a filter for denoising a beauty (color) image using the first hit albedo and normal too
+            oidn::FilterRef filter = device.newFilter("RT");                                      // generic ray tracing filter
+            filter.setImage("color", color_buffer.data(), oidn::Format::Float3, width, height);   // beauty
+            filter.setImage("albedo", albedo_buffer.data(), oidn::Format::Float3, width, height); // auxiliary
+            filter.setImage("normal", normal_buffer.data(), oidn::Format::Float3, width, height); // auxiliary
+            filter.setImage("output", color_buffer.data(), oidn::Format::Float3, width, height);  // denoised beauty
+            filter.set("hdr", true);
             filter.commit();
 
             // Filter the image
@@ -251,46 +368,451 @@ namespace MiniEngine::PathTracing
             if (device.getError(errorMessage) != oidn::Error::None)
                 std::cout << "Error: " << errorMessage << std::endl;
 
-            for (int j = height - 1; j >= 0; --j)
+            for (int j = 0; j < height; ++j)
             {
                 for (int i = 0; i < width; ++i)
                 {
-                    vec3 swap_color;
-                    swap_color.x = denoise_buffer[3 * (width * j + i) + 0];
-                    swap_color.y = denoise_buffer[3 * (width * j + i) + 1];
-                    swap_color.z = denoise_buffer[3 * (width * j + i) + 2];
-                    writeColor(pixels, ivec2(width, height), ivec2(i, j), swap_color, 2.2);
+                    writeDisplayColor(ivec2(i, j), color_buffer[width * j + i]);
                 }
             }
 
-            free(denoise_buffer);
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.denoise_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - denoise_start).count();
+        }
+
+        vector<vec3> heatmap;
+        if (settings.SampleHeatmap)
+        {
+            film.getSampleHeatmap(heatmap);
+            for (int j = 0; j < height; ++j)
+            {
+                for (int i = 0; i < width; ++i)
+                {
+                    writeColor(pixels, ivec2(width, height), ivec2(i, j), heatmap[width * j + i], 1.0);
+                }
+            }
+        }
+
+        if (settings.Output)
+            saveImage(color_buffer);
+
+        std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+        std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - startTime);
+        render_time = time_span.count();
+
+        finishStatistics();
+        state = 4;
+    }
+
+    void PathTracer::traceProgressive(shared_ptr<Model> m_model)
+    {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        // tiles keep their own sample count, a frame that runs out of time leaves the rest of
+        // the pass to the next one
+        const int tiles_x = (width + TileSize - 1) / TileSize;
+        const int tiles_y = (height + TileSize - 1) / TileSize;
+        vector<int> tile_samples(tiles_x * tiles_y, 0);
+
+        shared_ptr<Hittable> scene;
+        shared_ptr<Camera> cam;
+        TraceContext context;
+        ViewState view;
+
+        film.resize(width, height);
+        scene_changed = false;
+        {
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.film_bytes = getFilmMemoryUsage();
         }
 
-        if (init_info->Output)
+        while (!should_stop_tracing)
         {
-            // unsigned char *output_buffer = new unsigned char[3 * width * height];
+            bool restart = false;
+            if (!scene || scene_changed.exchange(false))
+            {
+                // the film keeps the size the render started with, and the mode stays progressive
+                settings = getPublishedSettings();
+                settings.Progressive = true;
+                scene = buildScene(m_model);
+                if (!scene)
+                    return;
+                restart = true;
+            }
+
+            ViewState current_view = getPublishedView();
+            if (restart || !(current_view == view))
+            {
+                view = current_view;
+                cam = make_shared<Camera>(setupCamera(view, *scene));
+                context = makeContext(*scene, *cam, view.fov);
 
-            // for (int j = height - 1; j >= 0; --j)
-            // {
-            //     for (int i = 0; i < width; ++i)
-            //     {
-            //         vec3 srgb_color = readColor(pixels, ivec2(width, height), ivec2(i, j), 1.0);
-            //         writeColor(output_buffer, ivec2(width, height), ivec2(i, j), srgb_color, 2.2);
-            //     }
-            // }
+                film.clear();
+                std::fill(tile_samples.begin(), tile_samples.end(), 0);
+                accumulated_samples = 0;
+                trace_time = 0.f;
+                {
+                    // the counters describe what is on screen
+                    std::lock_guard<std::mutex> lock(statistics_mutex);
+                    statistics.camera_samples = 0;
+                    statistics.rays = 0;
+                    statistics.nodes_visited = 0;
+                    statistics.triangle_tests = 0;
+                    statistics.path_vertices = 0;
+                    statistics.roulette_terminations = 0;
+                    statistics.trace_time = 0.f;
+                }
+                progress = 0.f;
+                state = 2;
+            }
+
+            const int pass = *std::min_element(tile_samples.begin(), tile_samples.end());
+            if (pass >= settings.SampleCount)
+            {
+                // converged, wait for a change
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            // at least 1 ms, as in the editor, a config file can ask for anything
+            const float frame_budget = std::max(settings.FrameBudget, 1.f);
+            std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point deadline = frame_start + std::chrono::microseconds(static_cast<long long>(1000.f * frame_budget));
+            std::atomic<bool> frame_started{false};
+
+            auto render_tile = [&](int tile)
+            {
+                if (tile_samples[tile] != pass)
+                    return;
+                // the first tile of a frame runs even past the deadline, so every frame makes progress
+                if (frame_started.exchange(true) && std::chrono::steady_clock::now() > deadline)
+                    return;
+
+                const int x0 = (tile % tiles_x) * TileSize, y0 = (tile / tiles_x) * TileSize;
+                WorkCounters work;
+                for (int j = y0; j < std::min(y0 + TileSize, height); ++j)
+                {
+                    for (int i = x0; i < std::min(x0 + TileSize, width); ++i)
+                    {
+                        if (should_stop_tracing.load(std::memory_order_relaxed))
+                        {
+                            addWork(work);
+                            return;
+                        }
+
+                        traceSample(context, i, j, pass, work);
+                        writeDisplayColor(ivec2(i, j), film.getColor(i, j));
+                    }
+                }
+                tile_samples[tile]++;
+                addWork(work);
+            };
+
+            if (settings.MultiThread)
+            {
+                tbb::parallel_for(0, tiles_x * tiles_y, render_tile, tbb::simple_partitioner());
+            }
+            else
+            {
+                for (int tile = 0; tile < tiles_x * tiles_y; tile++)
+                {
+                    render_tile(tile);
+                }
+            }
+
+            trace_time += std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - frame_start).count();
+            frame_count++;
+            {
+                std::lock_guard<std::mutex> lock(statistics_mutex);
+                statistics.trace_time = trace_time;
+            }
+
+            if (should_stop_tracing)
+                break;
+
+            const int done = *std::min_element(tile_samples.begin(), tile_samples.end());
+            if (done > pass)
+            {
+                accumulated_samples = done;
+                progress = 100.f * done / settings.SampleCount;
+                if (preview_callback)
+                    preview_callback(done);
+            }
+        }
 
-            stbi_flip_vertically_on_write(true);
-            stbi_write_png(init_info->SavePath, width, height, 3, pixels, 0);
+        sample_count = 0;
+        for (int count : film.sample_counts)
+        {
+            sample_count += count;
+        }
+        {
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.camera_samples = sample_count;
+            ray_count = statistics.rays;
+        }
 
-            // free(output_buffer);
+        // the plain running average, as it was on screen
+        if (settings.Output && scene)
+        {
+            vector<vec3> color_buffer, albedo_buffer, normal_buffer;
+            film.resolve(color_buffer, albedo_buffer, normal_buffer);
+            saveImage(color_buffer);
         }
 
+        render_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - start_time).count();
+
+        finishStatistics();
         state = 4;
+    }
 
-        std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
-        std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - startTime);
-        render_time = time_span.count();
+    shared_ptr<Hittable> PathTracer::buildScene(shared_ptr<Model> m_model)
+    {
+        std::chrono::steady_clock::time_point transfer_start = std::chrono::steady_clock::now();
+        transferModelData(m_model);
+        std::chrono::steady_clock::time_point build_start = std::chrono::steady_clock::now();
+
+        int material_count = 0;
+        for (const TriangleMesh &blas_mesh : blas_meshes)
+        {
+            material_count += blas_mesh.materials.size();
+        }
+
+        // Light
+        if (!getMainLightNumber()){
+            return nullptr;
+        }
+        const LightSampler &lights = light_sampler;
+        std::cout << "Lights: " << lights.size() << " emissive triangles (" << lights.getMemoryUsage() / 1024 << " KB), picked "
+                  << (settings.LightBVH ? "by light BVH" : "by power") << std::endl;
+        std::cout << "Textures: " << texture_cache.size() << " files (" << texture_cache.getMemoryUsage() / 1024 << " KB with mips)" << std::endl;
+
+        // Model, a bottom level structure per entry of blas_meshes and a top level one over their placements
+        state = 1;
+        bvh_build_time = 0.f;
+        bvh_sah_cost = 0.f;
+
+        BLASStats blas_stats;
+        vector<shared_ptr<Hittable>> blases(blas_meshes.size());
+        vector<AABB> blas_bounds(blas_meshes.size());
+        vector<size_t> blas_triangles(blas_meshes.size());
+        for (size_t b = 0; b < blas_meshes.size(); b++)
+        {
+            blas_triangles[b] = blas_meshes[b].size();
+            if (blas_triangles[b] == 0)
+                continue;
+            blases[b] = buildBLAS(std::move(blas_meshes[b]), blas_stats);
+            blases[b]->aabb(blas_bounds[b]);
+        }
+        blas_meshes.clear();
+
+        bvh_build_time = blas_stats.build_time;
+        bvh_sah_cost = blas_stats.triangles > 0 ? blas_stats.weighted_sah_cost / blas_stats.triangles : 0.f;
+        if (settings.BVH)
+        {
+            std::cout << (blas_stats.blocks > 0 ? "BVH4: " : "BVH: ") << blas_stats.triangles << " triangles (" << blas_stats.triangle_bytes / 1024 << " KB), "
+                      << blas_stats.nodes << " nodes (" << blas_stats.node_bytes / 1024 << " KB), ";
+            if (blas_stats.blocks > 0)
+                std::cout << blas_stats.blocks << " blocks (" << blas_stats.block_bytes / 1024 << " KB), ";
+            std::cout << blas_stats.count << " bottom level (" << blas_stats.cached << " from the cache), built in "
+                      << blas_stats.build_time << "s, SAH cost " << bvh_sah_cost << std::endl;
+        }
+
+        auto publish = [&](size_t top_level_bytes)
+        {
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.primitive_bytes = blas_stats.triangle_bytes + blas_stats.block_bytes;
+            statistics.bvh_bytes = blas_stats.node_bytes + top_level_bytes;
+            statistics.light_bytes = light_sampler.getMemoryUsage();
+            statistics.texture_bytes = texture_cache.getMemoryUsage();
+            statistics.materials = material_count;
+            statistics.textures = texture_cache.size();
+            statistics.transfer_time = std::chrono::duration_cast<std::chrono::duration<float>>(build_start - transfer_start).count();
+            statistics.build_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - build_start).count();
+        };
+
+        if (placements.size() == 1 && placements[0].transform == mat4(1.f))
+        {
+            // nothing instanced, the static geometry needs no top level
+            publish(0);
+            return blases[placements[0].blas];
+        }
+
+        vector<Instance> scene_instances;
+        size_t instanced_triangles = 0;
+        for (const Placement &placement : placements)
+        {
+            scene_instances.emplace_back(placement.blas, placement.transform, blas_bounds[placement.blas], placement.first_light);
+            instanced_triangles += blas_triangles[placement.blas];
+        }
+
+        auto tlas = make_shared<TLAS>(std::move(blases), std::move(scene_instances));
+        bvh_build_time += tlas->build_time;
+
+        std::cout << "TLAS: " << tlas->instances.size() << " instances, " << instanced_triangles << " instanced triangles, "
+                  << tlas->nodes.size() << " nodes, built in " << tlas->build_time << "s" << std::endl;
+        publish(tlas->nodes.size() * sizeof(LinearBVHNode) + tlas->instances.size() * sizeof(Instance));
+        return tlas;
+    }
+
+    Camera PathTracer::setupCamera(const ViewState &view, const Hittable &mesh) const
+    {
+        vec3 direction(cos(glm::radians(view.yaw))*cos(glm::radians(view.pitch)),sin(glm::radians(view.pitch)),sin(glm::radians(view.yaw))*cos(glm::radians(view.pitch)));
+        vec3 lookfrom(view.position);
+        vec3 lookat(view.position + direction);
+        vec3 vup(0, 1, 0);
+        auto aperture = view.aperture;
+        auto fov = view.fov;
+        auto aspect_ratio = (float)width/(float)height;
+
+        Camera laser(lookfrom, lookat, vup, fov, 0.f, 1.f, aspect_ratio);
+                
+        f32 dist_to_focus;
+        if (!view.focus_mode)
+        { 
+            Ray r = laser.getRay(0.5f, 0.5f);
+            HitRecord rec;
+            mesh.hit(r, EPS, INF, rec);
+            dist_to_focus = rec.t;
+        }
+        else
+        {
+            dist_to_focus = view.focus_distance;
+        }
+
+        return Camera(lookfrom, lookat, vup, fov, aperture, dist_to_focus, aspect_ratio);
+    }
+
+    PathTracer::TraceContext PathTracer::makeContext(const Hittable &scene, const Camera &camera, float fov) const
+    {
+        TraceContext context;
+        context.scene = &scene;
+        context.lights = &light_sampler;
+        context.camera = &camera;
+        // angle a pixel subtends, the ray cones start with it
+        context.spread_angle = atan(2.f * tan(glm::radians(fov) / 2.f) / height);
+        context.max_depth = settings.BounceLimit;
+        context.roulette_depth = settings.RouletteDepth;
+        context.importance_sampling = settings.ImportSample;
+        context.seed = static_cast<uint32_t>(settings.Seed);
+        context.sampler_type = settings.LowDiscrepancy ? SamplerType::Sobol : SamplerType::Independent;
+        return context;
+    }
+
+    void PathTracer::traceSample(const TraceContext &context, int i, int j, int s, WorkCounters &work)
+    {
+        Sampler::current().startPixelSample(ivec2(i, j), s, context.seed, context.sampler_type);
+        vec2 offset = random2D();
+        f32 u = (i + offset.x) / (width - 1);
+        f32 v = (j + offset.y) / (height - 1);
+        Ray r = context.camera->getRay(u, v);
+        PathRecord path;
+        vec3 sample_color = getColor(r, *context.scene, *context.lights, context.max_depth, context.roulette_depth, context.importance_sampling, context.spread_angle, path);
+        if (isInfinity(sample_color) || isNan(sample_color))
+            sample_color = {0, 0, 0};
+        film.addSample(i, j, sample_color, path.albedo, path.normal);
+
+        work.rays += path.ray_count;
+        work.path_vertices += path.length;
+        work.roulette_terminations += path.roulette_terminated ? 1 : 0;
+    }
+
+    void PathTracer::saveImage(const vector<vec3> &color_buffer)
+    {
+        std::chrono::steady_clock::time_point write_start = std::chrono::steady_clock::now();
+
+        std::string stem = getOutputStem();
+
+        stbi_flip_vertically_on_write(true);
+        if (settings.SampleHeatmap && !settings.Progressive)
+        {
+            // the display holds the heatmap, the image itself goes to the usual path
+            vector<unsigned char> image(3 * width * height);
+            for (int j = 0; j < height; ++j)
+            {
+                for (int i = 0; i < width; ++i)
+                {
+                    vec3 color = settings.ToneMapping ? Film::toneMapACES(color_buffer[width * j + i]) : color_buffer[width * j + i];
+                    writeColor(image.data(), ivec2(width, height), ivec2(i, j), color, 2.2);
+                }
+            }
+            stbi_write_png(settings.SavePath, width, height, 3, image.data(), 0);
+            stbi_write_png((stem + ".samples.png").c_str(), width, height, 3, pixels, 0);
+        }
+        else
+        {
+            stbi_write_png(settings.SavePath, width, height, 3, pixels, 0);
+        }
+
+        if (settings.OutputHDR)
+        {
+            Film::writePFM(stem + ".pfm", width, height, color_buffer);
+        }
+
+        std::lock_guard<std::mutex> lock(statistics_mutex);
+        statistics.write_time = std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::steady_clock::now() - write_start).count();
+    }
+
+    std::string PathTracer::getOutputStem() const
+    {
+        std::string stem(settings.SavePath);
+        size_t extension = stem.find_last_of('.');
+        if (extension != std::string::npos && stem.find_first_of("/\\", extension) == std::string::npos)
+            stem.erase(extension);
+        return stem;
+    }
+
+    size_t PathTracer::getFilmMemoryUsage() const
+    {
+        return film.getMemoryUsage() + 3 * size_t(width) * height + pixel_active.capacity();
+    }
 
+    RenderStatistics PathTracer::getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(statistics_mutex);
+        return statistics;
+    }
+
+    void PathTracer::resetStatistics()
+    {
+        std::lock_guard<std::mutex> lock(statistics_mutex);
+        statistics = RenderStatistics();
+    }
+
+    void PathTracer::addWork(const WorkCounters &work)
+    {
+        // the BVHs count into thread locals, a tile runs on one thread from start to end
+        const TraversalCounters &traversal = TraversalCounters::local();
+
+        std::lock_guard<std::mutex> lock(statistics_mutex);
+        statistics.rays += work.rays;
+        statistics.path_vertices += work.path_vertices;
+        statistics.roulette_terminations += work.roulette_terminations;
+        statistics.nodes_visited += traversal.nodes_visited - work.nodes_visited_start;
+        statistics.triangle_tests += traversal.triangle_tests - work.triangle_tests_start;
+    }
+
+    void PathTracer::finishStatistics()
+    {
+        RenderStatistics result;
+        {
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            statistics.film_bytes = getFilmMemoryUsage();
+            statistics.total_time = render_time;
+            result = statistics;
+        }
+
+        result.print(std::cout);
+
+        // next to the image, like the .pfm
+        if (settings.Output)
+        {
+            std::string stem = getOutputStem();
+            std::ofstream file(stem + ".stats.json");
+            if (file)
+                file << result.toJson().dump() << std::endl;
+            else
+                std::cerr << "Could not write " << stem << ".stats.json" << std::endl;
+        }
     }
 
     void PathTracer::writeColor(unsigned char *pixels, ivec2 tex_size, ivec2 tex_coord, vec3 color, float gama)
@@ -308,69 +830,230 @@ namespace MiniEngine::PathTracing
         pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 2] = static_cast<int>(256 * Math::clamp(b, 0.0, 0.999));
     }
 
-    vec3 PathTracer::readColor(unsigned char *pixels, ivec2 tex_size, ivec2 tex_coord, float gama)
+    void PathTracer::writeDisplayColor(ivec2 tex_coord, vec3 color)
+    {
+        if (settings.ToneMapping)
+            color = Film::toneMapACES(color);
+        writeColor(pixels, ivec2(width, height), tex_coord, color, 2.2);
+    }
+
+    int PathTracer::updateActivePixels(float threshold)
+    {
+        vector<uint8_t> above(width * height);
+        tbb::parallel_for(0, height, [&](int j)
+                          {
+            for (int i = 0; i < width; ++i)
+            {
+                above[width * j + i] = film.getRelativeError(i, j) > threshold;
+            } });
+
+        // a pixel keeps sampling while any pixel of its 3x3 neighbourhood is above the threshold,
+        // single pixel error estimates are too noisy to trust alone
+        std::atomic<int> active_count{0};
+        tbb::parallel_for(0, height, [&](int j)
+                          {
+            int row_count = 0;
+            for (int i = 0; i < width; ++i)
+            {
+                uint8_t active = 0;
+                for (int y = std::max(j - 1, 0); y <= std::min(j + 1, height - 1) && !active; ++y)
+                {
+                    for (int x = std::max(i - 1, 0); x <= std::min(i + 1, width - 1) && !active; ++x)
+                    {
+                        active = above[width * y + x];
+                    }
+                }
+                pixel_active[width * j + i] = active;
+                row_count += active;
+            }
+            active_count += row_count; });
+
+        return active_count;
+    }
+
+    shared_ptr<Hittable> PathTracer::buildBLAS(TriangleMesh mesh, BLASStats &stats)
     {
-        vec3 color;
+        stats.count++;
+        stats.triangles += mesh.size();
+
+        if (!settings.BVH)
+        {
+            stats.triangle_bytes += mesh.getMemoryUsage();
+            return make_shared<TriangleMesh>(std::move(mesh));
+        }
 
-        color.r = pow(pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 0] / 255.f, gama);
-        color.g = pow(pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 1] / 255.f, gama);
-        color.b = pow(pixels[3 * (tex_size.x * tex_coord.y + tex_coord.x) + 2] / 255.f, gama);
+        BVHBuildParams params;
+        params.sah = settings.SAH;
+        params.max_leaf_size = settings.LeafSize;
+        params.traversal_cost = settings.TraversalCost;
 
-        return color;
+        // bottom levels are in object space, so moving an instance never invalidates their cache files
+        const bool wide = settings.SIMD && BVH4::isSupported();
+        BVHCache cache;
+        uint64_t cache_key = settings.CacheBVH ? BVHCache::computeKey(mesh, params, wide) : 0;
+
+        if (wide)
+        {
+            auto bvh = make_shared<BVH4>();
+            bool cached = settings.CacheBVH && cache.load(cache_key, mesh, *bvh);
+            if (!cached)
+            {
+                *bvh = BVH4(std::move(mesh), params);
+                if (settings.CacheBVH && !cache.save(cache_key, *bvh))
+                    std::cerr << "BVH cache: could not write " << cache.getPath(cache_key) << std::endl;
+            }
+
+            stats.cached += cached ? 1 : 0;
+            stats.build_time += bvh->build_time;
+            stats.weighted_sah_cost += bvh->sah_cost * bvh->triangles.size();
+            stats.triangle_bytes += bvh->triangles.getMemoryUsage();
+            stats.nodes += bvh->nodes.size();
+            stats.node_bytes += bvh->nodes.size() * sizeof(BVH4Node);
+            stats.blocks += bvh->blocks.size();
+            stats.block_bytes += bvh->blocks.size() * sizeof(Triangle4);
+            return bvh;
+        }
+        else
+        {
+            auto bvh = make_shared<LinearBVH>();
+            bool cached = settings.CacheBVH && cache.load(cache_key, mesh, *bvh);
+            if (!cached)
+            {
+                *bvh = LinearBVH(std::move(mesh), params);
+                if (settings.CacheBVH && !cache.save(cache_key, *bvh))
+                    std::cerr << "BVH cache: could not write " << cache.getPath(cache_key) << std::endl;
+            }
+
+            stats.cached += cached ? 1 : 0;
+            stats.build_time += bvh->build_time;
+            stats.weighted_sah_cost += bvh->sah_cost * bvh->triangles.size();
+            stats.triangle_bytes += bvh->triangles.getMemoryUsage();
+            stats.nodes += bvh->nodes.size();
+            stats.node_bytes += bvh->nodes.size() * sizeof(LinearBVHNode);
+            return bvh;
+        }
     }
 
     void PathTracer::transferModelData(shared_ptr<Model> m_model)
     {
         // clean data buffer
-        mesh_data.clear();
-        light_data.clear();
+        blas_meshes.clear();
+        placements.clear();
+        light_sampler.clear();
+
+        // the textures of another model would only take up memory
+        if (m_model->model_path != texture_model_path)
+        {
+            texture_cache.clear();
+            texture_model_path = m_model->model_path;
+        }
+
+        // bottom level 0 merges every mesh without instances, an instanced mesh gets one of its own
+        vector<int> mesh_blas(m_model->meshes.size(), 0);
+        int blas_count = 1;
+        for (const MeshInstance &instance : instances)
+        {
+            if (instance.mesh < 0 || instance.mesh >= m_model->meshes.size())
+            {
+                std::cerr << "Instance of mesh " << instance.mesh << " ignored, the model has " << m_model->meshes.size() << " meshes" << std::endl;
+                continue;
+            }
+            if (mesh_blas[instance.mesh] == 0)
+                mesh_blas[instance.mesh] = blas_count++;
+        }
+
+        blas_meshes.resize(blas_count);
+        vector<size_t> triangle_counts(blas_count, 0);
+        for (size_t m = 0; m < m_model->meshes.size(); m++)
+        {
+            triangle_counts[mesh_blas[m]] += m_model->meshes[m].indices.size() / 3;
+        }
+        for (int b = 0; b < blas_count; b++)
+        {
+            blas_meshes[b].reserve(triangle_counts[b]);
+        }
+
+        const TextureFilter texture_filter = settings.MipMapping ? TextureFilter::Trilinear : TextureFilter::Bilinear;
+
+        // object space emitters of every bottom level, in the order of their local light ids
+        struct EmissiveTriangle
+        {
+            vec3 a, b, c;
+            vec3 radiance;
+        };
+        vector<vector<EmissiveTriangle>> blas_emitters(blas_count);
 
         // loop meshes
-        for (const auto &mesh : m_model->meshes)
+        for (size_t m = 0; m < m_model->meshes.size(); m++)
         {
-            auto mat = make_shared<Phong>(mesh.material, m_model->model_path);
+            const Mesh &mesh = m_model->meshes[m];
+            TriangleMesh &blas_mesh = blas_meshes[mesh_blas[m]];
+            vector<EmissiveTriangle> &emitters = blas_emitters[mesh_blas[m]];
+
+            shared_ptr<const MipTexture> diffuse_texture;
+            if (!mesh.material.map_Kd.empty())
+            {
+                diffuse_texture = texture_cache.get(m_model->model_path + "/" + mesh.material.map_Kd);
+            }
+
+            shared_ptr<Material> mat = makeMaterial(mesh.material, diffuse_texture, texture_filter);
+            int mat_id = blas_mesh.addMaterial(mat);
+            if (mat_id < 0)
+            {
+                std::cerr << "Mesh " << m << " skipped, its bottom level is out of material ids" << std::endl;
+                continue;
+            }
+            const bool emissive = isEmissive(mesh.material);
 
             // loop triangles
             for (int id = 0; id < mesh.indices.size(); id += 3)
             {
-                vector<Vertex> vertices(3);
-                vertices[0] = mesh.vertices[mesh.indices[id]];
-                vertices[1] = mesh.vertices[mesh.indices[id + 1]];
-                vertices[2] = mesh.vertices[mesh.indices[id + 2]];
+                const Vertex &v0 = mesh.vertices[mesh.indices[id]];
+                const Vertex &v1 = mesh.vertices[mesh.indices[id + 1]];
+                const Vertex &v2 = mesh.vertices[mesh.indices[id + 2]];
 
-                mesh_data.add(make_shared<Triangle>(vertices, mat));
-
-                if (mat->is_emitted(mat->mat))
+                // hits on an emitter need its id to weigh them against light sampling
+                int light_id = -1;
+                if (emissive)
                 {
-                    light_data.add(make_shared<Triangle>(vertices, shared_ptr<Material>()));
+                    light_id = emitters.size();
+                    emitters.push_back({v0.Position, v1.Position, v2.Position, mesh.material.Ke});
                 }
+
+                blas_mesh.addTriangle(v0, v1, v2, mat_id, light_id);
             }
         }
 
-        // get main light (for importance sampling)
-        std::map<shared_ptr<Hittable>, float> light_with_area;
-        for (const auto &light : light_data.objects)
+        // the static geometry first, so its local light ids are the global ones
+        if (blas_meshes[0].size() > 0)
         {
-            light_with_area.insert(pair<shared_ptr<Hittable>, float>(light, light->getArea()));
+            placements.push_back({0, mat4(1.f), 0});
         }
-        
-        vector<pair<shared_ptr<Hittable>, float>> map_vec;
-        for(map<shared_ptr<Hittable>, float>::iterator it = light_with_area.begin(); it != light_with_area.end(); it++)
+        for (const MeshInstance &instance : instances)
         {
-            map_vec.push_back( pair<shared_ptr<Hittable>, float>(it->first,it->second) );
+            if (instance.mesh >= 0 && instance.mesh < m_model->meshes.size())
+                placements.push_back({mesh_blas[instance.mesh], instance.transform, 0});
         }
-        sort(map_vec.begin(),map_vec.end(),hittableCompare);
-        light_data.clear();
-        for (const auto &light_map : map_vec)
+
+        // every placement brings its own world space copy of the emitters
+        for (Placement &placement : placements)
         {
-            light_data.objects.push_back(light_map.first);            
-            if (light_data.objects.size() == MaxLights)
-                break;
+            placement.first_light = light_sampler.size();
+            for (const EmissiveTriangle &emitter : blas_emitters[placement.blas])
+            {
+                vec3 a = vec3(placement.transform * vec4(emitter.a, 1.f));
+                vec3 b = vec3(placement.transform * vec4(emitter.b, 1.f));
+                vec3 c = vec3(placement.transform * vec4(emitter.c, 1.f));
+                light_sampler.addTriangle(a, b, c, emitter.radiance);
+            }
         }
+
+        // emitter selection for importance sampling, over every emissive triangle
+        light_sampler.build(settings.LightBVH);
     }
 
     int PathTracer::getMainLightNumber()
     {
-        return light_data.objects.size();
+        return light_sampler.size();
     }
 }
\ No newline at end of file
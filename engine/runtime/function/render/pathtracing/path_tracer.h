@@ -4,6 +4,11 @@
 #include "runtime/function/render/pathtracing/common/ray.h"
 #include "runtime/function/render/pathtracing/common/hittable.h"
 #include "runtime/function/render/pathtracing/common/material.h"
+#include "runtime/function/render/pathtracing/common/film.h"
+#include "runtime/function/render/pathtracing/common/light_sampler.h"
+#include "runtime/function/render/pathtracing/common/camera.h"
+#include "runtime/function/render/pathtracing/common/render_statistics.h"
+#include "runtime/function/render/pathtracing/primitive/triangle_mesh.h"
 #include "runtime/function/render/render_model.h"
 #include "runtime/function/render/render_camera.h"
 
@@ -11,51 +16,216 @@
 #include <stb_image_write.h>
 
 #include <map>
+#include <atomic>
+#include <mutex>
+#include <functional>
 
 namespace MiniEngine::PathTracing
 {
     struct RenderingInitInfo
     {
         ivec2 Resolution;
-        int SampleCount;
+        int SampleCount;           // per pixel, the upper bound when sampling adaptively
+        bool Adaptive;
+        int AdaptiveMinSamples;    // samples every pixel gets before its error is trusted
+        float AdaptiveThreshold;   // relative standard error at which a pixel stops sampling
+        bool SampleHeatmap;        // show (and save) the per pixel sample counts instead of the image
+        bool Progressive;          // 1 spp frames into the film until stopped, restarted whenever the camera moves, no adaptive sampling or denoising
+        float FrameBudget;         // milliseconds, a progressive frame that runs longer leaves the rest of its pass to the next one
         int BounceLimit;
+        int RouletteDepth; // bounces before Russian roulette may terminate a path
         bool ImportSample;
+        bool LightBVH;       // spatially aware emitter choice, otherwise in proportion to power
+        int Seed;            // same seed, same image, whatever the thread count
+        bool LowDiscrepancy; // Owen scrambled Sobol instead of independent PCG samples
+        bool MipMapping;     // trilinear texture filtering over ray cone footprints, otherwise bilinear
         bool BVH;
+        bool SAH;
+        int LeafSize;
+        float TraversalCost;
+        bool CacheBVH;       // reuse BVHs that earlier runs built for the same triangles, kept in the temp directory
+        bool SIMD;
         bool MultiThread;
         bool Denoise;
+        bool ToneMapping; // ACES instead of a plain clamp before the 8 bit gamma encode
         bool Output;
+        bool OutputHDR;   // linear float image next to the PNG, as .pfm
         char SavePath[128];
     };
 
+    // one placement of a model mesh
+    struct MeshInstance
+    {
+        int mesh;       // index into Model::meshes
+        mat4 transform; // object to world, the coordinates in the file count as object space
+    };
+
+    // what a single path leaves behind besides its radiance
+    struct PathRecord
+    {
+        vec3 albedo{0, 0, 0}; // first hit features, for the denoiser
+        vec3 normal{0, 0, 0};
+        int ray_count{0};
+        int length{0}; // surface hits
+        bool roulette_terminated{false};
+    };
+
     class PathTracer
     {
     public:
         int width;
         int height;
         unsigned int result;
-        bool should_stop_tracing{false};
-        unsigned char *pixels = nullptr;
-        shared_ptr<RenderingInitInfo> init_info;
-        int state;
-        float progress;
+        std::atomic<bool> should_stop_tracing{false}; // checked per pixel, so stopping never waits for a tile
+        unsigned char *pixels = nullptr; // display image, gamma encoded
+        Film film;                       // linear radiance, albedo and normal sums
+        shared_ptr<RenderingInitInfo> init_info; // edited by the ui, the tracing thread reads the copy publishSettings makes
+        std::atomic<int> state{0};
+        std::atomic<float> progress{0.f};
         float render_time;
+        float bvh_build_time{0.f};
+        float bvh_sah_cost{0.f};
+        // statistics of the last render
+        float trace_time{0.f};     // seconds spent in the sampling passes
+        long long ray_count{0};    // every ray cast into the scene
+        long long sample_count{0}; // camera samples over all pixels
+        // progressive mode
+        std::atomic<int> frame_count{0};         // frames since the start, including the ones a restart discarded
+        std::atomic<int> accumulated_samples{0}; // per pixel, since the last restart
+        std::atomic<bool> scene_changed{false};  // set after editing the model or the settings, the next frame rebuilds the scene
+
+        // called on the tracing thread after every progressive pass, once 'pixels' holds the
+        // average of the first sample_count samples
+        std::function<void(int sample_count)> preview_callback;
+
+        // meshes listed here are drawn once per entry, each with a bottom level BVH of its own.
+        // Every other mesh is drawn once where the file puts it, merged into one static BVH.
+        vector<MeshInstance> instances;
 
         PathTracer();
 
-        void initializeRenderer();
-        void startTracing(shared_ptr<Model> m_model, shared_ptr<MiniEngine::Camera> m_camera);
+        // create_texture = false keeps the renderer off the GL context, for headless use
+        void initializeRenderer(bool create_texture = true);
+        // the tracing thread never reads the editor camera, it renders the pose last published
+        // here by the thread that moves it, before startTracing and then once per frame
+        void publishView(const MiniEngine::Camera &camera);
+        // the same for *init_info, before startTracing and after editing it. A running progressive
+        // render restarts with the new settings at its next frame, apart from the resolution.
+        void publishSettings();
+        void startTracing(shared_ptr<Model> m_model);
         void transferModelData(shared_ptr<Model> m_model);
 
         int getMainLightNumber();
 
+        // memory, work and phase timings of the current or last render, safe to call while it runs
+        RenderStatistics getStatistics() const;
+
     private:
-        HittableList mesh_data;
-        HittableList light_data;
+        static const int TileSize = 16;
+        static const int MaxPassSamples = 16;
 
-        glm::vec3 getColor(const Ray &r, const Hittable &model, shared_ptr<HittableList> &lights, int depth, bool importance_sampling);
-        void writeColor(unsigned char *pixels, glm::ivec2 tex_size, glm::ivec2 tex_coord, glm::vec3 color, float gama);
-        glm::vec3 readColor(unsigned char *pixels, glm::ivec2 tex_size, glm::ivec2 tex_coord, float gama);
+        // a placed bottom level structure, waiting for the top level build
+        struct Placement
+        {
+            int blas;
+            mat4 transform;
+            int first_light; // LightSampler index of its first emitter
+        };
 
-        static bool hittableCompare(pair<shared_ptr<Hittable>, float> a, pair<shared_ptr<Hittable>, float> b) {return a.second > b.second;}
+        struct BLASStats
+        {
+            int count = 0;
+            int cached = 0;
+            size_t triangles = 0;
+            size_t nodes = 0;
+            size_t blocks = 0;
+            size_t triangle_bytes = 0;
+            size_t node_bytes = 0;
+            size_t block_bytes = 0;
+            float build_time = 0.f;
+            float weighted_sah_cost = 0.f; // by triangle count
+        };
+
+        vector<TriangleMesh> blas_meshes; // object space triangles, the first one holds the static geometry
+        vector<Placement> placements;
+        vector<uint8_t> pixel_active; // adaptive sampling, 0 once a pixel and its neighbours converged
+        LightSampler light_sampler; // every emissive triangle
+        TextureCache texture_cache; // kept across renders of one model, so a re-render decodes nothing
+        std::string texture_model_path; // the model texture_cache was filled for
+        RenderStatistics statistics;
+        mutable std::mutex statistics_mutex;
+
+        shared_ptr<Hittable> buildBLAS(TriangleMesh mesh, BLASStats &stats);
+        glm::vec3 getColor(Ray r, const Hittable &model, const LightSampler &lights, int max_depth, int roulette_depth, bool importance_sampling, float spread_angle, PathRecord &path);
+        // what tracing a sample reads, besides the film
+        struct TraceContext
+        {
+            const Hittable *scene = nullptr;
+            const LightSampler *lights = nullptr;
+            const Camera *camera = nullptr;
+            float spread_angle = 0.f;
+            int max_depth = 0;
+            int roulette_depth = 0;
+            bool importance_sampling = false;
+            uint32_t seed = 0;
+            SamplerType sampler_type = SamplerType::Independent;
+        };
+
+        // the parts of the editor camera the image depends on, progressive mode restarts when they change
+        struct ViewState
+        {
+            vec3 position{0.f};
+            float yaw = 0.f, pitch = 0.f, fov = 0.f;
+            float aperture = 0.f, focus_distance = 0.f;
+            int focus_mode = 0;
+
+            static ViewState from(const MiniEngine::Camera &camera)
+            {
+                return {camera.Position, camera.Yaw, camera.Pitch, camera.Zoom, camera.Aperture, camera.FocusDistance, camera.FocusMode};
+            }
+
+            bool operator==(const ViewState &other) const
+            {
+                return position == other.position && yaw == other.yaw && pitch == other.pitch && fov == other.fov &&
+                       aperture == other.aperture && focus_distance == other.focus_distance && focus_mode == other.focus_mode;
+            }
+        };
+        ViewState published_view; // guarded by view_mutex
+        RenderingInitInfo published_settings; // guarded by view_mutex
+        mutable std::mutex view_mutex;
+        ViewState getPublishedView() const;
+        RenderingInitInfo getPublishedSettings() const;
+
+        RenderingInitInfo settings; // what the tracing thread renders with
+
+        // what one tile did, added to the statistics once it is done
+        struct WorkCounters
+        {
+            long long rays = 0;
+            long long path_vertices = 0;
+            long long roulette_terminations = 0;
+            // traversal counts of the thread when the tile started
+            long long nodes_visited_start = TraversalCounters::local().nodes_visited;
+            long long triangle_tests_start = TraversalCounters::local().triangle_tests;
+        };
+
+        // returns nullptr when the scene has no emitter
+        shared_ptr<Hittable> buildScene(shared_ptr<Model> m_model);
+        Camera setupCamera(const ViewState &view, const Hittable &mesh) const;
+        TraceContext makeContext(const Hittable &scene, const Camera &camera, float fov) const;
+        // adds sample s of pixel (i, j) to the film
+        void traceSample(const TraceContext &context, int i, int j, int s, WorkCounters &work);
+        void traceProgressive(shared_ptr<Model> m_model);
+        void saveImage(const vector<vec3> &color_buffer);
+        std::string getOutputStem() const; // SavePath without its extension
+
+        size_t getFilmMemoryUsage() const; // sums, display pixels and the adaptive mask
+        void resetStatistics();
+        void addWork(const WorkCounters &work);
+        // prints the table, and writes the JSON next to the image
+        void finishStatistics();
+        void writeColor(unsigned char *pixels, glm::ivec2 tex_size, glm::ivec2 tex_coord, glm::vec3 color, float gama);
+        void writeDisplayColor(glm::ivec2 tex_coord, glm::vec3 color);
+        int updateActivePixels(float threshold);
     };
 }
\ No newline at end of file
@@ -18,6 +18,7 @@ namespace MiniEngine::PathTracing
         Box(const vec3 &p0, const vec3 &p1, shared_ptr<Material> ptr);
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     };
 
     Box::Box(const vec3 &p0, const vec3 &p1, shared_ptr<Material> ptr)
@@ -40,6 +41,11 @@ namespace MiniEngine::PathTracing
         return sides.hit(r, t_min, t_max, rec);
     }
 
+    bool Box::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        return sides.occluded(r, t_min, t_max);
+    }
+
     class Translate : public Hittable
     {
     public:
@@ -49,6 +55,7 @@ namespace MiniEngine::PathTracing
         Translate(shared_ptr<Hittable> p, const vec3 &displacement) : ptr(p), offset(displacement) {}
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     };
 
     bool Translate::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
@@ -63,6 +70,11 @@ namespace MiniEngine::PathTracing
         return true;
     }
 
+    bool Translate::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        return ptr->occluded(Ray(r.origin - offset, r.direction), t_min, t_max);
+    }
+
     class RotateY : public Hittable
     {
     public:
@@ -73,6 +85,7 @@ namespace MiniEngine::PathTracing
         RotateY(shared_ptr<Hittable> p, float angle);
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     };
 
     RotateY::RotateY(shared_ptr<Hittable> p, float angle) : ptr(p)
@@ -112,4 +125,18 @@ namespace MiniEngine::PathTracing
 
         return true;
     }
-}
\ No newline at end of file
+
+    bool RotateY::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        auto origin = r.origin;
+        auto direction = r.direction;
+
+        origin[0] = cos_theta * r.origin[0] - sin_theta * r.origin[2];
+        origin[2] = sin_theta * r.origin[0] + cos_theta * r.origin[2];
+
+        direction[0] = cos_theta * r.direction[0] - sin_theta * r.direction[2];
+        direction[2] = sin_theta * r.direction[0] + cos_theta * r.direction[2];
+
+        return ptr->occluded(Ray(origin, direction), t_min, t_max);
+    }
+}
@@ -24,6 +24,7 @@ namespace MiniEngine::PathTracing
         }
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     };
 
     class RectangleXZ : public Hittable
@@ -45,6 +46,7 @@ namespace MiniEngine::PathTracing
 
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
 
         virtual float getPDF(const vec3 &origin, const vec3 &v) const override
         {
@@ -63,7 +65,8 @@ namespace MiniEngine::PathTracing
 
         virtual vec3 random(const vec3 &origin) const override
         {
-            auto random_point = vec3(linearRand(x0, x1), k, linearRand(z0, z1));
+            vec2 r = random2D();
+            auto random_point = vec3(x0 + (x1 - x0) * r.x, k, z0 + (z1 - z0) * r.y);
             return random_point - origin;
         }
     };
@@ -86,6 +89,7 @@ namespace MiniEngine::PathTracing
         }
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     };
 
     bool RectangleXY::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
@@ -100,11 +104,21 @@ namespace MiniEngine::PathTracing
         rec.t = t;
         auto outward_normal = vec3(0, 0, 1);
         rec.setFaceNormal(r, outward_normal);
-        rec.mat_ptr = m;
+        rec.mat_ptr = m.get();
         rec.hit_point.Position = r.cast(t);
         return true;
     }
 
+    bool RectangleXY::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        auto t = (k - r.origin.z) / r.direction.z;
+        if (t < t_min || t > t_max)
+            return false;
+        auto x = r.origin.x + t * r.direction.x;
+        auto y = r.origin.y + t * r.direction.y;
+        return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+    }
+
     bool RectangleXZ::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         auto t = (k - r.origin.y) / r.direction.y;
@@ -117,11 +131,21 @@ namespace MiniEngine::PathTracing
         rec.t = t;
         auto outward_normal = vec3(0, 1, 0);
         rec.setFaceNormal(r, outward_normal);
-        rec.mat_ptr = m;
+        rec.mat_ptr = m.get();
         rec.hit_point.Position = r.cast(t);
         return true;
     }
 
+    bool RectangleXZ::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        auto t = (k - r.origin.y) / r.direction.y;
+        if (t < t_min || t > t_max)
+            return false;
+        auto x = r.origin.x + t * r.direction.x;
+        auto z = r.origin.z + t * r.direction.z;
+        return x >= x0 && x <= x1 && z >= z0 && z <= z1;
+    }
+
     bool RectangleYZ::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
     {
         auto t = (k - r.origin.x) / r.direction.x;
@@ -134,8 +158,18 @@ namespace MiniEngine::PathTracing
         rec.t = t;
         auto outward_normal = vec3(1, 0, 0);
         rec.setFaceNormal(r, outward_normal);
-        rec.mat_ptr = m;
+        rec.mat_ptr = m.get();
         rec.hit_point.Position = r.cast(t);
         return true;
     }
+
+    bool RectangleYZ::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        auto t = (k - r.origin.x) / r.direction.x;
+        if (t < t_min || t > t_max)
+            return false;
+        auto y = r.origin.y + t * r.direction.y;
+        auto z = r.origin.z + t * r.direction.z;
+        return y >= y0 && y <= y1 && z >= z0 && z <= z1;
+    }
 }
@@ -16,6 +16,7 @@ namespace MiniEngine::PathTracing
         Sphere(vec3 cen, float r, shared_ptr<Material> m) : center(cen), radius(r), mat_ptr(m){};
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     };
 
     bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
@@ -43,9 +44,26 @@ namespace MiniEngine::PathTracing
         rec.hit_point.Position = r.cast(rec.t);
         vec3 outward_normal = (rec.hit_point.Position - center) / radius;
         rec.setFaceNormal(r, outward_normal);
-        rec.mat_ptr = mat_ptr;
+        rec.mat_ptr = mat_ptr.get();
 
         return true;
     }
 
+    bool Sphere::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        vec3 oc = r.origin - center;
+        auto a = dot(r.direction, r.direction);
+        auto half_b = dot(oc, r.direction);
+        auto c = dot(oc, oc) - radius * radius;
+
+        auto discriminant = half_b * half_b - a * c;
+        if (discriminant < 0)
+            return false;
+        auto sqrtd = sqrt(discriminant);
+
+        auto near_root = (-half_b - sqrtd) / a;
+        auto far_root = (-half_b + sqrtd) / a;
+        return (near_root >= t_min && near_root <= t_max) || (far_root >= t_min && far_root <= t_max);
+    }
+
 }
@@ -6,7 +6,7 @@
 
 namespace MiniEngine::PathTracing
 {
-    class Triangle : public Hittable
+    class Triangle final : public Hittable
     {
     public:
         vector<Vertex> vertices;
@@ -16,6 +16,7 @@ namespace MiniEngine::PathTracing
         Triangle(vector<Vertex> vt, shared_ptr<Material> m) : vertices(vt), mat_ptr(m){};
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
         virtual bool aabb(AABB &output_box) const override;
 
         virtual float getPDF(const vec3 &origin, const vec3 &v) const override
@@ -38,8 +39,9 @@ namespace MiniEngine::PathTracing
             vec3 edge1 = vertices[1].Position - vertices[0].Position;
             vec3 edge2 = vertices[2].Position - vertices[0].Position;
 
-            auto u = linearRand(0.f, 1.f);
-            auto v = linearRand(0.f, 1.f);
+            vec2 r = random2D();
+            auto u = r.x;
+            auto v = r.y;
 
             vec3 random_point;
 
@@ -60,6 +62,8 @@ namespace MiniEngine::PathTracing
         }
 
     private:
+        bool intersect(const Ray &r, float t_min, float t_max, float &t, float &u, float &v) const;
+
         vec2 interpTexcoord(float u, float v) const
         {
             vec2 st = u * vertices[1].Texcoord + v * vertices[2].Texcoord + (1 - u - v) * vertices[0].Texcoord;
@@ -67,9 +71,8 @@ namespace MiniEngine::PathTracing
         }
     };
 
-    bool Triangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    inline bool Triangle::intersect(const Ray &r, float t_min, float t_max, float &t, float &u, float &v) const
     {
-        // ray intersection
         vec3 edge1 = vertices[1].Position - vertices[0].Position;
         vec3 edge2 = vertices[2].Position - vertices[0].Position;
 
@@ -81,32 +84,48 @@ namespace MiniEngine::PathTracing
 
         auto f = 1.0 / a;
         auto s = r.origin - vertices[0].Position;
-        auto u = f * dot(s, q);
+        u = f * dot(s, q);
 
         if (u < 0)
             return false;
 
         auto k = cross(s, edge1);
-        auto v = f * dot(r.direction, k);
+        v = f * dot(r.direction, k);
 
         if (v < 0 || u + v > 1)
             return false;
 
-        auto t = f * dot(edge2, k);
-        if (t < t_min || t_max < t)
+        t = f * dot(edge2, k);
+        return t >= t_min && t <= t_max;
+    }
+
+    inline bool Triangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        // ray intersection
+        float t, u, v;
+        if (!intersect(r, t_min, t_max, t, u, v))
             return false;
 
+        vec3 edge1 = vertices[1].Position - vertices[0].Position;
+        vec3 edge2 = vertices[2].Position - vertices[0].Position;
+
         rec.t = t;
         rec.hit_point.Position = r.cast(rec.t);
         rec.hit_point.Texcoord = interpTexcoord(u, v);
         vec3 outward_normal = normalize(cross(edge1, edge2));
         rec.setFaceNormal(r, outward_normal);
-        rec.mat_ptr = mat_ptr;
+        rec.mat_ptr = mat_ptr.get();
 
         return true;
     }
 
-    bool Triangle::aabb(AABB &bounding_box) const
+    inline bool Triangle::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        float t, u, v;
+        return intersect(r, t_min, t_max, t, u, v);
+    }
+
+    inline bool Triangle::aabb(AABB &bounding_box) const
     {
         auto x_min = min({vertices[0].Position.x, vertices[1].Position.x, vertices[2].Position.x}) - EPS;
         auto y_min = min({vertices[0].Position.y, vertices[1].Position.y, vertices[2].Position.y}) - EPS;
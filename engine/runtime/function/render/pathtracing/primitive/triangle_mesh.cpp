@@ -0,0 +1,176 @@
+#include "runtime/function/render/pathtracing/primitive/triangle_mesh.h"
+
+#include <cassert>
+#include <iostream>
+
+namespace MiniEngine::PathTracing
+{
+    template <typename T>
+    static void permute(vector<T> &data, const vector<int> &order, size_t stride = 1)
+    {
+        vector<T> ordered(data.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            for (size_t k = 0; k < stride; k++)
+            {
+                ordered[stride * i + k] = data[stride * order[i] + k];
+            }
+        }
+        data.swap(ordered);
+    }
+
+    void TriangleMesh::clear()
+    {
+        v0_x.clear(), v0_y.clear(), v0_z.clear();
+        e1_x.clear(), e1_y.clear(), e1_z.clear();
+        e2_x.clear(), e2_y.clear(), e2_z.clear();
+
+        normals.clear();
+        texcoords.clear();
+        material_ids.clear();
+        light_ids.clear();
+        uv_densities.clear();
+        materials.clear();
+    }
+
+    void TriangleMesh::reserve(size_t triangle_count)
+    {
+        v0_x.reserve(triangle_count), v0_y.reserve(triangle_count), v0_z.reserve(triangle_count);
+        e1_x.reserve(triangle_count), e1_y.reserve(triangle_count), e1_z.reserve(triangle_count);
+        e2_x.reserve(triangle_count), e2_y.reserve(triangle_count), e2_z.reserve(triangle_count);
+
+        normals.reserve(triangle_count);
+        texcoords.reserve(3 * triangle_count);
+        material_ids.reserve(triangle_count);
+        light_ids.reserve(triangle_count);
+        uv_densities.reserve(triangle_count);
+    }
+
+    void TriangleMesh::addTriangle(const Vertex &a, const Vertex &b, const Vertex &c, int material_id, int light_id)
+    {
+        vec3 edge1 = b.Position - a.Position;
+        vec3 edge2 = c.Position - a.Position;
+
+        v0_x.push_back(a.Position.x), v0_y.push_back(a.Position.y), v0_z.push_back(a.Position.z);
+        e1_x.push_back(edge1.x), e1_y.push_back(edge1.y), e1_z.push_back(edge1.z);
+        e2_x.push_back(edge2.x), e2_y.push_back(edge2.y), e2_z.push_back(edge2.z);
+
+        vec3 n = cross(edge1, edge2);
+        normals.push_back(normalize(n));
+        texcoords.push_back(a.Texcoord);
+        texcoords.push_back(b.Texcoord);
+        texcoords.push_back(c.Texcoord);
+        assert(material_id >= 0 && material_id < MaxMaterials);
+        material_ids.push_back(static_cast<uint16_t>(material_id));
+        light_ids.push_back(light_id);
+
+        vec2 uv1 = b.Texcoord - a.Texcoord;
+        vec2 uv2 = c.Texcoord - a.Texcoord;
+        float uv_area = fabs(uv1.x * uv2.y - uv1.y * uv2.x);
+        float area = length(n);
+        uv_densities.push_back(area > 0.f ? sqrt(uv_area / area) : 0.f);
+    }
+
+    int TriangleMesh::addMaterial(shared_ptr<Material> material)
+    {
+        if (materials.size() >= MaxMaterials)
+        {
+            std::cerr << "Mesh has more than " << MaxMaterials << " materials" << std::endl;
+            return -1;
+        }
+        materials.push_back(material);
+        return materials.size() - 1;
+    }
+
+    void TriangleMesh::reorder(const vector<int> &order)
+    {
+        permute(v0_x, order), permute(v0_y, order), permute(v0_z, order);
+        permute(e1_x, order), permute(e1_y, order), permute(e1_z, order);
+        permute(e2_x, order), permute(e2_y, order), permute(e2_z, order);
+
+        permute(normals, order);
+        permute(texcoords, order, 3);
+        permute(material_ids, order);
+        permute(light_ids, order);
+        permute(uv_densities, order);
+    }
+
+    AABB TriangleMesh::bounds(int id) const
+    {
+        vec3 p0 = getVertex0(id);
+        vec3 p1 = p0 + getEdge1(id);
+        vec3 p2 = p0 + getEdge2(id);
+
+        // pad like Triangle::aabb so axis aligned triangles still have a volume
+        return AABB(glm::min(p0, glm::min(p1, p2)) - EPS, glm::max(p0, glm::max(p1, p2)) + EPS);
+    }
+
+    size_t TriangleMesh::getMemoryUsage() const
+    {
+        return 9 * v0_x.capacity() * sizeof(float) +
+               normals.capacity() * sizeof(vec3) +
+               texcoords.capacity() * sizeof(vec2) +
+               material_ids.capacity() * sizeof(uint16_t) +
+               light_ids.capacity() * sizeof(int) +
+               uv_densities.capacity() * sizeof(float);
+    }
+
+    void TriangleMesh::fillHitRecord(int id, const Ray &r, float t, float u, float v, HitRecord &rec) const
+    {
+        rec.t = t;
+        rec.hit_point.Position = r.cast(t);
+        rec.hit_point.Texcoord = u * texcoords[3 * id + 1] + v * texcoords[3 * id + 2] + (1 - u - v) * texcoords[3 * id];
+        rec.setFaceNormal(r, normals[id]);
+        rec.mat_ptr = materials[material_ids[id]].get();
+        rec.light_id = light_ids[id];
+        rec.uv_density = uv_densities[id];
+    }
+
+    bool TriangleMesh::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const
+    {
+        int closest = -1;
+        float closest_u, closest_v;
+
+        for (int i = 0; i < size(); i++)
+        {
+            float t, u, v;
+            if (intersect(i, r, t_min, t_max, t, u, v))
+            {
+                closest = i;
+                closest_u = u;
+                closest_v = v;
+                t_max = t;
+            }
+        }
+
+        if (closest < 0)
+            return false;
+
+        fillHitRecord(closest, r, t_max, closest_u, closest_v, rec);
+        return true;
+    }
+
+    bool TriangleMesh::occluded(const Ray &r, float t_min, float t_max) const
+    {
+        for (int i = 0; i < size(); i++)
+        {
+            float t, u, v;
+            if (intersect(i, r, t_min, t_max, t, u, v))
+                return true;
+        }
+        return false;
+    }
+
+    bool TriangleMesh::aabb(AABB &bounding_box) const
+    {
+        if (size() == 0)
+            return false;
+
+        bounding_box = bounds(0);
+        for (int i = 1; i < size(); i++)
+        {
+            bounding_box = AABB::getSurroundingBox(bounding_box, bounds(i));
+        }
+        return true;
+    }
+}
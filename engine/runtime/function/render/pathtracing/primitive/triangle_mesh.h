@@ -0,0 +1,86 @@
+#pragma once
+
+#include "runtime/function/render/pathtracing/common/hittable.h"
+
+#include <cstdint>
+
+namespace MiniEngine::PathTracing
+{
+    // Mesh level triangle soup. The data touched by every intersection test (first vertex and
+    // the two edges) is kept in structure-of-arrays form, the shading data is only read for the
+    // closest hit.
+    class TriangleMesh : public Hittable
+    {
+    public:
+        // intersection data
+        vector<float> v0_x, v0_y, v0_z;
+        vector<float> e1_x, e1_y, e1_z;
+        vector<float> e2_x, e2_y, e2_z;
+
+        // shading data
+        vector<vec3> normals;         // unit geometric normal, one per triangle
+        vector<vec2> texcoords;       // three per triangle
+        vector<uint16_t> material_ids;
+        vector<int> light_ids;        // index into the LightSampler, -1 for triangles that do not emit
+        vector<float> uv_densities;   // sqrt(uv area / surface area), scales ray cone widths to uv units
+        vector<shared_ptr<Material>> materials;
+
+        // material ids are stored as uint16_t
+        static const int MaxMaterials = UINT16_MAX + 1;
+
+        TriangleMesh() = default;
+
+        size_t size() const { return v0_x.size(); }
+
+        void clear();
+        void reserve(size_t triangle_count);
+        void addTriangle(const Vertex &a, const Vertex &b, const Vertex &c, int material_id, int light_id = -1);
+        // returns -1 once MaxMaterials are in use
+        int addMaterial(shared_ptr<Material> material);
+
+        // reorders every per triangle array so that triangle i becomes triangle order[i]
+        void reorder(const vector<int> &order);
+
+        AABB bounds(int id) const;
+        size_t getMemoryUsage() const;
+
+        vec3 getVertex0(int id) const { return vec3(v0_x[id], v0_y[id], v0_z[id]); }
+        vec3 getEdge1(int id) const { return vec3(e1_x[id], e1_y[id], e1_z[id]); }
+        vec3 getEdge2(int id) const { return vec3(e2_x[id], e2_y[id], e2_z[id]); }
+
+        // Moller-Trumbore on the precomputed edges, returns the distance and barycentrics only
+        inline bool intersect(int id, const Ray &r, float t_min, float t_max, float &t, float &u, float &v) const
+        {
+            vec3 edge1 = getEdge1(id);
+            vec3 edge2 = getEdge2(id);
+
+            vec3 q = cross(r.direction, edge2);
+            float a = dot(edge1, q);
+
+            if (fabs(a) < EPS * EPS)
+                return false;
+
+            float f = 1.f / a;
+            vec3 s = r.origin - getVertex0(id);
+            u = f * dot(s, q);
+
+            if (u < 0)
+                return false;
+
+            vec3 k = cross(s, edge1);
+            v = f * dot(r.direction, k);
+
+            if (v < 0 || u + v > 1)
+                return false;
+
+            t = f * dot(edge2, k);
+            return t >= t_min && t <= t_max;
+        }
+
+        void fillHitRecord(int id, const Ray &r, float t, float u, float v, HitRecord &rec) const;
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool aabb(AABB &bounding_box) const override;
+    };
+}
@@ -0,0 +1,211 @@
+#include "runtime/function/render/rasterization/acc_struct/octree.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace MiniEngine
+{
+    // subtrees with more triangles than this are split on their own task
+    static const int ParallelSplitSize = 4096;
+
+    struct OctTree::BuildNode
+    {
+        glm::vec3 split_min; // the octant, halved for the children
+        glm::vec3 split_max;
+        std::vector<int> triangles;      // global triangle ids, in model order
+        std::vector<int> leaf_vertices;  // global vertex ids of a leaf, sorted
+        std::unique_ptr<BuildNode> children[8];
+    };
+
+    void OctTree::split(BuildNode &node, const std::vector<glm::vec3> &centroids, int depth)
+    {
+        if (node.triangles.size() <= MaxFaceNum || depth >= MaxOctreeDepth)
+            return;
+
+        // every triangle goes to the octant of its centroid, so none is lost or duplicated
+        glm::vec3 center = 0.5f * (node.split_min + node.split_max);
+        for (int id : node.triangles)
+        {
+            const glm::vec3 &c = centroids[id];
+            int octant = (c.x > center.x ? 1 : 0) | (c.y > center.y ? 2 : 0) | (c.z > center.z ? 4 : 0);
+
+            std::unique_ptr<BuildNode> &child = node.children[octant];
+            if (!child)
+            {
+                child = std::make_unique<BuildNode>();
+                child->split_min = glm::vec3((octant & 1) ? center.x : node.split_min.x,
+                                             (octant & 2) ? center.y : node.split_min.y,
+                                             (octant & 4) ? center.z : node.split_min.z);
+                child->split_max = glm::vec3((octant & 1) ? node.split_max.x : center.x,
+                                             (octant & 2) ? node.split_max.y : center.y,
+                                             (octant & 4) ? node.split_max.z : center.z);
+            }
+            child->triangles.push_back(id);
+        }
+
+        bool parallel = node.triangles.size() > ParallelSplitSize;
+        node.triangles = std::vector<int>();
+
+        auto split_child = [&](int octant)
+        {
+            if (node.children[octant])
+                split(*node.children[octant], centroids, depth + 1);
+        };
+
+        if (parallel)
+        {
+            tbb::parallel_for(0, 8, split_child);
+        }
+        else
+        {
+            for (int octant = 0; octant < 8; octant++)
+                split_child(octant);
+        }
+    }
+
+    void OctTree::build_oct_tree(const Model &model)
+    {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        nodes.clear();
+        vertices.clear();
+        indices.clear();
+
+        // the triangles of all meshes with global vertex ids
+        std::vector<const Vertex *> source_vertices;
+        std::vector<int> corners;
+        for (const Mesh &mesh : model.meshes)
+        {
+            int base = source_vertices.size();
+            for (const Vertex &vertex : mesh.vertices)
+            {
+                source_vertices.push_back(&vertex);
+            }
+            for (int i = 0; i + 2 < mesh.indices.size(); i += 3)
+            {
+                corners.push_back(base + mesh.indices[i]);
+                corners.push_back(base + mesh.indices[i + 1]);
+                corners.push_back(base + mesh.indices[i + 2]);
+            }
+        }
+
+        const int triangle_count = corners.size() / 3;
+        if (triangle_count == 0)
+            return;
+
+        BuildNode root;
+        root.split_min = glm::vec3(std::numeric_limits<float>::max());
+        root.split_max = glm::vec3(-std::numeric_limits<float>::max());
+        root.triangles.resize(triangle_count);
+
+        std::vector<glm::vec3> centroids(triangle_count);
+        for (int id = 0; id < triangle_count; id++)
+        {
+            const glm::vec3 &a = source_vertices[corners[3 * id]]->Position;
+            const glm::vec3 &b = source_vertices[corners[3 * id + 1]]->Position;
+            const glm::vec3 &c = source_vertices[corners[3 * id + 2]]->Position;
+
+            centroids[id] = (a + b + c) / 3.f;
+            root.split_min = glm::min(root.split_min, glm::min(a, glm::min(b, c)));
+            root.split_max = glm::max(root.split_max, glm::max(a, glm::max(b, c)));
+            root.triangles[id] = id;
+        }
+
+        split(root, centroids, 0);
+
+        // breadth first, which puts the children of every node next to each other
+        std::vector<BuildNode *> order(1, &root);
+        std::vector<int> leaves;
+        nodes.resize(1);
+        for (int i = 0; i < order.size(); i++)
+        {
+            BuildNode *node = order[i];
+
+            int first_child = order.size();
+            for (int octant = 0; octant < 8; octant++)
+            {
+                if (node->children[octant])
+                    order.push_back(node->children[octant].get());
+            }
+
+            nodes.resize(order.size());
+            nodes[i].child_count = order.size() - first_child;
+            if (nodes[i].child_count > 0)
+                nodes[i].first_child = first_child;
+            else
+                leaves.push_back(i);
+        }
+
+        // the vertices every leaf needs
+        tbb::parallel_for(0, int(leaves.size()), [&](int l)
+                          {
+            BuildNode &node = *order[leaves[l]];
+            node.leaf_vertices.reserve(3 * node.triangles.size());
+            for (int id : node.triangles)
+            {
+                node.leaf_vertices.push_back(corners[3 * id]);
+                node.leaf_vertices.push_back(corners[3 * id + 1]);
+                node.leaf_vertices.push_back(corners[3 * id + 2]);
+            }
+            std::sort(node.leaf_vertices.begin(), node.leaf_vertices.end());
+            node.leaf_vertices.erase(std::unique(node.leaf_vertices.begin(), node.leaf_vertices.end()), node.leaf_vertices.end()); });
+
+        int vertex_total = 0, triangle_total = 0;
+        for (int i : leaves)
+        {
+            nodes[i].first_vertex = vertex_total;
+            nodes[i].vertex_count = order[i]->leaf_vertices.size();
+            nodes[i].first_triangle = triangle_total;
+            nodes[i].triangle_count = order[i]->triangles.size();
+            vertex_total += nodes[i].vertex_count;
+            triangle_total += nodes[i].triangle_count;
+        }
+        vertices.resize(vertex_total);
+        indices.resize(3 * triangle_total);
+
+        tbb::parallel_for(0, int(leaves.size()), [&](int l)
+                          {
+            OctNode &leaf = nodes[leaves[l]];
+            const BuildNode &node = *order[leaves[l]];
+
+            leaf.bound.min = glm::vec3(std::numeric_limits<float>::max());
+            leaf.bound.max = glm::vec3(-std::numeric_limits<float>::max());
+            for (int v = 0; v < leaf.vertex_count; v++)
+            {
+                const Vertex &vertex = *source_vertices[node.leaf_vertices[v]];
+                vertices[leaf.first_vertex + v] = vertex;
+                leaf.bound.min = glm::min(leaf.bound.min, vertex.Position);
+                leaf.bound.max = glm::max(leaf.bound.max, vertex.Position);
+            }
+
+            unsigned int *leaf_indices = &indices[3 * leaf.first_triangle];
+            for (int t = 0; t < leaf.triangle_count; t++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    int global = corners[3 * node.triangles[t] + k];
+                    leaf_indices[3 * t + k] = std::lower_bound(node.leaf_vertices.begin(), node.leaf_vertices.end(), global) - node.leaf_vertices.begin();
+                }
+            } });
+
+        // children come after their parent, so walking backwards finishes them first
+        for (int i = nodes.size() - 1; i >= 0; i--)
+        {
+            OctNode &node = nodes[i];
+            if (node.leaf())
+                continue;
+
+            node.bound = nodes[node.first_child].bound;
+            for (int c = node.first_child + 1; c < node.first_child + node.child_count; c++)
+            {
+                node.bound.min = glm::min(node.bound.min, nodes[c].bound.min);
+                node.bound.max = glm::max(node.bound.max, nodes[c].bound.max);
+            }
+        }
+
+        std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+        build_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time).count();
+    }
+}
@@ -1,7 +1,14 @@
 #include "runtime/function/render/rasterization/hierarchy_zbuffer.h"
+#include "thirdparty/tbb/include/tbb/parallel_for.h"
 
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+
+#ifdef SOFT_RASTERIZER_SSE
+#include <emmintrin.h>
+#endif
 
 // #define DEPTH
 
@@ -9,22 +16,35 @@ using namespace std;
 
 namespace MiniEngine
 {
-    void SoftRasterizer::hierarchy_zbuffer_rasterize(
-        OctTree::OctNode *model_root,
-        glm::mat4 &model,
-        glm::mat4 &view,
-        glm::mat4 &projection,
-        unsigned char *pixels,
-        unsigned char *texture,
-        int width,
-        int height)
+#ifdef SOFT_RASTERIZER_SSE
+    // the lanes of a quad mask as vector masks
+    alignas(16) static const int32_t LaneMasks[16][4] = {
+        {0, 0, 0, 0}, {-1, 0, 0, 0}, {0, -1, 0, 0}, {-1, -1, 0, 0},
+        {0, 0, -1, 0}, {-1, 0, -1, 0}, {0, -1, -1, 0}, {-1, -1, -1, 0},
+        {0, 0, 0, -1}, {-1, 0, 0, -1}, {0, -1, 0, -1}, {-1, -1, 0, -1},
+        {0, 0, -1, -1}, {-1, 0, -1, -1}, {0, -1, -1, -1}, {-1, -1, -1, -1}};
+#endif
+
+    // set lanes of a quad mask
+    static const int LaneCount[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+    SoftRasterizer::Statistics &SoftRasterizer::Statistics::operator+=(const Statistics &other)
     {
-        pass_one_rasterization(model_root, model, view, projection, pixels, texture, width, height);
-        pass_two_rasterization(model_root, model, view, projection, pixels, texture, width, height);
+        nodes_tested += other.nodes_tested;
+        nodes_rejected += other.nodes_rejected;
+        triangles += other.triangles;
+        triangles_culled += other.triangles_culled;
+        tile_tests += other.tile_tests;
+        tiles_rejected += other.tiles_rejected;
+        block_tests += other.block_tests;
+        blocks_rejected += other.blocks_rejected;
+        depth_tests += other.depth_tests;
+        pixels_shaded += other.pixels_shaded;
+        return *this;
     }
 
-    void SoftRasterizer::pass_one_rasterization(
-        OctTree::OctNode *model_root,
+    void SoftRasterizer::hierarchy_zbuffer_rasterize(
+        OctTree &tree,
         glm::mat4 &model,
         glm::mat4 &view,
         glm::mat4 &projection,
@@ -33,364 +53,706 @@ namespace MiniEngine
         int width,
         int height)
     {
-        if (!model_root->visibility)
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        statistics = Statistics();
+        zbuffer.clear();
+        if (tree.empty())
         {
             return;
         }
+        octree = &tree;
 
-        OctTree::Bound bound = model_root->bound[1];
-        screen_space_transform(&bound, model, view, projection);
-        float xmin, xmax, ymin, ymax, zmin, zmax;
+        // what was visible in the last frame goes first, it occludes most of the rest
+        batch.clear();
+        pass_one_rasterization(0);
+        render_batch(model, view, projection, pixels, texture, width, height);
+        std::swap(batch, first_batch);
 
-        xmin = bound.corner[0].x;
-        xmax = bound.corner[0].x;
-        ymin = bound.corner[0].y;
-        ymax = bound.corner[0].y;
-        zmin = bound.corner[0].z;
-        zmax = bound.corner[0].z;
+        // everything else is tested against its depth
+        glm::vec3 eye = glm::vec3(glm::inverse(view * model)[3]);
+        batch.clear();
+        pass_two_rasterization(0, eye, model, view, projection);
+        render_batch(model, view, projection, pixels, texture, width, height);
 
-        for (int i = 1; i < 8; i++)
+        for (int leaf : first_batch)
         {
-            if (bound.corner[i].x < xmin)
-                xmin = bound.corner[i].x;
-            if (bound.corner[i].x > xmax)
-                xmax = bound.corner[i].x;
-            if (bound.corner[i].y < ymin)
-                ymin = bound.corner[i].y;
-            if (bound.corner[i].y > ymax)
-                ymax = bound.corner[i].y;
-            if (bound.corner[i].z < zmin)
-                zmin = bound.corner[i].z;
-            if (bound.corner[i].z > zmax)
-                zmax = bound.corner[i].z;
+            octree->nodes[leaf].checked = false;
         }
 
-        if (!ztest(zmin, xmin, xmax, ymin, ymax))
-        { 
-            model_root->visibility=false;
-            model_root->checked=true;
+        std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+        statistics.frame_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time).count();
+    }
+
+    void SoftRasterizer::pass_one_rasterization(int node)
+    {
+        OctTree::OctNode &current = octree->nodes[node];
+        if (!current.visibility)
+        {
             return;
         }
 
-        if (model_root->childs[0] == nullptr)
+        if (current.leaf())
         {
-            Mesh mesh = model_root->triangles;
-            screen_space_transform(&mesh, model, view, projection);
-            triangle_render(&mesh, pixels, texture, width, height);
+            current.checked = true;
+            batch.push_back(node);
             return;
         }
 
-        for (int i = 0; i < 8; i++)
+        for (int child = current.first_child; child < current.first_child + current.child_count; child++)
         {
-            if (model_root->childs[i]->empty)
-            {
-                continue;
-            }
-
-            pass_one_rasterization(model_root->childs[i], model, view, projection, pixels, texture, width, height);
+            pass_one_rasterization(child);
         }
     }
 
     void SoftRasterizer::pass_two_rasterization(
-        OctTree::OctNode *model_root,
+        int node,
+        const glm::vec3 &eye,
         glm::mat4 &model,
         glm::mat4 &view,
-        glm::mat4 &projection,
-        unsigned char *pixels,
-        unsigned char *texture,
-        int width,
-        int height)
+        glm::mat4 &projection)
     {
-        if (model_root->visibility)
+        OctTree::OctNode &current = octree->nodes[node];
+
+        glm::vec3 screen_min, screen_max;
+        screen_space_transform(current.bound, screen_min, screen_max, model, view, projection, frame_width, frame_height);
+
+        current.visibility = ztest(screen_min.z, screen_min.x, screen_max.x, screen_min.y, screen_max.y);
+        statistics.nodes_tested++;
+        if (!current.visibility)
         {
+            statistics.nodes_rejected++;
             return;
         }
 
-        if (model_root->checked)
-        {   
-            model_root->checked=false;
+        if (current.leaf())
+        {
+            // leaves of the first batch are drawn already
+            if (!current.checked)
+            {
+                batch.push_back(node);
+            }
             return;
         }
 
-        OctTree::Bound bound = model_root->bound[1];
-        screen_space_transform(&bound, model, view, projection);
-        float xmin, xmax, ymin, ymax, zmin, zmax;
+        int order[8];
+        float distance[8];
+        const int count = current.child_count;
+        for (int i = 0; i < count; i++)
+        {
+            const OctTree::Bound &bound = octree->nodes[current.first_child + i].bound;
+            glm::vec3 offset = 0.5f * (bound.min + bound.max) - eye;
+            distance[i] = glm::dot(offset, offset);
+            order[i] = i;
+        }
+        std::sort(order, order + count, [&](int a, int b)
+                  { return distance[a] < distance[b]; });
 
-        xmin = bound.corner[0].x;
-        xmax = bound.corner[0].x;
-        ymin = bound.corner[0].y;
-        ymax = bound.corner[0].y;
-        zmin = bound.corner[0].z;
-        zmax = bound.corner[0].z;
+        for (int i = 0; i < count; i++)
+        {
+            pass_two_rasterization(current.first_child + order[i], eye, model, view, projection);
+        }
+    }
 
-        for (int i = 1; i < 8; i++)
+    void SoftRasterizer::hierarchy_zbuffer_initialize(int width, int height)
+    {
+        frame_width = width;
+        frame_height = height;
+        zbuffer.initialize(max(width, height));
+
+        tiles_x = (width + TileSize - 1) / TileSize;
+        tiles_y = (height + TileSize - 1) / TileSize;
+        bins.resize(BinChunks * tiles_x * tiles_y);
+        chunk_statistics.resize(BinChunks);
+        tile_statistics.resize(tiles_x * tiles_y);
+    }
+
+    void SoftRasterizer::HiZBuffer::initialize(int buffer_size)
+    {
+        // whole regions, and a power of two so every level halves exactly
+        size = 1 << RegionLevel;
+        while (size < buffer_size)
+            size <<= 1;
+
+        levels = 0;
+        offsets.clear();
+        int texels = 0;
+        for (int n = size; n > 0; n >>= 1)
         {
-            if (bound.corner[i].x < xmin)
-                xmin = bound.corner[i].x;
-            if (bound.corner[i].x > xmax)
-                xmax = bound.corner[i].x;
-            if (bound.corner[i].y < ymin)
-                ymin = bound.corner[i].y;
-            if (bound.corner[i].y > ymax)
-                ymax = bound.corner[i].y;
-            if (bound.corner[i].z < zmin)
-                zmin = bound.corner[i].z;
-            if (bound.corner[i].z > zmax)
-                zmax = bound.corner[i].z;
+            offsets.push_back(texels);
+            texels += n * n;
+            levels++;
         }
 
-        if (!ztest(zmin, xmin, xmax, ymin, ymax))
+        far_depth.assign(texels, 1.f);
+        near_depth.assign(texels, 1.f);
+        dirty.assign(texels, 0);
+
+        regions = size >> RegionLevel;
+        dirty_tiles.assign(regions * regions, std::vector<int>());
+        for (std::vector<int> &tiles : dirty_tiles)
         {
-            return;
+            tiles.reserve(1 << (2 * (RegionLevel - TileLevel)));
         }
+        region_changed.assign(regions * regions, 0);
 
-        model_root->visibility = true;
+        queue[0].clear();
+        queue[0].reserve(regions * regions);
+        queue[1].clear();
+        queue[1].reserve(regions * regions);
+    }
 
-        if (model_root->childs[0] == nullptr)
+    void SoftRasterizer::HiZBuffer::clear()
+    {
+        std::fill(far_depth.begin(), far_depth.end(), 1.f);
+        std::fill(near_depth.begin(), near_depth.end(), 1.f);
+        std::fill(dirty.begin(), dirty.end(), 0);
+        std::fill(region_changed.begin(), region_changed.end(), 0);
+        for (std::vector<int> &tiles : dirty_tiles)
         {
-            Mesh mesh = model_root->triangles;
-            screen_space_transform(&mesh, model, view, projection);
-            triangle_render(&mesh, pixels, texture, width, height);
-            return;
+            tiles.clear();
         }
+    }
+
+    void SoftRasterizer::HiZBuffer::refresh(int level, int x, int y, int n)
+    {
+        const int source_stride = size >> (level - 1);
+        const int target_stride = size >> level;
 
-        for (int i = 0; i < 8; i++)
+        // level 0 is a plain z-buffer, its nearest and farthest depth are the same
+        const int source = texel(level - 1, 2 * x, 2 * y);
+        const float *source_far = &far_depth[source];
+        const float *source_near = level == 1 ? source_far : &near_depth[source];
+
+        const int target = texel(level, x, y);
+        float *target_far = &far_depth[target];
+        float *target_near = &near_depth[target];
+
+        for (int j = 0; j < n; j++)
         {
-            if (model_root->childs[i]->empty)
+            const float *f0 = source_far + 2 * j * source_stride, *f1 = f0 + source_stride;
+            const float *n0 = source_near + 2 * j * source_stride, *n1 = n0 + source_stride;
+            for (int i = 0; i < n; i++)
             {
-                continue;
+                target_far[j * target_stride + i] = max(max(f0[2 * i], f0[2 * i + 1]), max(f1[2 * i], f1[2 * i + 1]));
+                target_near[j * target_stride + i] = min(min(n0[2 * i], n0[2 * i + 1]), min(n1[2 * i], n1[2 * i + 1]));
             }
-
-            pass_two_rasterization(model_root->childs[i], model, view, projection, pixels, texture, width, height);
         }
     }
 
-    void SoftRasterizer::hierarchy_zbuffer_initialize(int size)
+    void SoftRasterizer::HiZBuffer::flush_region(int region)
     {
-        zbuffer = SoftRasterizer::build_mipmap(size);
+        std::vector<int> &tiles = dirty_tiles[region];
+        if (tiles.empty())
+            return;
+
+        // the levels inside a tile only depend on its own pixels
+        const int tile_count = size >> TileLevel;
+        for (int tile : tiles)
+        {
+            dirty[tile] = 0;
+            int tx = (tile - offsets[TileLevel]) % tile_count;
+            int ty = (tile - offsets[TileLevel]) / tile_count;
+
+            for (int level = 1; level <= TileLevel; level++)
+            {
+                int n = 1 << (TileLevel - level);
+                refresh(level, tx * n, ty * n, n);
+            }
+        }
+        tiles.clear();
+
+        // the few texels between the tiles and the region are cheaper to redo than to track
+        int rx = region % regions, ry = region / regions;
+        for (int level = TileLevel + 1; level <= RegionLevel; level++)
+        {
+            int n = 1 << (RegionLevel - level);
+            refresh(level, rx * n, ry * n, n);
+        }
+        region_changed[region] = 1;
     }
 
-    SoftRasterizer::Mipmap *SoftRasterizer::build_mipmap(int size)
+    void SoftRasterizer::HiZBuffer::flush()
     {
-        vector<vector<vector<Mipmap *>>> texel;
-        texel.resize(log2(size) + 1);
-        bool is_leafnode = true;
-
-        while (size)
+        queue[0].clear();
+        for (int region = 0; region < regions * regions; region++)
         {
-            int level = log2(size);
-            texel[level].resize(size);
+            flush_region(region);
+            if (!region_changed[region])
+                continue;
 
-            if (is_leafnode)
+            region_changed[region] = 0;
+            if (RegionLevel + 1 < levels)
             {
-                for (int i = 0; i < size; i++)
+                int parent = texel(RegionLevel + 1, (region % regions) >> 1, (region / regions) >> 1);
+                if (!dirty[parent])
                 {
-                    texel[level][i].resize(size);
-                    for (int j = 0; j < size; j++)
-                    {
-                        texel[level][i][j] = new Mipmap();
-                    }
+                    dirty[parent] = 1;
+                    queue[0].push_back(parent);
                 }
-                is_leafnode = false;
             }
-            else
+        }
+
+        // above the regions one level at a time, every dirty texel once
+        for (int level = RegionLevel + 1; level < levels; level++)
+        {
+            const int n = size >> level;
+            queue[1].clear();
+            for (int id : queue[0])
             {
-                for (int i = 0; i < size; i++)
+                dirty[id] = 0;
+                int x = (id - offsets[level]) % n;
+                int y = (id - offsets[level]) / n;
+                refresh(level, x, y, 1);
+
+                if (level + 1 < levels)
                 {
-                    texel[level][i].resize(size);
-                    for (int j = 0; j < size; j++)
+                    int parent = texel(level + 1, x >> 1, y >> 1);
+                    if (!dirty[parent])
                     {
-                        texel[level][i][j] = new Mipmap(texel[level + 1][2 * i][2 * j],
-                                                        texel[level + 1][2 * i][2 * j + 1],
-                                                        texel[level + 1][2 * i + 1][2 * j],
-                                                        texel[level + 1][2 * i + 1][2 * j + 1]);
+                        dirty[parent] = 1;
+                        queue[1].push_back(parent);
                     }
                 }
             }
+            std::swap(queue[0], queue[1]);
+        }
+    }
 
-            size = size >> 1;
+    int SoftRasterizer::HiZBuffer::query_level(int xmin, int xmax, int ymin, int ymax) const
+    {
+        // texels at least as wide as the box, it then overlaps two of them at most per axis
+        int extent = std::max(xmax - xmin, ymax - ymin) + 1;
+        int level = 0;
+        while ((1 << level) < extent && level + 1 < levels)
+            level++;
+        return level;
+    }
+
+    bool SoftRasterizer::HiZBuffer::occluded(float zmin, int xmin, int xmax, int ymin, int ymax) const
+    {
+        int level = query_level(xmin, xmax, ymin, ymax);
+        int x0 = xmin >> level, x1 = xmax >> level;
+        int y0 = ymin >> level, y1 = ymax >> level;
+
+        float depth = max({far_depth[texel(level, x0, y0)], far_depth[texel(level, x1, y0)],
+                           far_depth[texel(level, x0, y1)], far_depth[texel(level, x1, y1)]});
+        return depth <= zmin;
+    }
+
+    bool SoftRasterizer::HiZBuffer::unoccluded(float zmax, int xmin, int xmax, int ymin, int ymax) const
+    {
+        int level = query_level(xmin, xmax, ymin, ymax);
+        int x0 = xmin >> level, x1 = xmax >> level;
+        int y0 = ymin >> level, y1 = ymax >> level;
+
+        const std::vector<float> &near = level == 0 ? far_depth : near_depth;
+        float depth = min({near[texel(level, x0, y0)], near[texel(level, x1, y0)],
+                           near[texel(level, x0, y1)], near[texel(level, x1, y1)]});
+        return zmax < depth;
+    }
+
+    void SoftRasterizer::render_batch(
+        glm::mat4 &model,
+        glm::mat4 &view,
+        glm::mat4 &projection,
+        unsigned char *pixels,
+        unsigned char *texture,
+        int width,
+        int height)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+
+        vertex_offsets.resize(batch.size() + 1);
+        triangle_offsets.resize(batch.size() + 1);
+        vertex_offsets[0] = 0;
+        triangle_offsets[0] = 0;
+        for (int i = 0; i < batch.size(); i++)
+        {
+            const OctTree::OctNode &leaf = octree->nodes[batch[i]];
+            vertex_offsets[i + 1] = vertex_offsets[i] + leaf.vertex_count;
+            triangle_offsets[i + 1] = triangle_offsets[i] + leaf.triangle_count;
         }
+        screen_vertices.resize(vertex_offsets.back());
+        triangles.resize(triangle_offsets.back());
+        statistics.triangles += triangles.size();
+
+        tbb::parallel_for(0, BinChunks, [&](int chunk)
+                          { bin_triangles(chunk, model, view, projection); });
+
+        tbb::parallel_for(
+            0, tiles_x * tiles_y, [&](int tile)
+            { tile_render(tile, pixels, texture, width, height); },
+            tbb::simple_partitioner());
 
-        return texel[0][0][0];
+        zbuffer.flush();
+
+        for (Statistics &counters : chunk_statistics)
+        {
+            statistics += counters;
+            counters = Statistics();
+        }
+        for (Statistics &counters : tile_statistics)
+        {
+            statistics += counters;
+            counters = Statistics();
+        }
     }
 
-    void SoftRasterizer::triangle_render(Mesh *triangles, unsigned char *pixels, unsigned char *texture, int width, int height)
+    void SoftRasterizer::bin_triangles(int chunk, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection)
     {
-        // save vertices of one triangle
-        vector<Vertex> vertices(3);
+        Statistics &counters = chunk_statistics[chunk];
+        const int tile_count = tiles_x * tiles_y;
+        for (int tile = 0; tile < tile_count; tile++)
+        {
+            bins[chunk * tile_count + tile].clear();
+        }
 
-        // loop triangle faces
-        for (int id = 0; id < triangles->indices.size(); id += 3)
+        int first = chunk * batch.size() / BinChunks;
+        int last = (chunk + 1) * batch.size() / BinChunks;
+        for (int leaf = first; leaf < last; leaf++)
         {
-            vertices[0] = triangles->vertices[triangles->indices[id]];
-            vertices[1] = triangles->vertices[triangles->indices[id + 1]];
-            vertices[2] = triangles->vertices[triangles->indices[id + 2]];
-
-            vertices[0].Position.x = int(vertices[0].Position.x + 0.5);
-            vertices[1].Position.x = int(vertices[1].Position.x + 0.5);
-            vertices[2].Position.x = int(vertices[2].Position.x + 0.5);
-            vertices[0].Position.y = int(vertices[0].Position.y + 0.5);
-            vertices[1].Position.y = int(vertices[1].Position.y + 0.5);
-            vertices[2].Position.y = int(vertices[2].Position.y + 0.5);
-
-            float az, bz, cz;
-            az = vertices[0].Position.z;
-            bz = vertices[1].Position.z;
-            cz = vertices[2].Position.z;
-
-            float zmin = min({az, bz, cz});
-
-            int xmin, xmax, ymin, ymax;
-            xmin = max(int(min({vertices[0].Position.x, vertices[1].Position.x, vertices[2].Position.x})), 0);
-            xmax = min(int(max({vertices[0].Position.x, vertices[1].Position.x, vertices[2].Position.x})), window_size - 1);
-            ymin = max(int(min({vertices[0].Position.y, vertices[1].Position.y, vertices[2].Position.y})), 0);
-            ymax = min(int(max({vertices[0].Position.y, vertices[1].Position.y, vertices[2].Position.y})), window_size - 1);
-
-            if (!ztest(zmin, xmin, xmax, ymin, ymax))
+            const OctTree::OctNode &node = octree->nodes[batch[leaf]];
+            const unsigned int *indices = &octree->indices[3 * node.first_triangle];
+            Vertex *vertices = &screen_vertices[vertex_offsets[leaf]];
+
+            screen_space_transform(&octree->vertices[node.first_vertex], node.vertex_count, vertices, model, view, projection, frame_width, frame_height);
+
+            for (int face = 0; face < node.triangle_count; face++)
             {
-                continue;
-            }
+                int id = triangle_offsets[leaf] + face;
+                BinnedTriangle &triangle = triangles[id];
+                triangle.v[0] = vertex_offsets[leaf] + indices[3 * face];
+                triangle.v[1] = vertex_offsets[leaf] + indices[3 * face + 1];
+                triangle.v[2] = vertex_offsets[leaf] + indices[3 * face + 2];
+
+                bool outside_guard_band = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    const glm::vec3 &p = screen_vertices[triangle.v[k]].Position;
+                    // also catches the NaNs of vertices on the camera plane
+                    if (!(fabs(p.x) < GuardBand && fabs(p.y) < GuardBand))
+                        outside_guard_band = true;
 
-            EdgeEquation e0(vertices[1], vertices[2]);
-            EdgeEquation e1(vertices[2], vertices[0]);
-            EdgeEquation e2(vertices[0], vertices[1]);
+                    triangle.position[k] = glm::ivec2(int(floor(p.x * SubPixelScale + 0.5f)), int(floor(p.y * SubPixelScale + 0.5f)));
+                }
+                if (outside_guard_band)
+                {
+                    counters.triangles_culled++;
+                    continue;
+                }
 
-            // skip backface
-            float area = 0.5 * (e0.c + e1.c + e2.c);
-            if (area < 0)
-                continue;
+                const glm::ivec2 &a = triangle.position[0];
+                const glm::ivec2 &b = triangle.position[1];
+                const glm::ivec2 &c = triangle.position[2];
 
-            ParameterEquation depth(vertices[0].Position.z,
-                                    vertices[1].Position.z,
-                                    vertices[2].Position.z,
-                                    e0, e1, e2, area);
-            ParameterEquation texcoord_s(vertices[0].Texcoord.s,
-                                         vertices[1].Texcoord.s,
-                                         vertices[2].Texcoord.s,
-                                         e0, e1, e2, area);
-            ParameterEquation texcoord_t(vertices[0].Texcoord.t,
-                                         vertices[1].Texcoord.t,
-                                         vertices[2].Texcoord.t,
-                                         e0, e1, e2, area);
-
-            for (int px = xmin; px <= xmax; px++)
-            {
-                for (int py = ymin; py <= ymax; py++)
+                // skip backfaces, and degenerate triangles which would interpolate NaN depths
+                if (int64_t(b.x - a.x) * (c.y - a.y) - int64_t(c.x - a.x) * (b.y - a.y) <= 0)
                 {
-                    if (e0.evaluate(px, py) && e1.evaluate(px, py) && e2.evaluate(px, py))
-                    {
-                        float z = depth.interpolate(px, py);
+                    counters.triangles_culled++;
+                    continue;
+                }
 
-                        if (ztest(z, px, py))
-                        {
-                            float u = texcoord_s.interpolate(px, py);
-                            float v = texcoord_t.interpolate(px, py);
-#ifdef DEPTH
-                            pixels[3 * (window_size * py + px) + 0] = z * 8;
-                            pixels[3 * (window_size * py + px) + 1] = z * 8;
-                            pixels[3 * (window_size * py + px) + 2] = z * 8;
-#else
-                            pixels[3 * (window_size * py + px) + 0] = texture[3 * (width * int(height * v + 0.5) + int(width * u + 0.5)) + 0];
-                            pixels[3 * (window_size * py + px) + 1] = texture[3 * (width * int(height * v + 0.5) + int(width * u + 0.5)) + 1];
-                            pixels[3 * (window_size * py + px) + 2] = texture[3 * (width * int(height * v + 0.5) + int(width * u + 0.5)) + 2];
-#endif
-                        }
+                // pixels whose center lies inside the fixed point bounds
+                const int half = SubPixelScale / 2;
+                triangle.xmin = max((min({a.x, b.x, c.x}) - half + SubPixelScale - 1) >> SubPixelBits, 0);
+                triangle.xmax = min((max({a.x, b.x, c.x}) - half) >> SubPixelBits, frame_width - 1);
+                triangle.ymin = max((min({a.y, b.y, c.y}) - half + SubPixelScale - 1) >> SubPixelBits, 0);
+                triangle.ymax = min((max({a.y, b.y, c.y}) - half) >> SubPixelBits, frame_height - 1);
+                triangle.zmin = min({screen_vertices[triangle.v[0]].Position.z,
+                                     screen_vertices[triangle.v[1]].Position.z,
+                                     screen_vertices[triangle.v[2]].Position.z});
+
+                if (triangle.xmin > triangle.xmax || triangle.ymin > triangle.ymax)
+                {
+                    counters.triangles_culled++;
+                    continue;
+                }
+
+                for (int ty = triangle.ymin / TileSize; ty <= triangle.ymax / TileSize; ty++)
+                {
+                    for (int tx = triangle.xmin / TileSize; tx <= triangle.xmax / TileSize; tx++)
+                    {
+                        bins[chunk * tile_count + ty * tiles_x + tx].push_back(id);
                     }
                 }
             }
         }
     }
 
-    bool SoftRasterizer::ztest(float z, int x, int y)
+    void SoftRasterizer::tile_render(int tile, unsigned char *pixels, unsigned char *texture, int width, int height)
     {
-        int texel_size = window_size;
-        auto mipmap = zbuffer;
+        Statistics &counters = tile_statistics[tile];
+        const int tile_count = tiles_x * tiles_y;
+        const int x0 = (tile % tiles_x) * TileSize, x1 = min(x0 + TileSize, frame_width) - 1;
+        const int y0 = (tile / tiles_x) * TileSize, y1 = min(y0 + TileSize, frame_height) - 1;
+        const int region = zbuffer.region(x0, y0);
 
-        while (mipmap->childs[0] != nullptr)
+        for (int chunk = 0; chunk < BinChunks; chunk++)
         {
-            texel_size = texel_size >> 1;
-
-            if (mipmap->depth <= z)
+            for (int id : bins[chunk * tile_count + tile])
             {
-                return false;
-            }
+                const BinnedTriangle &triangle = triangles[id];
 
-            if (x < texel_size && y < texel_size)
-            {
-                mipmap = mipmap->childs[0];
-            }
-            else if (x >= texel_size && y < texel_size)
-            {
-                x -= texel_size;
-                mipmap = mipmap->childs[1];
-            }
-            else if (x < texel_size && y >= texel_size)
-            {
-                y -= texel_size;
-                mipmap = mipmap->childs[2];
-            }
-            else if (x >= texel_size && y >= texel_size)
-            {
-                x -= texel_size;
-                y -= texel_size;
-                mipmap = mipmap->childs[3];
+                int xmin = max(triangle.xmin, x0), xmax = min(triangle.xmax, x1);
+                int ymin = max(triangle.ymin, y0), ymax = min(triangle.ymax, y1);
+
+                // coarse rejection against this tile's part of the Hi-Z
+                zbuffer.flush_region(region);
+                counters.tile_tests++;
+                if (!ztest(triangle.zmin, xmin, xmax, ymin, ymax))
+                {
+                    counters.tiles_rejected++;
+                    continue;
+                }
+
+                triangle_render(triangle, xmin, xmax, ymin, ymax, pixels, texture, width, height, counters);
             }
         }
+    }
 
-        if (mipmap->depth <= z)
+    void SoftRasterizer::triangle_render(const BinnedTriangle &triangle,
+                                         int xmin,
+                                         int xmax,
+                                         int ymin,
+                                         int ymax,
+                                         unsigned char *pixels,
+                                         unsigned char *texture,
+                                         int width,
+                                         int height,
+                                         Statistics &counters)
+    {
+        // edge values inside a partly covered block stay far below this, clamping the start
+        // value of a block to it keeps every sign and the arithmetic in 32 bits
+        const int64_t EdgeClamp = 1 << 30;
+        const int half = SubPixelScale / 2;
+
+        const EdgeEquation edges[3] = {EdgeEquation(triangle.position[1], triangle.position[2]),
+                                       EdgeEquation(triangle.position[2], triangle.position[0]),
+                                       EdgeEquation(triangle.position[0], triangle.position[1])};
+
+        const Vertex &v0 = screen_vertices[triangle.v[0]];
+        const Vertex &v1 = screen_vertices[triangle.v[1]];
+        const Vertex &v2 = screen_vertices[triangle.v[2]];
+
+        // the snapped positions, in pixels
+        glm::vec2 positions[3];
+        for (int k = 0; k < 3; k++)
         {
-            return false;
+            positions[k] = glm::vec2(triangle.position[k]) / float(SubPixelScale);
         }
 
-        mipmap->update(z);
-
-        return true;
-    }
+        ParameterEquation depth(v0.Position.z, v1.Position.z, v2.Position.z, positions);
+        ParameterEquation texcoord_s(v0.Texcoord.s, v1.Texcoord.s, v2.Texcoord.s, positions);
+        ParameterEquation texcoord_t(v0.Texcoord.t, v1.Texcoord.t, v2.Texcoord.t, positions);
 
-    bool SoftRasterizer::ztest(float z, float xmin, float xmax, float ymin, float ymax)
-    {
-        int texel_size = window_size;
-        auto mipmap = zbuffer;
+        // quad lanes are (0, 0), (1, 0), (0, 1), (1, 1)
+        const float depth_offsets[4] = {0.f, depth.a, depth.b, depth.a + depth.b};
+        const float s_offsets[4] = {0.f, texcoord_s.a, texcoord_s.b, texcoord_s.a + texcoord_s.b};
+        const float t_offsets[4] = {0.f, texcoord_t.a, texcoord_t.b, texcoord_t.a + texcoord_t.b};
+        int32_t edge_offsets[3][4];
+        for (int k = 0; k < 3; k++)
+        {
+            int32_t step_x = edges[k].a * SubPixelScale, step_y = edges[k].b * SubPixelScale;
+            edge_offsets[k][0] = 0;
+            edge_offsets[k][1] = step_x;
+            edge_offsets[k][2] = step_y;
+            edge_offsets[k][3] = step_x + step_y;
+        }
 
-        while (xmin >= 0 && xmax < texel_size && ymin >= 0 && ymax < texel_size && mipmap != nullptr)
+#ifdef SOFT_RASTERIZER_SSE
+        const __m128 depth_lanes = _mm_loadu_ps(depth_offsets);
+        const __m128 s_lanes = _mm_loadu_ps(s_offsets);
+        const __m128 t_lanes = _mm_loadu_ps(t_offsets);
+        __m128i edge_lanes[3];
+        for (int k = 0; k < 3; k++)
         {
-            texel_size = texel_size >> 1;
+            edge_lanes[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(edge_offsets[k]));
+        }
+#endif
 
-            if (mipmap->depth <= z)
-            {
-                return false;
-            }
+        float *depth_buffer = zbuffer.far_depth.data();
+        const int depth_stride = zbuffer.size;
 
-            if (xmin >= 0 && xmax < texel_size && ymin >= 0 && ymax < texel_size)
-            {
-                mipmap = mipmap->childs[0];
-            }
-            else if (xmin - texel_size >= 0 && xmax - texel_size < texel_size && ymin >= 0 && ymax < texel_size)
-            {
-                xmin -= texel_size;
-                xmax -= texel_size;
-                mipmap = mipmap->childs[1];
-            }
-            else if (xmin >= 0 && xmax < texel_size && ymin - texel_size >= 0 && ymax - texel_size < texel_size)
-            {
-                ymin -= texel_size;
-                ymax -= texel_size;
-                mipmap = mipmap->childs[2];
-            }
-            else if (xmin - texel_size >= 0 && xmax - texel_size < texel_size && ymin - texel_size >= 0 && ymax - texel_size < texel_size)
-            {
-                xmin -= texel_size;
-                xmax -= texel_size;
-                ymin -= texel_size;
-                ymax -= texel_size;
-                mipmap = mipmap->childs[3];
-            }
-            else
+        for (int by = ymin & ~7; by <= ymax; by += 8)
+        {
+            for (int bx = xmin & ~7; bx <= xmax; bx += 8)
             {
-                return true;
+                // edge values at the centers of the four corner pixels
+                const int64_t sx0 = (int64_t(bx) << SubPixelBits) + half, sx1 = sx0 + (7 << SubPixelBits);
+                const int64_t sy0 = (int64_t(by) << SubPixelBits) + half, sy1 = sy0 + (7 << SubPixelBits);
+
+                bool rejected = false, accepted = true;
+                int32_t edge_start[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    int64_t e00 = edges[k].evaluate(sx0, sy0), e10 = edges[k].evaluate(sx1, sy0);
+                    int64_t e01 = edges[k].evaluate(sx0, sy1), e11 = edges[k].evaluate(sx1, sy1);
+
+                    if (max({e00, e10, e01, e11}) < 0)
+                        rejected = true;
+                    if (min({e00, e10, e01, e11}) < 0)
+                        accepted = false;
+
+                    edge_start[k] = int32_t(std::clamp(e00, -EdgeClamp, EdgeClamp));
+                }
+
+                if (rejected)
+                    continue;
+
+                counters.block_tests++;
+                if (triangle.zmin >= 0 && zbuffer.occluded(triangle.zmin, bx, bx + 7, by, by + 7))
+                {
+                    counters.blocks_rejected++;
+                    continue;
+                }
+
+                bool written = false;
+                for (int qy = 0; qy < 8; qy += 2)
+                {
+                    const int py = by + qy;
+                    if (py > ymax)
+                        break;
+                    if (py + 1 < ymin)
+                        continue;
+
+                    for (int qx = 0; qx < 8; qx += 2)
+                    {
+                        const int px = bx + qx;
+                        if (px > xmax)
+                            break;
+                        if (px + 1 < xmin)
+                            continue;
+
+                        // lanes inside the box
+                        int mask = 15;
+                        if (px < xmin)
+                            mask &= ~5;
+                        if (px + 1 > xmax)
+                            mask &= ~10;
+                        if (py < ymin)
+                            mask &= ~3;
+                        if (py + 1 > ymax)
+                            mask &= ~12;
+
+                        const float fx = px + 0.5f, fy = py + 0.5f;
+                        float *depth_row0 = depth_buffer + py * depth_stride + px;
+                        float *depth_row1 = depth_row0 + depth_stride;
+                        float z[4];
+                        int32_t column[4], row[4];
+
+#ifdef SOFT_RASTERIZER_SSE
+                        __m128i live = _mm_loadu_si128(reinterpret_cast<const __m128i *>(LaneMasks[mask]));
+                        if (!accepted)
+                        {
+                            __m128i outside = _mm_setzero_si128();
+                            for (int k = 0; k < 3; k++)
+                            {
+                                int32_t e = edge_start[k] + qx * edges[k].a * SubPixelScale + qy * edges[k].b * SubPixelScale;
+                                outside = _mm_or_si128(outside, _mm_add_epi32(_mm_set1_epi32(e), edge_lanes[k]));
+                            }
+                            live = _mm_andnot_si128(_mm_srai_epi32(outside, 31), live);
+                        }
+                        counters.depth_tests += LaneCount[_mm_movemask_ps(_mm_castsi128_ps(live))];
+
+                        __m128 zq = _mm_add_ps(_mm_set1_ps(depth.interpolate(fx, fy)), depth_lanes);
+                        __m128 stored = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(depth_row0));
+                        stored = _mm_loadh_pi(stored, reinterpret_cast<const __m64 *>(depth_row1));
+                        __m128 pass = _mm_and_ps(_mm_castsi128_ps(live), _mm_cmplt_ps(zq, stored));
+
+                        mask = _mm_movemask_ps(pass);
+                        if (!mask)
+                            continue;
+                        counters.pixels_shaded += LaneCount[mask];
+
+                        __m128 merged = _mm_or_ps(_mm_and_ps(pass, zq), _mm_andnot_ps(pass, stored));
+                        _mm_storel_pi(reinterpret_cast<__m64 *>(depth_row0), merged);
+                        _mm_storeh_pi(reinterpret_cast<__m64 *>(depth_row1), merged);
+                        _mm_storeu_ps(z, zq);
+
+                        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+                        __m128 u = _mm_add_ps(_mm_set1_ps(texcoord_s.interpolate(fx, fy)), s_lanes);
+                        __m128 v = _mm_add_ps(_mm_set1_ps(texcoord_t.interpolate(fx, fy)), t_lanes);
+                        u = _mm_min_ps(_mm_max_ps(u, zero), one);
+                        v = _mm_min_ps(_mm_max_ps(v, zero), one);
+                        const __m128 rounding = _mm_set1_ps(0.5f);
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(column), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(float(width - 1)), u), rounding)));
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(row), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(float(height - 1)), v), rounding)));
+#else
+                        const float z_base = depth.interpolate(fx, fy);
+                        const float s_base = texcoord_s.interpolate(fx, fy);
+                        const float t_base = texcoord_t.interpolate(fx, fy);
+                        for (int lane = 0; lane < 4; lane++)
+                        {
+                            if (!accepted)
+                            {
+                                for (int k = 0; k < 3; k++)
+                                {
+                                    int32_t e = edge_start[k] + qx * edges[k].a * SubPixelScale + qy * edges[k].b * SubPixelScale;
+                                    if (e + edge_offsets[k][lane] < 0)
+                                        mask &= ~(1 << lane);
+                                }
+                            }
+
+                            if (!(mask & (1 << lane)))
+                                continue;
+                            counters.depth_tests++;
+
+                            float &stored = lane < 2 ? depth_row0[lane] : depth_row1[lane - 2];
+                            z[lane] = z_base + depth_offsets[lane];
+                            if (!(z[lane] < stored))
+                            {
+                                mask &= ~(1 << lane);
+                                continue;
+                            }
+                            stored = z[lane];
+
+                            column[lane] = int((width - 1) * std::clamp(s_base + s_offsets[lane], 0.f, 1.f) + 0.5f);
+                            row[lane] = int((height - 1) * std::clamp(t_base + t_offsets[lane], 0.f, 1.f) + 0.5f);
+                        }
+                        if (!mask)
+                            continue;
+                        counters.pixels_shaded += LaneCount[mask];
+#endif
+
+                        for (int lane = 0; lane < 4; lane++)
+                        {
+                            if (!(mask & (1 << lane)))
+                                continue;
+
+                            unsigned char *pixel = pixels + 3 * (frame_width * (py + (lane >> 1)) + px + (lane & 1));
+#ifdef DEPTH
+                            pixel[0] = z[lane] * 255;
+                            pixel[1] = z[lane] * 255;
+                            pixel[2] = z[lane] * 255;
+#else
+                            const unsigned char *texel = texture + 3 * (width * row[lane] + column[lane]);
+                            pixel[0] = texel[0];
+                            pixel[1] = texel[1];
+                            pixel[2] = texel[2];
+#endif
+                        }
+                        written = true;
+                    }
+                }
+
+                if (written)
+                    zbuffer.mark(bx, by);
             }
         }
+    }
+
+    bool SoftRasterizer::ztest(float z, float xmin, float xmax, float ymin, float ymax)
+    {
+        // boxes reaching off screen or in front of the near plane are kept
+        if (xmin < 0 || xmax >= frame_width || ymin < 0 || ymax >= frame_height || z < 0)
+        {
+            return true;
+        }
 
-        return true;
+        return !zbuffer.occluded(z, int(xmin), int(xmax), int(ymin), int(ymax));
     }
-}
\ No newline at end of file
+}
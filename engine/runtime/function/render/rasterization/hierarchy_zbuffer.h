@@ -4,133 +4,182 @@
 #include "runtime/function/render/rasterization/transform/transform.h"
 #include "runtime/function/render/rasterization/acc_struct/octree.h"
 
-#define window_size 512
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SOFT_RASTERIZER_SSE
+#endif
 
 namespace MiniEngine
 {
     class SoftRasterizer
     {
     public:
-        struct Mipmap
+        // Hierarchical z-buffer as one flat array per mip level. Level 0 is the z-buffer itself,
+        // every coarser texel keeps the nearest and the farthest depth of the 2x2 below it. Depth
+        // writes only go to level 0 and mark their 8x8 tile dirty, the coarse levels catch up in
+        // flush(), tile by tile and then level by level. Nothing is allocated after initialize().
+        // The levels up to 64x64 pixel regions only depend on the pixels of their region, so
+        // different regions can be written and flushed by different threads.
+        struct HiZBuffer
         {
-            float depth;
+            static const int TileLevel = 3;   // 8x8 pixels
+            static const int RegionLevel = 6; // 64x64 pixels
 
-            Mipmap *parent;
-            Mipmap *childs[4];
+            int size = 0; // of level 0, a power of two
+            int levels = 0;
+            int regions = 0; // per row
 
-            Mipmap()
-            {
-                depth = window_size;
+            std::vector<int> offsets;     // first texel of every level
+            std::vector<float> far_depth; // all levels, level 0 is the z-buffer
+            std::vector<float> near_depth;
 
-                parent = nullptr;
-                childs[0] = nullptr;
-                childs[1] = nullptr;
-                childs[2] = nullptr;
-                childs[3] = nullptr;
-            }
+            std::vector<uint8_t> dirty;                 // per texel of all levels, set while queued
+            std::vector<int> queue[2];                  // dirty texels of the level being refreshed and of the next one
+            std::vector<std::vector<int>> dirty_tiles;  // per region
+            std::vector<uint8_t> region_changed;        // flushed, but not yet above the region level
 
-            Mipmap(Mipmap *c0, Mipmap *c1, Mipmap *c2, Mipmap *c3)
+            void initialize(int buffer_size);
+            void clear();
+            // brings the levels of one region up to date, safe to run for different regions at once
+            void flush_region(int region);
+            // brings every level up to date with every write since the last call
+            void flush();
+
+            int region(int x, int y) const
             {
-                depth = window_size;
-
-                c0->parent = this;
-                c1->parent = this;
-                c2->parent = this;
-                c3->parent = this;
-                childs[0] = c0;
-                childs[1] = c1;
-                childs[2] = c2;
-                childs[3] = c3;
+                return (y >> RegionLevel) * regions + (x >> RegionLevel);
             }
 
-            void update(float z)
+            int texel(int level, int x, int y) const
             {
-                depth = z;
-
-                if (parent == nullptr)
-                    return;
-                else
-                    parent->depth = max({parent->childs[0]->depth,
-                                        parent->childs[1]->depth,
-                                        parent->childs[2]->depth,
-                                        parent->childs[3]->depth});
-
-                if (parent->depth >= z)
-                    return;
-                else
-                    parent->update(z);
+                return offsets[level] + (y << (levels - 1 - level)) + x;
             }
 
-            void refresh()
+            // after writing level 0 somewhere in the tile of (x, y)
+            void mark(int x, int y)
             {
-                depth = window_size;
-
-                if (childs[0] != nullptr)
+                int tile = texel(TileLevel, x >> TileLevel, y >> TileLevel);
+                if (!dirty[tile])
                 {
-                    childs[0]->refresh();
-                    childs[1]->refresh();
-                    childs[2]->refresh();
-                    childs[3]->refresh();
+                    dirty[tile] = 1;
+                    dirty_tiles[region(x, y)].push_back(tile);
                 }
             }
+
+            // Conservative tests of a screen space box against the level where it covers at most
+            // 2x2 texels, so they cost the same for any box. Call flush() first, or flush_region()
+            // for a box inside one region, which only reads that region.
+            bool occluded(float zmin, int xmin, int xmax, int ymin, int ymax) const;
+            bool unoccluded(float zmax, int xmin, int xmax, int ymin, int ymax) const;
+
+        private:
+            int query_level(int xmin, int xmax, int ymin, int ymax) const;
+            // the n x n texels of a level from (x, y) on, from the level below
+            void refresh(int level, int x, int y, int n);
         };
 
+        // Screen positions are snapped to 1/16 pixel. Vertices outside the guard band are
+        // culled, which keeps the edge functions inside a block in 32 bits.
+        static const int SubPixelBits = 4;
+        static const int SubPixelScale = 1 << SubPixelBits;
+        static const int GuardBand = 1 << 16; // pixels
+
+        // E(x, y) = a * x + b * y + c over fixed point positions, positive inside a front
+        // facing triangle. Samples exactly on an edge belong to it when a > 0, or b > 0 for a
+        // horizontal edge. The two triangles sharing an edge see it in opposite directions, so
+        // exactly one of them gets those samples. The bias is folded into c, inside is E >= 0.
         struct EdgeEquation
         {
-            float a;
-            float b;
-            float c;
-            bool tie;
-
-            EdgeEquation(const Vertex &v0, const Vertex &v1)
-            {   
-                a = v0.Position.y - v1.Position.y;
-                b = v1.Position.x - v0.Position.x;
-                c = -(a * (v0.Position.x + v1.Position.x) + b * (v0.Position.y + v1.Position.y)) / 2;
-                tie = a != 0 ? a > 0 : b > 0;
+            int32_t a;
+            int32_t b;
+            int64_t c;
+
+            EdgeEquation(const glm::ivec2 &v0, const glm::ivec2 &v1)
+            {
+                a = v0.y - v1.y;
+                b = v1.x - v0.x;
+                c = int64_t(v0.x) * v1.y - int64_t(v1.x) * v0.y;
+
+                bool tie = a != 0 ? a > 0 : b > 0;
+                if (!tie)
+                    c -= 1;
             }
 
-            // test if the given point is inside the edge
-            bool evaluate(int x, int y)
+            int64_t evaluate(int64_t x, int64_t y) const
             {
-                float t = a * x + b * y + c;
-                return (t > 0 || (t == 0 && tie));
+                return a * x + b * y + c;
             }
         };
 
+        // a vertex attribute as a plane over pixel coordinates
         struct ParameterEquation
         {
             float a;
             float b;
             float c;
 
-            ParameterEquation(
-                float p0,
-                float p1,
-                float p2,
-                const EdgeEquation &e0,
-                const EdgeEquation &e1,
-                const EdgeEquation &e2,
-                float area)
+            ParameterEquation(float p0, float p1, float p2, const glm::vec2 *positions)
             {
-                float factor = 1.0f / (2.0f * area);
+                glm::vec2 d1 = positions[1] - positions[0];
+                glm::vec2 d2 = positions[2] - positions[0];
+                float factor = 1.0f / (d1.x * d2.y - d2.x * d1.y);
 
-                a = factor * (p0 * e0.a + p1 * e1.a + p2 * e2.a);
-                b = factor * (p0 * e0.b + p1 * e1.b + p2 * e2.b);
-                c = factor * (p0 * e0.c + p1 * e1.c + p2 * e2.c);
+                a = factor * ((p1 - p0) * d2.y - (p2 - p0) * d1.y);
+                b = factor * ((p2 - p0) * d1.x - (p1 - p0) * d2.x);
+                c = p0 - a * positions[0].x - b * positions[0].y;
             }
 
-            // compute the parameter equation for the given point
-            float interpolate(float x, float y)
+            float interpolate(float x, float y) const
             {
                 return a * x + b * y + c;
             }
         };
 
-        Mipmap *build_mipmap(int size);
+        // a triangle of the current batch after setup, in screen space
+        struct BinnedTriangle
+        {
+            int v[3]; // into screen_vertices
+            glm::ivec2 position[3]; // fixed point
+            int xmin;
+            int xmax;
+            int ymin;
+            int ymax;
+            float zmin;
+        };
+
+        // Screen tiles are the Hi-Z regions, so every tile owns its depth and color pixels and
+        // its part of the Hi-Z. The leaves of a batch are set up and binned in a fixed number of
+        // chunks, tiles then walk their bins chunk by chunk. That keeps the drawing order, and
+        // with it the image, independent of the thread count.
+        static const int TileSize = 1 << HiZBuffer::RegionLevel;
+        static const int BinChunks = 32;
+
+        // what the last frame did, summed over the threads
+        struct Statistics
+        {
+            long long nodes_tested = 0; // octree nodes tested against the Hi-Z in pass two
+            long long nodes_rejected = 0;
+            long long triangles = 0;        // of the drawn leaves
+            long long triangles_culled = 0; // back facing, degenerate, off screen or outside the guard band
+            long long tile_tests = 0;       // triangle and tile pairs tested against the Hi-Z
+            long long tiles_rejected = 0;
+            long long block_tests = 0; // 8x8 blocks touched by a triangle
+            long long blocks_rejected = 0;
+            long long depth_tests = 0; // covered pixels
+            long long pixels_shaded = 0;
+            float frame_time = 0.f; // seconds
 
+            Statistics &operator+=(const Statistics &other);
+        };
+
+        Statistics statistics;
+
+        // draws the whole tree into a frame of the initialized size, pixels are rgb and so is
+        // the width x height texture, looked up with texture coordinates clamped to [0, 1]
         void hierarchy_zbuffer_rasterize(
-            OctTree::OctNode *model_root,
+            OctTree &tree,
             glm::mat4 &model,
             glm::mat4 &view,
             glm::mat4 &projection,
@@ -139,37 +188,75 @@ namespace MiniEngine
             int width,
             int height);
 
-        void pass_one_rasterization(
-        OctTree::OctNode *model_root,
-        glm::mat4 &model,
-        glm::mat4 &view,
-        glm::mat4 &projection,
-        unsigned char *pixels,
-        unsigned char *texture,
-        int width,
-        int height);
+        // queues the leaves visible in the last frame
+        void pass_one_rasterization(int node);
 
+        // tests every node against the depth of the first batch, queues newly visible leaves
+        // children nearest to the eye first, so that they occlude the others sooner
         void pass_two_rasterization(
-        OctTree::OctNode *model_root,
+        int node,
+        const glm::vec3 &eye,
         glm::mat4 &model,
         glm::mat4 &view,
-        glm::mat4 &projection,
-        unsigned char *pixels,
-        unsigned char *texture,
-        int width,
-        int height);
+        glm::mat4 &projection);
 
-        void hierarchy_zbuffer_initialize(int size);
+        // draws the queued leaves and brings the Hi-Z up to date
+        void render_batch(
+            glm::mat4 &model,
+            glm::mat4 &view,
+            glm::mat4 &projection,
+            unsigned char *pixels,
+            unsigned char *texture,
+            int width,
+            int height);
+
+        void bin_triangles(int chunk, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection);
+
+        void tile_render(int tile, unsigned char *pixels, unsigned char *texture, int width, int height);
+
+        // Walks the 8x8 blocks of the box, which are the dirty tiles of the Hi-Z. Blocks are
+        // rejected or accepted whole from their corners, the others test coverage a 2x2 quad
+        // at a time. Attributes are planes evaluated per quad, so its lanes also give the
+        // screen space derivatives.
+        void triangle_render(const BinnedTriangle &triangle,
+                             int xmin,
+                             int xmax,
+                             int ymin,
+                             int ymax,
+                             unsigned char *pixels,
+                             unsigned char *texture,
+                             int width,
+                             int height,
+                             Statistics &counters);
 
-        void triangle_render(Mesh *triangles,
-                            unsigned char *pixels,
-                            unsigned char *texture,
-                            int width,
-                            int height);
+        // the Hi-Z covers the larger side of the frame
+        void hierarchy_zbuffer_initialize(int width, int height);
 
-        bool ztest(float z, int x, int y);
         bool ztest(float z, float xmin, float xmax, float ymin, float ymax);
+
+        // of the last frame, 1 where nothing was drawn
+        float depth(int x, int y) const
+        {
+            return zbuffer.far_depth[zbuffer.texel(0, x, y)];
+        }
     
-        Mipmap *zbuffer;
+        HiZBuffer zbuffer;
+        int frame_width = 0;
+        int frame_height = 0;
+
+        OctTree *octree = nullptr; // of the frame being drawn
+
+        // the batch being drawn, kept from frame to frame for their storage
+        std::vector<int> batch; // leaf nodes
+        std::vector<int> first_batch; // drawn before pass two, still flagged checked
+        std::vector<int> vertex_offsets;             // per leaf of the batch, and the total
+        std::vector<int> triangle_offsets;
+        std::vector<Vertex> screen_vertices;
+        std::vector<BinnedTriangle> triangles;
+        std::vector<std::vector<int>> bins; // [chunk * tile count + tile], triangle ids
+        std::vector<Statistics> chunk_statistics; // of the batch, summed once it is drawn
+        std::vector<Statistics> tile_statistics;
+        int tiles_x = 0;
+        int tiles_y = 0;
     };
 }
@@ -3,34 +3,48 @@
 #include <glm/glm.hpp>
 #include <iostream>
 
-#define window_size 512
-
 namespace MiniEngine
 {
-    void screen_space_transform(Mesh *mesh, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection)
+    static glm::vec3 viewport_transform(const glm::vec4 &clip, int width, int height)
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip[3];
+        return glm::vec3((ndc[0] + 1) * 0.5f * width, (ndc[1] + 1) * 0.5f * height, (ndc[2] + 1) * 0.5f);
+    }
+
+    void screen_space_transform(Mesh *mesh, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, int width, int height)
     {
+        glm::mat4 mvp = projection * view * model;
+
         for (int v = 0; v < mesh->vertices.size(); v++)
         {
-            glm::vec4 ndc = projection * view * model * glm::vec4(mesh->vertices[v].Position, 1.0f);
-            glm::vec3 ssc = glm::vec3(ndc) / ndc[3];
-            ssc[0] = (ssc[0]+1)*0.5*window_size;
-            ssc[1] = (ssc[1]+1)*0.5*window_size;
-            ssc[2] = (ssc[2]+1)*0.5*window_size;
-            mesh->vertices[v].Position = ssc;
+            mesh->vertices[v].Position = viewport_transform(mvp * glm::vec4(mesh->vertices[v].Position, 1.0f), width, height);
         }
+    }
 
+    void screen_space_transform(const Vertex *vertices, int count, Vertex *out, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, int width, int height)
+    {
+        glm::mat4 mvp = projection * view * model;
+
+        for (int v = 0; v < count; v++)
+        {
+            out[v] = vertices[v];
+            out[v].Position = viewport_transform(mvp * glm::vec4(vertices[v].Position, 1.0f), width, height);
+        }
     }
 
-    void screen_space_transform(OctTree::Bound *bound, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection)
+    void screen_space_transform(const OctTree::Bound &bound, glm::vec3 &screen_min, glm::vec3 &screen_max, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, int width, int height)
     {
-        for (int i=0;i<8;i++)
+        glm::mat4 mvp = projection * view * model;
+
+        for (int i = 0; i < 8; i++)
         {
-            glm::vec4 ndc = projection * view * model * glm::vec4(bound->corner[i], 1.0f);
-            glm::vec3 ssc = glm::vec3(ndc) / ndc[3];
-            ssc[0] = (ssc[0]+1)*0.5*window_size;
-            ssc[1] = (ssc[1]+1)*0.5*window_size;
-            ssc[2] = (ssc[2]+1)*0.5*window_size;
-            bound->corner[i] = ssc;
+            glm::vec3 corner((i & 1) ? bound.max.x : bound.min.x,
+                             (i & 2) ? bound.max.y : bound.min.y,
+                             (i & 4) ? bound.max.z : bound.min.z);
+            glm::vec3 ssc = viewport_transform(mvp * glm::vec4(corner, 1.0f), width, height);
+
+            screen_min = i == 0 ? ssc : glm::min(screen_min, ssc);
+            screen_max = i == 0 ? ssc : glm::max(screen_max, ssc);
         }
     }
-}
\ No newline at end of file
+}
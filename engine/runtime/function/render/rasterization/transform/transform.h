@@ -7,8 +7,14 @@
 
 namespace MiniEngine
 {
-    void screen_space_transform(Mesh *mesh, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection);
+    // to pixel coordinates of a width x height viewport, depth from 0 at the near to 1 at the far plane
 
-    void screen_space_transform(OctTree::Bound *bound, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection);
+    void screen_space_transform(Mesh *mesh, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, int width, int height);
 
-}
\ No newline at end of file
+    // into out, which has room for all of them
+    void screen_space_transform(const Vertex *vertices, int count, Vertex *out, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, int width, int height);
+
+    // screen space box around the eight corners
+    void screen_space_transform(const OctTree::Bound &bound, glm::vec3 &screen_min, glm::vec3 &screen_max, glm::mat4 &model, glm::mat4 &view, glm::mat4 &projection, int width, int height);
+
+}
@@ -36,6 +36,8 @@ namespace MiniEngine
         glm::vec3 Tr; // transmittance of material.
         float Ns;     // shiness, the exponent of phong lobe.
         float Ni;     // Index of Refraction(IOR) of transparent object like glass and water.
+        float Pr;     // roughness of the PBR extension, 0 when the file has none.
+        float Pm;     // metallic of the PBR extension, 0 when the file has none.
 
         std::string map_Kd;
         std::string map_Ks;
@@ -55,15 +57,16 @@ namespace MiniEngine
 
         Mesh()=default;
 
-        // constructor
-        Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, Material material)
+        // constructor, upload_to_gpu = false keeps the mesh on the cpu (no GL context needed)
+        Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, Material material, bool upload_to_gpu = true)
         {
             this->vertices = vertices;
             this->indices = indices;
             this->material = material;
 
             // now that we have all the required data, set the vertex buffers and its attribute pointers.
-            setupMesh();
+            if (upload_to_gpu)
+                setupMesh();
         }
 
         // render the mesh
@@ -36,7 +36,8 @@ namespace MiniEngine
         string model_path;
 
         // constructor, expects a filepath to a 3D model.
-        Model(string const &path)
+        // upload_to_gpu = false only loads the cpu side data, for headless tools.
+        Model(string const &path, bool upload_to_gpu = true) : upload_to_gpu(upload_to_gpu)
         {
             loadModel(path);
         }
@@ -49,6 +50,8 @@ namespace MiniEngine
         }
 
     private:
+        bool upload_to_gpu;
+
         // loads a model with supported tiny_obj_loader extensions from file and stores the resulting meshes in the meshes vector.
         void loadModel(string const &path)
         {
@@ -117,6 +120,8 @@ namespace MiniEngine
                 mat.Ke = {material.emission[0], material.emission[1], material.emission[2]};
                 mat.Ns = material.shininess;
                 mat.Ni = material.ior;
+                mat.Pr = material.roughness;
+                mat.Pm = material.metallic;
         
                 if (!material.diffuse_texname.empty()) {
                     mat.map_Kd = material.diffuse_texname.c_str();
@@ -273,7 +278,7 @@ namespace MiniEngine
 
             for (size_t i = 0; i < materials.size(); i++)
             {
-                meshes.push_back(Mesh(vertices[i], indices[i], mats[i]));
+                meshes.push_back(Mesh(vertices[i], indices[i], mats[i], upload_to_gpu));
             }
 
         }
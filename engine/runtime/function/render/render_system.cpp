@@ -722,6 +722,10 @@ namespace MiniEngine
 
     void RenderSystem::tick(float delta_time)
     {
+        // a progressive render follows the camera moved by this frame's input
+        if (m_render_camera)
+            m_path_tracer->publishView(*m_render_camera);
+
         // refresh render target frame buffer
         refreshFrameBuffer();
         
@@ -859,7 +863,9 @@ namespace MiniEngine
     void RenderSystem::startRendering()
     {
         m_path_tracer->should_stop_tracing = false;
-        m_tracing_process = std::thread(&PathTracing::PathTracer::startTracing,m_path_tracer,m_render_model,m_render_camera);
+        m_path_tracer->publishView(*m_render_camera);
+        m_path_tracer->publishSettings();
+        m_tracing_process = std::thread(&PathTracing::PathTracer::startTracing,m_path_tracer,m_render_model);
         m_tracing_process.detach();
     };
 
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+
+// Shared by the command line tools: the demo scene lookup and reading option values.
+// MINIENGINE_DEMO_DIR is defined for every tool in engine/tools/CMakeLists.txt.
+
+namespace MiniEngine::Tools
+{
+    // a demo name resolves to the first .obj of its folder under MINIENGINE_DEMO_DIR, anything
+    // else must be the path of a file
+    inline bool resolveScene(const std::string &scene, std::filesystem::path &obj_path)
+    {
+        namespace fs = std::filesystem;
+
+        if (fs::is_regular_file(scene))
+        {
+            obj_path = scene;
+            return true;
+        }
+
+        fs::path directory = fs::path(MINIENGINE_DEMO_DIR) / scene;
+        if (!fs::is_directory(directory))
+        {
+            std::cerr << "Scene " << scene << " is neither a file nor a folder of " << MINIENGINE_DEMO_DIR << std::endl;
+            return false;
+        }
+
+        obj_path.clear();
+        for (const auto &entry : fs::directory_iterator(directory))
+        {
+            if (entry.path().extension() == ".obj" && (obj_path.empty() || entry.path() < obj_path))
+                obj_path = entry.path();
+        }
+        if (obj_path.empty())
+        {
+            std::cerr << "No .obj file in " << directory.generic_string() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Walks the options of argv. read() takes the value of the current option and reports a
+    // missing one, readOptional() only takes the next argument when it is not an option itself.
+    class ArgumentReader
+    {
+    public:
+        ArgumentReader(int argc, char **argv) : argc(argc), argv(argv) {}
+
+        // false past the last argument
+        bool next(std::string &arg)
+        {
+            if (index + 1 >= argc)
+                return false;
+            option = argv[++index];
+            arg = option;
+            return true;
+        }
+
+        bool read(std::string &value)
+        {
+            const char *text = nextValue();
+            if (text)
+                value = text;
+            return text != nullptr;
+        }
+
+        bool read(int &value)
+        {
+            const char *text = nextValue();
+            if (text)
+                value = std::atoi(text);
+            return text != nullptr;
+        }
+
+        bool read(float &value)
+        {
+            const char *text = nextValue();
+            if (text)
+                value = static_cast<float>(std::atof(text));
+            return text != nullptr;
+        }
+
+        bool read(double &value)
+        {
+            const char *text = nextValue();
+            if (text)
+                value = std::atof(text);
+            return text != nullptr;
+        }
+
+        template <typename T>
+        bool read(std::optional<T> &value)
+        {
+            T read_value;
+            if (!read(read_value))
+                return false;
+            value = read_value;
+            return true;
+        }
+
+        template <typename T>
+        void readOptional(T &value)
+        {
+            if (index + 1 < argc && argv[index + 1][0] != '-')
+                read(value);
+        }
+
+        // reports the current option as unknown, returns false so parsers can return it
+        bool unknown() const
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+
+    private:
+        const char *nextValue()
+        {
+            if (index + 1 >= argc)
+            {
+                std::cerr << option << " expects a value" << std::endl;
+                return nullptr;
+            }
+            return argv[++index];
+        }
+
+        int argc;
+        char **argv;
+        int index = 0;
+        std::string option;
+    };
+}
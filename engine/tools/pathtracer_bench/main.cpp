@@ -0,0 +1,528 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "runtime/function/render/pathtracing/common/hittable.h"
+#include "runtime/function/render/pathtracing/common/material.h"
+#include "runtime/function/render/pathtracing/common/light_sampler.h"
+#include "runtime/function/render/pathtracing/common/sampler.h"
+#include "runtime/function/render/pathtracing/primitive/triangle.h"
+#include "runtime/function/render/pathtracing/primitive/triangle_mesh.h"
+#include "runtime/function/render/pathtracing/acc_struct/linear_bvh.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh4.h"
+#include "runtime/function/render/render_model.h"
+#include "tools/common/tool_common.h"
+
+#include <json11.hpp>
+
+// Microbenchmarks of the path tracer kernels on the demo meshes: box and triangle tests, BVH
+// traversal for coherent and incoherent rays, BVH builds, BSDF and light sampling. Everything
+// runs single threaded on the CPU, no GL context is created.
+
+using namespace MiniEngine::PathTracing;
+using MiniEngine::Model;
+using MiniEngine::Vertex;
+using MiniEngine::Tools::resolveScene;
+
+namespace
+{
+    const char *const Usage =
+        "usage: pathtracer_bench [options]\n"
+        "\n"
+        "  --scene <name|path>   demo scene folder under engine/editor/demo or an .obj file, can repeat,\n"
+        "                        mary, veach-mis and staircase by default\n"
+        "  --filter <text>       only kernels whose name contains text\n"
+        "  --min-time <s>        time every kernel runs for, 0.25 by default\n"
+        "  --json <file>         also write the results as JSON\n";
+
+    struct Options
+    {
+        std::vector<std::string> scenes;
+        std::string filter;
+        double min_time = 0.25;
+        std::string json_output;
+    };
+
+    struct Result
+    {
+        std::string kernel;
+        std::string scene;
+        double ns_per_op;
+        double mops_per_second; // million rays, tests, samples or triangles per second
+        std::string unit;
+    };
+
+    // written by every kernel so that the compiler cannot drop the work
+    volatile float sink = 0.f;
+
+    const int RayCount = 1 << 16;
+
+    class Bench
+    {
+    public:
+        std::vector<Result> results;
+
+        explicit Bench(const Options &options) : options(options) {}
+
+        // runs kernel (ops operations per call) until min_time has passed
+        template <typename Kernel>
+        void run(const std::string &kernel, const std::string &scene, size_t ops, const std::string &unit, Kernel &&body)
+        {
+            if (!options.filter.empty() && kernel.find(options.filter) == std::string::npos)
+                return;
+
+            body(); // warm up caches and the lazily built tables
+
+            using Clock = std::chrono::steady_clock;
+            size_t calls = 0;
+            Clock::time_point start = Clock::now();
+            double elapsed = 0;
+            do
+            {
+                body();
+                calls++;
+                elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            } while (elapsed < options.min_time);
+
+            report(kernel, scene, elapsed * 1e9 / (double(calls) * ops), unit);
+        }
+
+        void report(const std::string &kernel, const std::string &scene, double ns_per_op, const std::string &unit)
+        {
+            Result result{kernel, scene, ns_per_op, 1e3 / ns_per_op, unit};
+            std::cout << std::left << std::setw(36) << kernel << std::setw(14) << scene << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(12) << ns_per_op << " ns/op" << std::setw(12)
+                      << result.mops_per_second << " " << unit << std::endl;
+            results.push_back(result);
+        }
+
+        bool enabled(const std::string &kernel) const
+        {
+            return options.filter.empty() || kernel.find(options.filter) != std::string::npos;
+        }
+
+    private:
+        const Options &options;
+    };
+
+    // the triangle soup of a model with one gray material, plus its emitters
+    void buildSoup(const Model &model, TriangleMesh &mesh, LightSampler &lights)
+    {
+        size_t triangle_count = 0;
+        for (const auto &m : model.meshes)
+        {
+            triangle_count += m.indices.size() / 3;
+        }
+        mesh.reserve(triangle_count);
+        int material_id = mesh.addMaterial(make_shared<Lambertian>(vec3(0.5f)));
+
+        for (const auto &m : model.meshes)
+        {
+            for (size_t id = 0; id + 2 < m.indices.size(); id += 3)
+            {
+                const Vertex &v0 = m.vertices[m.indices[id]];
+                const Vertex &v1 = m.vertices[m.indices[id + 1]];
+                const Vertex &v2 = m.vertices[m.indices[id + 2]];
+                mesh.addTriangle(v0, v1, v2, material_id);
+                if (isEmissive(m.material))
+                    lights.addTriangle(v0.Position, v1.Position, v2.Position, m.material.Ke);
+            }
+        }
+    }
+
+    AABB boundsOf(const TriangleMesh &mesh)
+    {
+        AABB box(vec3(INF), vec3(-INF));
+        for (size_t i = 0; i < mesh.size(); i++)
+        {
+            vec3 v0 = mesh.getVertex0(i);
+            box.min = glm::min(box.min, glm::min(v0, glm::min(v0 + mesh.getEdge1(i), v0 + mesh.getEdge2(i))));
+            box.max = glm::max(box.max, glm::max(v0, glm::max(v0 + mesh.getEdge1(i), v0 + mesh.getEdge2(i))));
+        }
+        return box;
+    }
+
+    vec3 randomPointOn(const TriangleMesh &mesh)
+    {
+        int id = std::min(static_cast<int>(randomFloat() * mesh.size()), static_cast<int>(mesh.size()) - 1);
+        vec2 u = random2D();
+        if (u.x + u.y > 1)
+            u = vec2(1.f) - u;
+        return mesh.getVertex0(id) + u.x * mesh.getEdge1(id) + u.y * mesh.getEdge2(id);
+    }
+
+    // camera rays through a 256 x 256 grid, from outside the bounds towards their center
+    std::vector<Ray> coherentRays(const AABB &box)
+    {
+        vec3 center = 0.5f * (box.min + box.max);
+        float radius = 0.5f * length(box.max - box.min);
+        vec3 eye = center + vec3(0.f, 0.f, 2.5f * radius);
+
+        std::vector<Ray> rays;
+        rays.reserve(RayCount);
+        for (int j = 0; j < 256; j++)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                vec3 target = center + radius * vec3((i + 0.5f) / 128.f - 1.f, (j + 0.5f) / 128.f - 1.f, 0.f);
+                rays.emplace_back(eye, target - eye);
+            }
+        }
+        return rays;
+    }
+
+    // origins on the surfaces, uniform directions, like diffuse bounces
+    std::vector<Ray> incoherentRays(const TriangleMesh &mesh)
+    {
+        std::vector<Ray> rays;
+        rays.reserve(RayCount);
+        for (int i = 0; i < RayCount; i++)
+        {
+            rays.emplace_back(randomPointOn(mesh), randomUnitVector());
+        }
+        return rays;
+    }
+
+    // segments between two surface points, like shadow rays
+    void shadowRays(const TriangleMesh &mesh, std::vector<Ray> &rays, std::vector<float> &distances)
+    {
+        rays.reserve(RayCount);
+        distances.reserve(RayCount);
+        for (int i = 0; i < RayCount; i++)
+        {
+            vec3 from = randomPointOn(mesh), to = randomPointOn(mesh);
+            float distance = length(to - from);
+            if (distance < 10 * EPS)
+                continue;
+            rays.emplace_back(from, to - from);
+            distances.push_back(distance);
+        }
+    }
+
+    void benchPrimitives(Bench &bench, const std::string &scene, const TriangleMesh &mesh, const std::vector<Ray> &rays)
+    {
+        // boxes and triangles of the scene, one test per ray against a rotating primitive. The
+        // count is a power of two so that picking one costs a mask, not a division.
+        const int primitive_count = 1024;
+        const int primitive_mask = primitive_count - 1;
+        std::vector<AABB> boxes(primitive_count);
+        std::vector<Triangle> triangles(primitive_count);
+        std::vector<LinearBVHNode> nodes(primitive_count);
+        std::vector<int> ids(primitive_count);
+        for (int i = 0; i < primitive_count; i++)
+        {
+            int id = ids[i] = static_cast<int>(i % mesh.size());
+            Vertex a, b, c;
+            a.Position = mesh.getVertex0(id);
+            b.Position = a.Position + mesh.getEdge1(id);
+            c.Position = a.Position + mesh.getEdge2(id);
+            a.Normal = b.Normal = c.Normal = normalize(cross(b.Position - a.Position, c.Position - a.Position));
+            a.Texcoord = b.Texcoord = c.Texcoord = vec2(0.f);
+
+            triangles[i] = Triangle(vector<Vertex>{a, b, c}, nullptr);
+            triangles[i].aabb(boxes[i]);
+            nodes[i].box_min = boxes[i].min;
+            nodes[i].box_max = boxes[i].max;
+        }
+
+        bench.run("AABB::hit", scene, rays.size(), "Mtests/s", [&]() {
+            int hits = 0;
+            for (size_t i = 0; i < rays.size(); i++)
+                hits += boxes[i & primitive_mask].hit(rays[i], EPS, INF);
+            sink = sink + hits;
+        });
+
+        bench.run("LinearBVHNode::hit", scene, rays.size(), "Mtests/s", [&]() {
+            int hits = 0;
+            for (size_t i = 0; i < rays.size(); i++)
+            {
+                vec3 inv_direction = 1.f / rays[i].direction;
+                hits += nodes[i & primitive_mask].hit(rays[i].origin, inv_direction, EPS, INF);
+            }
+            sink = sink + hits;
+        });
+
+        bench.run("Triangle::hit", scene, rays.size(), "Mtests/s", [&]() {
+            int hits = 0;
+            HitRecord rec;
+            for (size_t i = 0; i < rays.size(); i++)
+                hits += triangles[i & primitive_mask].hit(rays[i], EPS, INF, rec);
+            sink = sink + hits;
+        });
+
+        bench.run("TriangleMesh::intersect", scene, rays.size(), "Mtests/s", [&]() {
+            int hits = 0;
+            float t, u, v;
+            for (size_t i = 0; i < rays.size(); i++)
+                hits += mesh.intersect(ids[i & primitive_mask], rays[i], EPS, INF, t, u, v);
+            sink = sink + hits;
+        });
+    }
+
+    void benchTraversal(Bench &bench, const std::string &scene, const std::string &name, const Hittable &bvh,
+                        const std::vector<Ray> &coherent, const std::vector<Ray> &incoherent,
+                        const std::vector<Ray> &shadow, const std::vector<float> &distances)
+    {
+        auto closest = [&](const std::vector<Ray> &rays) {
+            return [&]() {
+                int hits = 0;
+                HitRecord rec;
+                for (const Ray &r : rays)
+                    hits += bvh.hit(r, EPS, INF, rec);
+                sink = sink + hits;
+            };
+        };
+
+        bench.run(name + " closest coherent", scene, coherent.size(), "Mrays/s", closest(coherent));
+        bench.run(name + " closest incoherent", scene, incoherent.size(), "Mrays/s", closest(incoherent));
+
+        // shadow segments, bounded by the distance between their end points. "shadow closest"
+        // answers the same query with a closest hit to show what the any hit path saves.
+        bench.run(name + " shadow", scene, shadow.size(), "Mrays/s", [&]() {
+            int hits = 0;
+            for (size_t i = 0; i < shadow.size(); i++)
+                hits += bvh.occluded(shadow[i], EPS, distances[i] - EPS);
+            sink = sink + hits;
+        });
+        bench.run(name + " shadow closest", scene, shadow.size(), "Mrays/s", [&]() {
+            int hits = 0;
+            HitRecord rec;
+            for (size_t i = 0; i < shadow.size(); i++)
+                hits += bvh.hit(shadow[i], EPS, distances[i] - EPS, rec);
+            sink = sink + hits;
+        });
+    }
+
+    void benchBuilds(Bench &bench, const std::string &scene, const TriangleMesh &mesh, const Options &options)
+    {
+        // the copy of the soup each build consumes is not timed, BVHs time their own build
+        auto build = [&](const std::string &kernel, auto make) {
+            if (!bench.enabled(kernel))
+                return;
+
+            double total = 0;
+            int builds = 0;
+            do
+            {
+                total += make(TriangleMesh(mesh));
+                builds++;
+            } while (total < options.min_time);
+            bench.report(kernel, scene, total * 1e9 / (double(builds) * mesh.size()), "Mtris/s");
+        };
+
+        build("LinearBVH build", [](TriangleMesh m) { return LinearBVH(std::move(m)).build_time; });
+        if (BVH4::isSupported())
+            build("BVH4 build", [](TriangleMesh m) { return BVH4(std::move(m)).build_time; });
+    }
+
+    void benchLights(Bench &bench, const std::string &scene, LightSampler &lights, const TriangleMesh &mesh)
+    {
+        if (lights.size() == 0)
+            return;
+
+        std::vector<vec3> points(4096), normals(4096);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            points[i] = randomPointOn(mesh);
+            normals[i] = randomUnitVector();
+        }
+
+        for (bool use_light_bvh : {false, true})
+        {
+            lights.build(use_light_bvh);
+            bench.run(use_light_bvh ? "LightSampler::sample light BVH" : "LightSampler::sample power", scene, points.size(), "Msamples/s", [&]() {
+                LightSample ls;
+                float total = 0;
+                for (size_t i = 0; i < points.size(); i++)
+                {
+                    if (lights.sample(points[i], normals[i], randomFloat(), random2D(), ls))
+                        total += ls.pdf;
+                }
+                sink = sink + total;
+            });
+        }
+    }
+
+    void benchMaterials(Bench &bench)
+    {
+        MiniEngine::Material phong{};
+        phong.Kd = vec3(0.4f, 0.3f, 0.2f);
+        phong.Ks = vec3(0.3f);
+        phong.Ns = 50.f;
+        phong.Ni = 1.f;
+
+        struct Case
+        {
+            std::string name;
+            shared_ptr<Material> material;
+        };
+        const Case cases[] = {
+            {"Lambertian", make_shared<Lambertian>(vec3(0.5f))},
+            {"Phong", make_shared<Phong>(phong, nullptr, TextureFilter::Bilinear)},
+            {"GGXConductor", make_shared<GGXConductor>(vec3(0.95f, 0.64f, 0.54f), 0.3f)},
+            {"GGXPlastic", make_shared<GGXPlastic>(vec3(0.5f), 0.3f)},
+            {"GGXDielectric", make_shared<GGXDielectric>(1.5f, 0.3f)},
+        };
+
+        // shading points facing +z, seen from random directions of the upper hemisphere
+        const int count = 4096;
+        std::vector<Ray> rays;
+        std::vector<vec3> directions;
+        HitRecord rec;
+        rec.hit_point.Position = vec3(0.f);
+        rec.hit_point.Normal = vec3(0.f, 0.f, 1.f);
+        rec.hit_point.Texcoord = vec2(0.f);
+        rec.front_face = true;
+        for (int i = 0; i < count; i++)
+        {
+            vec3 wo = cosineRand();
+            rays.emplace_back(wo, -wo);
+            directions.push_back(cosineRand());
+        }
+
+        for (const Case &c : cases)
+        {
+            const Material &material = *c.material;
+            bench.run(c.name + "::sample", "-", count, "Msamples/s", [&]() {
+                BSDFSample bs;
+                float total = 0;
+                for (const Ray &r : rays)
+                {
+                    if (material.sample(r, rec, bs))
+                        total += bs.weight.x;
+                }
+                sink = sink + total;
+            });
+
+            bench.run(c.name + "::eval+pdf", "-", count, "Mevals/s", [&]() {
+                float total = 0;
+                for (int i = 0; i < count; i++)
+                    total += material.eval(rays[i], rec, directions[i]).x + material.pdf(rays[i], rec, directions[i]);
+                sink = sink + total;
+            });
+        }
+
+        bench.run("CosinePDF::generate", "-", count, "Msamples/s", [&]() {
+            CosinePDF cosine_pdf(rec.hit_point.Normal);
+            vec3 total(0.f);
+            for (int i = 0; i < count; i++)
+                total += cosine_pdf.generate();
+            sink = sink + total.x;
+        });
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        MiniEngine::Tools::ArgumentReader args(argc, argv);
+        std::string arg;
+        while (args.next(arg))
+        {
+            bool read = true;
+            if (arg == "--help" || arg == "-h")
+                return false;
+            else if (arg == "--scene")
+            {
+                std::string scene;
+                read = args.read(scene);
+                if (read)
+                    options.scenes.push_back(scene);
+            }
+            else if (arg == "--filter")
+                read = args.read(options.filter);
+            else if (arg == "--min-time")
+                read = args.read(options.min_time);
+            else if (arg == "--json")
+                read = args.read(options.json_output);
+            else
+                return args.unknown();
+
+            if (!read)
+                return false;
+        }
+
+        if (options.scenes.empty())
+            options.scenes = {"mary", "veach-mis", "staircase"};
+        return options.min_time > 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cout << Usage;
+        return 1;
+    }
+
+    Bench bench(options);
+    Sampler::current().startPixelSample(ivec2(0, 0), 0, 1, SamplerType::Independent);
+
+    for (const std::string &scene : options.scenes)
+    {
+        std::filesystem::path obj_path;
+        if (!resolveScene(scene, obj_path))
+            return 1;
+
+        auto model = make_shared<Model>(obj_path.generic_string(), false);
+        TriangleMesh mesh;
+        LightSampler lights;
+        buildSoup(*model, mesh, lights);
+        if (mesh.size() == 0)
+        {
+            std::cerr << "No triangles in " << obj_path.generic_string() << std::endl;
+            return 1;
+        }
+        std::cout << scene << ": " << mesh.size() << " triangles, " << lights.size() << " light triangles" << std::endl;
+
+        std::vector<Ray> coherent = coherentRays(boundsOf(mesh));
+        std::vector<Ray> incoherent = incoherentRays(mesh);
+        std::vector<Ray> shadow;
+        std::vector<float> distances;
+        shadowRays(mesh, shadow, distances);
+
+        benchPrimitives(bench, scene, mesh, incoherent);
+        benchBuilds(bench, scene, mesh, options);
+
+        LinearBVH linear_bvh(mesh);
+        benchTraversal(bench, scene, "LinearBVH", linear_bvh, coherent, incoherent, shadow, distances);
+        if (BVH4::isSupported())
+        {
+            BVH4 bvh4(mesh);
+            benchTraversal(bench, scene, "BVH4", bvh4, coherent, incoherent, shadow, distances);
+        }
+
+        benchLights(bench, scene, lights, mesh);
+    }
+
+    benchMaterials(bench);
+
+    if (options.json_output.empty())
+        return 0;
+
+    json11::Json::array results;
+    for (const Result &result : bench.results)
+    {
+        results.push_back(json11::Json::object{
+            {"kernel", result.kernel},
+            {"scene", result.scene},
+            {"ns_per_op", result.ns_per_op},
+            {"mops_per_second", result.mops_per_second},
+            {"unit", result.unit},
+        });
+    }
+
+    std::ofstream file(options.json_output);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << options.json_output << " for writing" << std::endl;
+        return 1;
+    }
+    file << json11::Json(json11::Json::object{{"min_time", options.min_time}, {"results", results}}).dump() << std::endl;
+    std::cout << "Saved " << options.json_output << std::endl;
+    return 0;
+}
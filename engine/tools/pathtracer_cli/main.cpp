@@ -0,0 +1,667 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "runtime/function/render/pathtracing/path_tracer.h"
+#include "runtime/function/render/pathtracing/acc_struct/bvh_cache.h"
+#include "runtime/function/render/render_model.h"
+#include "runtime/function/render/render_camera.h"
+#include "thirdparty/tbb/include/tbb/global_control.h"
+#include "tools/common/tool_common.h"
+
+#include <json11.hpp>
+
+// Headless front end of the path tracer: loads an .obj scene without a GL context, renders it
+// with settings from the command line or a JSON file and writes the image. --benchmark runs a
+// fixed matrix of scenes and settings and writes the timings as JSON, for regression tracking.
+
+using MiniEngine::Model;
+using MiniEngine::PathTracing::PathTracer;
+using MiniEngine::PathTracing::RenderingInitInfo;
+
+namespace
+{
+    const char *const Usage =
+        "usage: pathtracer_cli --scene <demo name | file.obj> [options]\n"
+        "       pathtracer_cli --benchmark [results.json] [--threads N]\n"
+        "       pathtracer_cli --clear-bvh-cache\n"
+        "\n"
+        "  --scene <name|path>   demo scene folder under engine/editor/demo, or an .obj file\n"
+        "  --config <file.json>  settings, keys as in RenderingInitInfo plus an optional \"Camera\"\n"
+        "                        object with \"Eye\", \"LookAt\" and \"Fovy\"\n"
+        "  --output <file.png>   image path, nothing is written without it\n"
+        "  --hdr                 also write the linear image as .pfm\n"
+        "  --width <n> --height <n>\n"
+        "  --spp <n>             samples per pixel\n"
+        "  --bounces <n>\n"
+        "  --seed <n>\n"
+        "  --threads <n>         worker threads, all cores by default\n"
+        "  --adaptive [error]    adaptive sampling, optionally with the relative error threshold\n"
+        "  --sobol               Owen scrambled Sobol samples\n"
+        "  --no-simd             binary BVH instead of the 4 wide one\n"
+        "  --no-light-bvh        pick emitters by power alone\n"
+        "  --no-mipmap           bilinear texture lookups on the finest level only\n"
+        "  --no-bvh-cache        always build the BVH, never read or write the on-disk cache\n"
+        "  --clear-bvh-cache     delete the on-disk cache first, it otherwise keeps the most recently\n"
+        "                        used BVHs up to 2 GB in <temp>/MiniEngine/bvh_cache\n"
+        "  --instance-grid <n>   n x n instances of the whole model, sharing one BVH per mesh\n"
+        "  --progressive <n>     the editor viewport mode, saves the running average after n frames of 1 spp\n"
+        "  --no-denoise\n";
+
+    struct SceneCamera
+    {
+        bool valid = false;
+        glm::vec3 eye{0.f};
+        glm::vec3 lookat{0.f, 0.f, -1.f};
+        float fovy = 45.f;
+        glm::ivec2 resolution{0, 0};
+    };
+
+    struct Options
+    {
+        std::string scene;
+        std::string config;
+        std::string output;
+        bool hdr = false;
+        std::optional<int> width;
+        std::optional<int> height;
+        std::optional<int> spp;
+        std::optional<int> bounces;
+        std::optional<int> seed;
+        std::optional<float> adaptive_threshold;
+        bool adaptive = false;
+        bool sobol = false;
+        bool no_simd = false;
+        bool no_light_bvh = false;
+        bool no_mipmap = false;
+        bool no_bvh_cache = false;
+        bool clear_bvh_cache = false;
+        bool no_denoise = false;
+        int instance_grid = 1;
+        std::optional<int> progressive_frames;
+        int threads = 0;
+        bool benchmark = false;
+        std::string benchmark_output;
+    };
+
+    struct RenderStats
+    {
+        size_t triangles = 0;
+        int lights = 0;
+        float bvh_build_time = 0.f;
+        float trace_time = 0.f;
+        float render_time = 0.f;
+        long long rays = 0;
+        long long samples = 0;
+        double mean_luminance = 0.0;
+        double peak_memory_mb = 0.0; // of the whole process so far, never drops between renders
+    };
+
+    double getPeakMemoryMB()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+        return 0.0;
+#else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+        return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#endif
+    }
+
+    // value of attribute 'name' inside the first <tag .../> element of an xml text
+    std::optional<float> readXMLAttribute(const std::string &text, const std::string &tag, const std::string &name)
+    {
+        size_t begin = text.find("<" + tag);
+        if (begin == std::string::npos)
+            return std::nullopt;
+        size_t end = text.find('>', begin);
+
+        size_t attribute = text.find(" " + name + "=\"", begin);
+        if (attribute == std::string::npos || attribute > end)
+            return std::nullopt;
+
+        return std::stof(text.substr(attribute + name.size() + 3));
+    }
+
+    // the demo scenes keep their camera in an xml file next to the .obj
+    SceneCamera loadCameraXML(const std::filesystem::path &path)
+    {
+        SceneCamera camera;
+
+        std::ifstream file(path);
+        if (!file)
+            return camera;
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        const std::string text = buffer.str();
+
+        auto eye_x = readXMLAttribute(text, "eye", "x"), eye_y = readXMLAttribute(text, "eye", "y"), eye_z = readXMLAttribute(text, "eye", "z");
+        auto at_x = readXMLAttribute(text, "lookat", "x"), at_y = readXMLAttribute(text, "lookat", "y"), at_z = readXMLAttribute(text, "lookat", "z");
+        if (!eye_x || !eye_y || !eye_z || !at_x || !at_y || !at_z)
+            return camera;
+
+        camera.valid = true;
+        camera.eye = glm::vec3(*eye_x, *eye_y, *eye_z);
+        camera.lookat = glm::vec3(*at_x, *at_y, *at_z);
+        camera.fovy = readXMLAttribute(text, "camera", "fovy").value_or(camera.fovy);
+        camera.resolution.x = static_cast<int>(readXMLAttribute(text, "camera", "width").value_or(0.f));
+        camera.resolution.y = static_cast<int>(readXMLAttribute(text, "camera", "height").value_or(0.f));
+        return camera;
+    }
+
+    // the .obj of a scene and the .xml camera with its name, or else the first one of its folder
+    bool resolveScene(const std::string &scene, std::filesystem::path &obj_path, SceneCamera &camera)
+    {
+        namespace fs = std::filesystem;
+
+        if (!MiniEngine::Tools::resolveScene(scene, obj_path))
+            return false;
+
+        fs::path directory = obj_path.parent_path();
+        fs::path xml_path = fs::path(obj_path).replace_extension(".xml");
+        if (!fs::exists(xml_path) && fs::is_directory(directory))
+        {
+            for (const auto &entry : fs::directory_iterator(directory))
+            {
+                if (entry.path().extension() == ".xml")
+                {
+                    xml_path = entry.path();
+                    break;
+                }
+            }
+        }
+        camera = loadCameraXML(xml_path);
+        return true;
+    }
+
+    glm::vec3 readVec3(const json11::Json &value, const glm::vec3 &fallback)
+    {
+        if (!value.is_array() || value.array_items().size() != 3)
+            return fallback;
+        return glm::vec3(value[0].number_value(), value[1].number_value(), value[2].number_value());
+    }
+
+    bool loadConfig(const std::string &path, RenderingInitInfo &info, SceneCamera &camera)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Failed to open " << path << std::endl;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+
+        std::string error;
+        json11::Json config = json11::Json::parse(buffer.str(), error);
+        if (!error.empty() || !config.is_object())
+        {
+            std::cerr << "Failed to parse " << path << ": " << error << std::endl;
+            return false;
+        }
+
+        auto readInt = [&](const char *key, int &value)
+        {
+            if (config[key].is_number())
+                value = config[key].int_value();
+        };
+        auto readFloat = [&](const char *key, float &value)
+        {
+            if (config[key].is_number())
+                value = static_cast<float>(config[key].number_value());
+        };
+        auto readBool = [&](const char *key, bool &value)
+        {
+            if (config[key].is_bool())
+                value = config[key].bool_value();
+        };
+
+        if (config["Resolution"].is_array() && config["Resolution"].array_items().size() == 2)
+            info.Resolution = glm::ivec2(config["Resolution"][0].int_value(), config["Resolution"][1].int_value());
+        readInt("SampleCount", info.SampleCount);
+        readBool("Adaptive", info.Adaptive);
+        readInt("AdaptiveMinSamples", info.AdaptiveMinSamples);
+        readFloat("AdaptiveThreshold", info.AdaptiveThreshold);
+        readBool("SampleHeatmap", info.SampleHeatmap);
+        readBool("Progressive", info.Progressive);
+        readFloat("FrameBudget", info.FrameBudget);
+        info.FrameBudget = std::max(info.FrameBudget, 1.f); // ms, the editor's minimum
+        readInt("BounceLimit", info.BounceLimit);
+        readInt("RouletteDepth", info.RouletteDepth);
+        readBool("ImportSample", info.ImportSample);
+        readBool("LightBVH", info.LightBVH);
+        readInt("Seed", info.Seed);
+        readBool("LowDiscrepancy", info.LowDiscrepancy);
+        readBool("MipMapping", info.MipMapping);
+        readBool("BVH", info.BVH);
+        readBool("SAH", info.SAH);
+        readInt("LeafSize", info.LeafSize);
+        readFloat("TraversalCost", info.TraversalCost);
+        readBool("CacheBVH", info.CacheBVH);
+        readBool("SIMD", info.SIMD);
+        readBool("MultiThread", info.MultiThread);
+        readBool("Denoise", info.Denoise);
+        readBool("ToneMapping", info.ToneMapping);
+        readBool("OutputHDR", info.OutputHDR);
+
+        const json11::Json &camera_config = config["Camera"];
+        if (camera_config.is_object())
+        {
+            camera.valid = true;
+            camera.eye = readVec3(camera_config["Eye"], camera.eye);
+            camera.lookat = readVec3(camera_config["LookAt"], camera.lookat);
+            if (camera_config["Fovy"].is_number())
+                camera.fovy = static_cast<float>(camera_config["Fovy"].number_value());
+        }
+        return true;
+    }
+
+    // the path tracer reads position, yaw, pitch and fov from the editor camera
+    shared_ptr<MiniEngine::Camera> makeCamera(const SceneCamera &scene_camera, const Model &model)
+    {
+        glm::vec3 eye = scene_camera.eye;
+        glm::vec3 lookat = scene_camera.lookat;
+        if (!scene_camera.valid)
+        {
+            // no camera given, look down -z at the whole scene
+            glm::vec3 min_corner(std::numeric_limits<float>::max()), max_corner(-std::numeric_limits<float>::max());
+            for (const auto &mesh : model.meshes)
+            {
+                for (const auto &vertex : mesh.vertices)
+                {
+                    min_corner = glm::min(min_corner, vertex.Position);
+                    max_corner = glm::max(max_corner, vertex.Position);
+                }
+            }
+            lookat = 0.5f * (min_corner + max_corner);
+            float radius = 0.5f * glm::length(max_corner - min_corner);
+            eye = lookat + glm::vec3(0.f, 0.f, 1.1f * radius / tan(glm::radians(0.5f * scene_camera.fovy)) + radius);
+        }
+
+        glm::vec3 direction = glm::normalize(lookat - eye);
+        auto camera = make_shared<MiniEngine::Camera>(eye);
+        camera->Pitch = glm::degrees(asin(glm::clamp(direction.y, -1.f, 1.f)));
+        camera->Yaw = glm::degrees(atan2(direction.z, direction.x));
+        camera->Zoom = scene_camera.fovy;
+        camera->updateCameraVectors();
+        return camera;
+    }
+
+    // copies of the model side by side along x and away from the camera along -z
+    void placeInstanceGrid(PathTracer &tracer, const Model &model, int grid)
+    {
+        glm::vec3 min_corner(std::numeric_limits<float>::max()), max_corner(-std::numeric_limits<float>::max());
+        for (const auto &mesh : model.meshes)
+        {
+            for (const auto &vertex : mesh.vertices)
+            {
+                min_corner = glm::min(min_corner, vertex.Position);
+                max_corner = glm::max(max_corner, vertex.Position);
+            }
+        }
+        glm::vec3 spacing = 1.1f * (max_corner - min_corner);
+
+        tracer.instances.clear();
+        for (int z = 0; z < grid; z++)
+        {
+            for (int x = 0; x < grid; x++)
+            {
+                glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(x * spacing.x, 0.f, -z * spacing.z));
+                for (int mesh = 0; mesh < static_cast<int>(model.meshes.size()); mesh++)
+                {
+                    tracer.instances.push_back({mesh, transform});
+                }
+            }
+        }
+        std::cout << "Instances: " << grid * grid << " copies of " << model.meshes.size() << " meshes" << std::endl;
+    }
+
+    bool render(PathTracer &tracer, shared_ptr<Model> model, shared_ptr<MiniEngine::Camera> camera, RenderStats &stats)
+    {
+        tracer.initializeRenderer(false);
+        tracer.publishView(*camera);
+        tracer.publishSettings();
+        tracer.startTracing(model);
+        if (tracer.state != 4)
+        {
+            std::cerr << "Nothing rendered, the scene has no emissive material" << std::endl;
+            return false;
+        }
+
+        stats.triangles = 0;
+        for (const auto &mesh : model->meshes)
+        {
+            stats.triangles += mesh.indices.size() / 3;
+        }
+        stats.lights = tracer.getMainLightNumber();
+        stats.bvh_build_time = tracer.bvh_build_time;
+        stats.trace_time = tracer.trace_time;
+        stats.render_time = tracer.render_time;
+        stats.rays = tracer.ray_count;
+        stats.samples = tracer.sample_count;
+
+        double luminance = 0.0;
+        for (int j = 0; j < tracer.height; ++j)
+        {
+            for (int i = 0; i < tracer.width; ++i)
+            {
+                luminance += MiniEngine::PathTracing::luminance(tracer.film.getColor(i, j));
+            }
+        }
+        stats.mean_luminance = luminance / (double(tracer.width) * tracer.height);
+        stats.peak_memory_mb = getPeakMemoryMB();
+        return true;
+    }
+
+    void printStats(const RenderStats &stats)
+    {
+        float trace_time = std::max(stats.trace_time, 1e-6f);
+        std::cout << "  triangles      " << stats.triangles << ", " << stats.lights << " light triangles\n"
+                  << "  bvh build      " << stats.bvh_build_time << " s\n"
+                  << "  tracing        " << stats.trace_time << " s (" << stats.render_time << " s in total)\n"
+                  << "  rays/s         " << stats.rays / trace_time / 1e6 << " M (" << stats.rays << " rays)\n"
+                  << "  samples/s      " << stats.samples / trace_time / 1e6 << " M (" << stats.samples << " samples)\n"
+                  << "  mean luminance " << stats.mean_luminance << "\n"
+                  << "  process peak   " << stats.peak_memory_mb << " MB" << std::endl;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        MiniEngine::Tools::ArgumentReader args(argc, argv);
+        std::string arg;
+        while (args.next(arg))
+        {
+            bool read = true;
+            if (arg == "--help" || arg == "-h")
+                return false;
+            else if (arg == "--scene")
+                read = args.read(options.scene);
+            else if (arg == "--config")
+                read = args.read(options.config);
+            else if (arg == "--output")
+                read = args.read(options.output);
+            else if (arg == "--hdr")
+                options.hdr = true;
+            else if (arg == "--width")
+                read = args.read(options.width);
+            else if (arg == "--height")
+                read = args.read(options.height);
+            else if (arg == "--spp")
+                read = args.read(options.spp);
+            else if (arg == "--bounces")
+                read = args.read(options.bounces);
+            else if (arg == "--seed")
+                read = args.read(options.seed);
+            else if (arg == "--threads")
+                read = args.read(options.threads);
+            else if (arg == "--adaptive")
+            {
+                options.adaptive = true;
+                args.readOptional(options.adaptive_threshold);
+            }
+            else if (arg == "--sobol")
+                options.sobol = true;
+            else if (arg == "--no-simd")
+                options.no_simd = true;
+            else if (arg == "--no-light-bvh")
+                options.no_light_bvh = true;
+            else if (arg == "--no-mipmap")
+                options.no_mipmap = true;
+            else if (arg == "--no-bvh-cache")
+                options.no_bvh_cache = true;
+            else if (arg == "--clear-bvh-cache")
+                options.clear_bvh_cache = true;
+            else if (arg == "--no-denoise")
+                options.no_denoise = true;
+            else if (arg == "--instance-grid")
+                read = args.read(options.instance_grid);
+            else if (arg == "--progressive")
+                read = args.read(options.progressive_frames);
+            else if (arg == "--benchmark")
+            {
+                options.benchmark = true;
+                args.readOptional(options.benchmark_output);
+            }
+            else
+                return args.unknown();
+
+            if (!read)
+                return false;
+        }
+        return options.benchmark || options.clear_bvh_cache || !options.scene.empty();
+    }
+
+    int runSingle(const Options &options)
+    {
+        PathTracer tracer;
+        RenderingInitInfo &info = *tracer.init_info;
+
+        std::filesystem::path obj_path;
+        SceneCamera scene_camera;
+        if (!resolveScene(options.scene, obj_path, scene_camera))
+            return 1;
+        if (scene_camera.resolution.x > 0 && scene_camera.resolution.y > 0)
+            info.Resolution = scene_camera.resolution;
+        if (!options.config.empty() && !loadConfig(options.config, info, scene_camera))
+            return 1;
+
+        if (options.width)
+            info.Resolution.x = *options.width;
+        if (options.height)
+            info.Resolution.y = *options.height;
+        if (options.spp)
+            info.SampleCount = *options.spp;
+        if (options.bounces)
+            info.BounceLimit = *options.bounces;
+        if (options.seed)
+            info.Seed = *options.seed;
+        if (options.adaptive)
+            info.Adaptive = true;
+        if (options.adaptive_threshold)
+            info.AdaptiveThreshold = *options.adaptive_threshold;
+        if (options.sobol)
+            info.LowDiscrepancy = true;
+        if (options.no_simd)
+            info.SIMD = false;
+        if (options.no_light_bvh)
+            info.LightBVH = false;
+        if (options.no_mipmap)
+            info.MipMapping = false;
+        if (options.no_bvh_cache)
+            info.CacheBVH = false;
+        if (options.no_denoise)
+            info.Denoise = false;
+        if (options.hdr)
+            info.OutputHDR = true;
+        if (options.progressive_frames)
+        {
+            info.Progressive = true;
+            info.SampleCount = *options.progressive_frames;
+        }
+
+        info.Output = !options.output.empty();
+        if (options.output.size() >= sizeof(info.SavePath))
+        {
+            std::cerr << "Output path is longer than " << sizeof(info.SavePath) - 1 << " characters" << std::endl;
+            return 1;
+        }
+        strncpy(info.SavePath, options.output.c_str(), sizeof(info.SavePath));
+
+        if (info.Resolution.x < 2 || info.Resolution.y < 2 || info.SampleCount < 1)
+        {
+            std::cerr << "Invalid resolution or sample count" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Loading " << obj_path.generic_string() << std::endl;
+        auto model = make_shared<Model>(obj_path.generic_string(), false);
+        auto camera = makeCamera(scene_camera, *model);
+        if (options.instance_grid > 1)
+            placeInstanceGrid(tracer, *model, options.instance_grid);
+
+        // a progressive render idles once it converged, waiting for the camera to move
+        if (info.Progressive)
+        {
+            tracer.preview_callback = [&](int sample_count)
+            {
+                if (sample_count >= info.SampleCount)
+                    tracer.should_stop_tracing = true;
+            };
+        }
+
+        std::cout << "Rendering " << info.Resolution.x << "x" << info.Resolution.y << " at " << info.SampleCount << " spp"
+                  << (info.Progressive ? ", progressive" : "") << std::endl;
+        RenderStats stats;
+        if (!render(tracer, model, camera, stats))
+            return 1;
+        printStats(stats);
+        if (info.Progressive)
+            std::cout << "  frames         " << tracer.frame_count << " of at most " << info.FrameBudget << " ms" << std::endl;
+
+        if (info.Output)
+            std::cout << "Saved " << info.SavePath << std::endl;
+        return 0;
+    }
+
+    // fixed scenes and settings, change them only together with the stored baselines
+    int runBenchmark(const Options &options)
+    {
+        struct BenchmarkConfig
+        {
+            const char *name;
+            bool simd;
+            bool sobol;
+            bool adaptive;
+        };
+        const char *const scenes[] = {"veach-mis", "staircase"};
+        const BenchmarkConfig configs[] = {
+            {"linear_bvh", false, false, false},
+            {"bvh4", true, false, false},
+            {"bvh4_sobol", true, true, false},
+            {"bvh4_adaptive", true, false, true},
+        };
+        const glm::ivec2 resolution(320, 180);
+        const int sample_count = 16;
+        const int seed = 1;
+
+        json11::Json::array runs;
+        for (const char *scene : scenes)
+        {
+            std::filesystem::path obj_path;
+            SceneCamera scene_camera;
+            if (!resolveScene(scene, obj_path, scene_camera))
+                return 1;
+
+            auto model = make_shared<Model>(obj_path.generic_string(), false);
+            auto camera = makeCamera(scene_camera, *model);
+
+            for (const BenchmarkConfig &config : configs)
+            {
+                PathTracer tracer;
+                RenderingInitInfo &info = *tracer.init_info;
+                info.Resolution = resolution;
+                info.SampleCount = sample_count;
+                info.Seed = seed;
+                info.SIMD = config.simd;
+                info.LowDiscrepancy = config.sobol;
+                info.Adaptive = config.adaptive;
+                info.AdaptiveMinSamples = 4;
+                info.Denoise = false;
+                info.CacheBVH = false; // the build time is part of the benchmark
+
+                std::cout << scene << " / " << config.name << std::endl;
+                RenderStats stats;
+                if (!render(tracer, model, camera, stats))
+                    return 1;
+                printStats(stats);
+
+                float trace_time = std::max(stats.trace_time, 1e-6f);
+                runs.push_back(json11::Json::object{
+                    {"scene", scene},
+                    {"config", config.name},
+                    {"triangles", static_cast<double>(stats.triangles)},
+                    {"bvh_build_time", stats.bvh_build_time},
+                    {"trace_time", stats.trace_time},
+                    {"render_time", stats.render_time},
+                    {"rays", static_cast<double>(stats.rays)},
+                    {"samples", static_cast<double>(stats.samples)},
+                    {"rays_per_second", stats.rays / trace_time},
+                    {"samples_per_second", stats.samples / trace_time},
+                    {"mean_luminance", stats.mean_luminance},
+                    {"statistics", tracer.getStatistics().toJson()},
+                });
+            }
+        }
+
+        json11::Json result = json11::Json::object{
+            {"resolution", json11::Json::array{resolution.x, resolution.y}},
+            {"sample_count", sample_count},
+            {"seed", seed},
+            {"threads", static_cast<int>(tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism))},
+            // reported once, the peak of one process covers every run before it
+            {"process_peak_memory_mb", getPeakMemoryMB()},
+            {"runs", runs},
+        };
+
+        if (options.benchmark_output.empty())
+        {
+            std::cout << result.dump() << std::endl;
+            return 0;
+        }
+
+        std::ofstream file(options.benchmark_output);
+        if (!file)
+        {
+            std::cerr << "Failed to open " << options.benchmark_output << " for writing" << std::endl;
+            return 1;
+        }
+        file << result.dump() << std::endl;
+        std::cout << "Saved " << options.benchmark_output << std::endl;
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cout << Usage;
+        return 1;
+    }
+
+    if (options.clear_bvh_cache)
+    {
+        MiniEngine::PathTracing::BVHCache cache;
+        int removed = cache.clear();
+        std::cout << "BVH cache: removed " << removed << " files from " << cache.getDirectory() << std::endl;
+        if (!options.benchmark && options.scene.empty())
+            return 0;
+    }
+
+    std::optional<tbb::global_control> thread_limit;
+    if (options.threads > 0)
+        thread_limit.emplace(tbb::global_control::max_allowed_parallelism, options.threads);
+
+    return options.benchmark ? runBenchmark(options) : runSingle(options);
+}
@@ -0,0 +1,611 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "runtime/function/render/rasterization/hierarchy_zbuffer.h"
+#include "runtime/function/render/render_model.h"
+#include "thirdparty/tbb/include/tbb/global_control.h"
+#include "tools/common/tool_common.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <json11.hpp>
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+// Headless front end of the software rasterizer: loads an .obj without a GL context, draws it
+// through the octree and the hierarchical z-buffer from a list of camera poses and writes the
+// color and depth of every pose. --compare checks the images against a folder written earlier
+// by --output, so changes to the rasterizer can be checked for correctness on any machine.
+
+using MiniEngine::Model;
+using MiniEngine::OctTree;
+using MiniEngine::SoftRasterizer;
+using MiniEngine::Tools::resolveScene;
+
+namespace
+{
+    const char *const Usage =
+        "usage: softrasterizer_cli --scene <demo name | file.obj> [options]\n"
+        "       softrasterizer_cli --compare <folder> [options]\n"
+        "\n"
+        "  --scene <name|path>   demo scene folder under engine/editor/demo, or an .obj file\n"
+        "  --poses <n|file.json> n poses orbiting the model, 8 by default, or a JSON file with a\n"
+        "                        \"Poses\" array of objects with \"Eye\", \"LookAt\" and \"Fovy\"\n"
+        "  --width <n> --height <n>\n"
+        "                        512x512 by default\n"
+        "  --frames <n>          frames drawn per pose, the timings are their average\n"
+        "  --threads <n>         worker threads, all cores by default\n"
+        "  --output <folder>     writes pose_<i>.png, pose_<i>_depth.png and pose_<i>_depth.pfm,\n"
+        "                        and render.json with the scene, the size and the poses\n"
+        "  --compare <folder>    draws what render.json of the folder describes and compares the\n"
+        "                        images with its pose_<i>.png, fails when one differs too much\n"
+        "  --threshold <n>       channel difference that makes a pixel differ, 16 by default\n"
+        "  --tolerance <f>       fraction of pixels allowed to differ, 0.001 by default\n"
+        "  --json <file>         also write the statistics as JSON\n"
+        "\n"
+        "References of the demo scenes are kept in engine/tools/softrasterizer_cli/golden, e.g.\n"
+        "  softrasterizer_cli --compare engine/tools/softrasterizer_cli/golden/mary\n";
+
+    const char *const Description = "render.json";
+
+    struct Pose
+    {
+        glm::vec3 eye{0.f};
+        glm::vec3 lookat{0.f, 0.f, -1.f};
+        float fovy = 45.f;
+    };
+
+    struct Options
+    {
+        std::string scene;
+        std::string poses;
+        std::optional<int> width;
+        std::optional<int> height;
+        int frames = 1;
+        int threads = 0;
+        std::string output;
+        std::string compare;
+        int threshold = 16;
+        double tolerance = 0.001;
+        std::string json_output;
+    };
+
+    struct PoseResult
+    {
+        SoftRasterizer::Statistics statistics; // of the last frame
+        float frame_time = 0.f;                // average over the frames, seconds
+        long long covered_pixels = 0;
+        double differing = -1.0; // fraction of pixels, when compared
+    };
+
+    glm::vec3 readVec3(const json11::Json &value, const glm::vec3 &fallback)
+    {
+        if (!value.is_array() || value.array_items().size() != 3)
+            return fallback;
+        return glm::vec3(value[0].number_value(), value[1].number_value(), value[2].number_value());
+    }
+
+    bool readJSON(const std::string &path, json11::Json &json)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Failed to open " << path << std::endl;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+
+        std::string error;
+        json = json11::Json::parse(buffer.str(), error);
+        if (!error.empty() || !json.is_object())
+        {
+            std::cerr << "Failed to parse " << path << ": " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<Pose> readPoses(const json11::Json &json)
+    {
+        std::vector<Pose> poses;
+        for (const json11::Json &item : json["Poses"].array_items())
+        {
+            Pose pose;
+            pose.eye = readVec3(item["Eye"], pose.eye);
+            pose.lookat = readVec3(item["LookAt"], pose.lookat);
+            if (item["Fovy"].is_number())
+                pose.fovy = static_cast<float>(item["Fovy"].number_value());
+            poses.push_back(pose);
+        }
+        return poses;
+    }
+
+    void modelBounds(const Model &model, glm::vec3 &min_corner, glm::vec3 &max_corner)
+    {
+        min_corner = glm::vec3(std::numeric_limits<float>::max());
+        max_corner = glm::vec3(-std::numeric_limits<float>::max());
+        for (const auto &mesh : model.meshes)
+        {
+            for (const auto &vertex : mesh.vertices)
+            {
+                min_corner = glm::min(min_corner, vertex.Position);
+                max_corner = glm::max(max_corner, vertex.Position);
+            }
+        }
+    }
+
+    // evenly around the y axis and slightly from above, the first one looks down -z
+    std::vector<Pose> orbitPoses(const Model &model, int count)
+    {
+        glm::vec3 min_corner, max_corner;
+        modelBounds(model, min_corner, max_corner);
+        glm::vec3 center = 0.5f * (min_corner + max_corner);
+        float radius = 0.5f * glm::length(max_corner - min_corner);
+
+        std::vector<Pose> poses(count);
+        for (int i = 0; i < count; i++)
+        {
+            Pose &pose = poses[i];
+            float distance = 1.1f * radius / tan(glm::radians(0.5f * pose.fovy));
+            float azimuth = glm::radians(90.f) + 2.f * glm::pi<float>() * i / count;
+            float elevation = glm::radians(15.f);
+            pose.lookat = center;
+            pose.eye = center + distance * glm::vec3(cos(elevation) * cos(azimuth), sin(elevation), cos(elevation) * sin(azimuth));
+        }
+        return poses;
+    }
+
+    // the first diffuse map of the model, or a checker board when it has none
+    void pickTexture(const Model &model, std::vector<unsigned char> &texture, int &width, int &height)
+    {
+        for (const auto &mesh : model.meshes)
+        {
+            const auto &map = mesh.material.diffuse_map;
+            if (map && map->data && map->width > 0 && map->height > 0)
+            {
+                width = map->width;
+                height = map->height;
+                texture.assign(map->data, map->data + 3 * width * height);
+                std::cout << "Texture " << mesh.material.map_Kd << ", " << width << "x" << height << std::endl;
+                return;
+            }
+        }
+
+        width = height = 64;
+        texture.resize(3 * width * height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char value = ((x >> 3) ^ (y >> 3)) & 1 ? 224 : 96;
+                std::fill_n(&texture[3 * (y * width + x)], 3, value);
+            }
+        }
+        std::cout << "Texture: none in the model, a checker board" << std::endl;
+    }
+
+    // frame rows go from bottom to top, image files from top to bottom
+    std::vector<unsigned char> flipRows(const std::vector<unsigned char> &pixels, int width, int height, int channels)
+    {
+        std::vector<unsigned char> flipped(pixels.size());
+        const int stride = width * channels;
+        for (int y = 0; y < height; y++)
+        {
+            std::copy_n(&pixels[(height - 1 - y) * stride], stride, &flipped[y * stride]);
+        }
+        return flipped;
+    }
+
+    bool writeDepth(const SoftRasterizer &rasterizer, int width, int height, const std::string &stem)
+    {
+        std::vector<float> depth(width * height);
+        float nearest = 1.f, farthest = 0.f;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                float z = rasterizer.depth(x, y);
+                depth[y * width + x] = z;
+                if (z < 1.f)
+                {
+                    nearest = std::min(nearest, z);
+                    farthest = std::max(farthest, z);
+                }
+            }
+        }
+
+        // a negative scale marks little endian data, scanlines go from bottom to top like the frame rows
+        std::string pfm_path = stem + "_depth.pfm";
+        FILE *file = fopen(pfm_path.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Failed to open " << pfm_path << " for writing" << std::endl;
+            return false;
+        }
+        fprintf(file, "Pf\n%d %d\n-1.0\n", width, height);
+        bool ok = fwrite(depth.data(), sizeof(float), depth.size(), file) == depth.size();
+        fclose(file);
+        if (!ok)
+        {
+            std::cerr << "Failed to write " << pfm_path << std::endl;
+            return false;
+        }
+
+        // the covered depth range stretched over the gray levels, near is bright, the background black
+        std::vector<unsigned char> gray(width * height, 0);
+        float range = std::max(farthest - nearest, 1e-6f);
+        for (int i = 0; i < width * height; i++)
+        {
+            if (depth[i] < 1.f)
+                gray[i] = static_cast<unsigned char>(255.f - 223.f * (depth[i] - nearest) / range);
+        }
+        std::string png_path = stem + "_depth.png";
+        gray = flipRows(gray, width, height, 1);
+        if (!stbi_write_png(png_path.c_str(), width, height, 1, gray.data(), 0))
+        {
+            std::cerr << "Failed to write " << png_path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // fraction of pixels with a channel further than threshold from the reference, -1 on errors
+    double compareImage(const std::vector<unsigned char> &image, int width, int height, const std::string &path, int threshold)
+    {
+        int reference_width = 0, reference_height = 0, channels = 0;
+        stbi_set_flip_vertically_on_load(false);
+        unsigned char *reference = stbi_load(path.c_str(), &reference_width, &reference_height, &channels, 3);
+        if (!reference)
+        {
+            std::cerr << "Failed to load " << path << std::endl;
+            return -1.0;
+        }
+        if (reference_width != width || reference_height != height)
+        {
+            std::cerr << path << " is " << reference_width << "x" << reference_height << ", the render " << width << "x" << height << std::endl;
+            stbi_image_free(reference);
+            return -1.0;
+        }
+
+        long long differing = 0;
+        for (int i = 0; i < width * height; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                if (std::abs(int(image[3 * i + c]) - int(reference[3 * i + c])) > threshold)
+                {
+                    differing++;
+                    break;
+                }
+            }
+        }
+        stbi_image_free(reference);
+        return double(differing) / (double(width) * height);
+    }
+
+    void printStatistics(const PoseResult &result)
+    {
+        const SoftRasterizer::Statistics &s = result.statistics;
+        auto rate = [](long long part, long long whole)
+        { return whole > 0 ? 100.0 * part / whole : 0.0; };
+        float frame_time = std::max(result.frame_time, 1e-6f);
+
+        std::cout << "  frame          " << result.frame_time * 1000.f << " ms\n"
+                  << "  triangles/s    " << s.triangles / frame_time / 1e6 << " M (" << s.triangles << " in visible leaves, "
+                  << s.triangles_culled << " culled)\n"
+                  << "  pixels shaded  " << s.pixels_shaded << " of " << s.depth_tests << " depth tests\n"
+                  << "  overdraw       " << (result.covered_pixels > 0 ? double(s.pixels_shaded) / result.covered_pixels : 0.0)
+                  << " (" << result.covered_pixels << " pixels covered)\n"
+                  << "  hi-z rejected  " << rate(s.nodes_rejected, s.nodes_tested) << "% of " << s.nodes_tested << " nodes, "
+                  << rate(s.tiles_rejected, s.tile_tests) << "% of " << s.tile_tests << " triangle tiles, "
+                  << rate(s.blocks_rejected, s.block_tests) << "% of " << s.block_tests << " blocks" << std::endl;
+    }
+
+    json11::Json toJson(const PoseResult &result)
+    {
+        const SoftRasterizer::Statistics &s = result.statistics;
+        json11::Json::object object{
+            {"frame_time", result.frame_time},
+            {"triangles", static_cast<double>(s.triangles)},
+            {"triangles_culled", static_cast<double>(s.triangles_culled)},
+            {"triangles_per_second", s.triangles / std::max(result.frame_time, 1e-6f)},
+            {"nodes_tested", static_cast<double>(s.nodes_tested)},
+            {"nodes_rejected", static_cast<double>(s.nodes_rejected)},
+            {"tile_tests", static_cast<double>(s.tile_tests)},
+            {"tiles_rejected", static_cast<double>(s.tiles_rejected)},
+            {"block_tests", static_cast<double>(s.block_tests)},
+            {"blocks_rejected", static_cast<double>(s.blocks_rejected)},
+            {"depth_tests", static_cast<double>(s.depth_tests)},
+            {"pixels_shaded", static_cast<double>(s.pixels_shaded)},
+            {"covered_pixels", static_cast<double>(result.covered_pixels)},
+        };
+        if (result.differing >= 0.0)
+            object["differing_pixels"] = result.differing;
+        return object;
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        MiniEngine::Tools::ArgumentReader args(argc, argv);
+        std::string arg;
+        while (args.next(arg))
+        {
+            bool read = true;
+            if (arg == "--help" || arg == "-h")
+                return false;
+            else if (arg == "--scene")
+                read = args.read(options.scene);
+            else if (arg == "--poses")
+                read = args.read(options.poses);
+            else if (arg == "--width")
+                read = args.read(options.width);
+            else if (arg == "--height")
+                read = args.read(options.height);
+            else if (arg == "--frames")
+                read = args.read(options.frames);
+            else if (arg == "--threads")
+                read = args.read(options.threads);
+            else if (arg == "--output")
+                read = args.read(options.output);
+            else if (arg == "--compare")
+                read = args.read(options.compare);
+            else if (arg == "--threshold")
+                read = args.read(options.threshold);
+            else if (arg == "--tolerance")
+                read = args.read(options.tolerance);
+            else if (arg == "--json")
+                read = args.read(options.json_output);
+            else
+                return args.unknown();
+
+            if (!read)
+                return false;
+        }
+        return !options.scene.empty() || !options.compare.empty();
+    }
+
+    int run(const Options &options)
+    {
+        namespace fs = std::filesystem;
+
+        // a compared folder brings its scene, size and poses, the command line still wins
+        std::string scene = options.scene;
+        int width = 512, height = 512;
+        std::vector<Pose> poses;
+        if (!options.compare.empty())
+        {
+            json11::Json description;
+            if (!readJSON((fs::path(options.compare) / Description).generic_string(), description))
+                return 1;
+            if (scene.empty())
+                scene = description["Scene"].string_value();
+            width = description["Width"].int_value();
+            height = description["Height"].int_value();
+            poses = readPoses(description);
+        }
+        if (options.width)
+            width = *options.width;
+        if (options.height)
+            height = *options.height;
+
+        if (width < 1 || height < 1 || options.frames < 1)
+        {
+            std::cerr << "Invalid resolution or frame count" << std::endl;
+            return 1;
+        }
+
+        fs::path obj_path;
+        if (!resolveScene(scene, obj_path))
+            return 1;
+
+        std::cout << "Loading " << obj_path.generic_string() << std::endl;
+        Model model(obj_path.generic_string(), false);
+
+        if (!options.poses.empty())
+        {
+            if (options.poses.find_first_not_of("0123456789") == std::string::npos)
+            {
+                poses = orbitPoses(model, std::atoi(options.poses.c_str()));
+            }
+            else
+            {
+                json11::Json description;
+                if (!readJSON(options.poses, description))
+                    return 1;
+                poses = readPoses(description);
+            }
+        }
+        else if (poses.empty())
+        {
+            poses = orbitPoses(model, 8);
+        }
+        if (poses.empty())
+        {
+            std::cerr << "No camera poses" << std::endl;
+            return 1;
+        }
+
+        OctTree tree;
+        tree.build_oct_tree(model);
+        if (tree.empty())
+        {
+            std::cerr << "The model has no triangles" << std::endl;
+            return 1;
+        }
+        std::cout << "Octree: " << tree.indices.size() / 3 << " triangles, " << tree.nodes.size() << " nodes, built in "
+                  << tree.build_time * 1000.f << " ms" << std::endl;
+
+        std::vector<unsigned char> texture;
+        int texture_width, texture_height;
+        pickTexture(model, texture, texture_width, texture_height);
+
+        if (!options.output.empty())
+        {
+            std::error_code error;
+            fs::create_directories(options.output, error);
+            if (error)
+            {
+                std::cerr << "Failed to create " << options.output << ": " << error.message() << std::endl;
+                return 1;
+            }
+        }
+
+        glm::vec3 min_corner, max_corner;
+        modelBounds(model, min_corner, max_corner);
+        glm::vec3 center = 0.5f * (min_corner + max_corner);
+        float radius = 0.5f * glm::length(max_corner - min_corner);
+
+        SoftRasterizer rasterizer;
+        rasterizer.hierarchy_zbuffer_initialize(width, height);
+        std::vector<unsigned char> pixels(3 * width * height);
+        glm::mat4 model_matrix(1.f);
+
+        std::vector<PoseResult> results(poses.size());
+        PoseResult total;
+        bool passed = true;
+        for (size_t p = 0; p < poses.size(); p++)
+        {
+            const Pose &pose = poses[p];
+            PoseResult &result = results[p];
+
+            // the depth range just around the model
+            float distance = glm::length(pose.eye - center);
+            float near_plane = std::max(distance - 1.5f * radius, 1e-3f * radius);
+            float far_plane = distance + 1.5f * radius;
+            glm::mat4 view = glm::lookAt(pose.eye, pose.lookat, glm::vec3(0.f, 1.f, 0.f));
+            glm::mat4 projection = glm::perspective(glm::radians(pose.fovy), float(width) / height, near_plane, far_plane);
+
+            for (int frame = 0; frame < options.frames; frame++)
+            {
+                std::fill(pixels.begin(), pixels.end(), 0);
+                rasterizer.hierarchy_zbuffer_rasterize(tree, model_matrix, view, projection, pixels.data(), texture.data(), texture_width, texture_height);
+                result.frame_time += rasterizer.statistics.frame_time / options.frames;
+            }
+            result.statistics = rasterizer.statistics;
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    result.covered_pixels += rasterizer.depth(x, y) < 1.f;
+                }
+            }
+
+            std::cout << "Pose " << p << ", eye (" << pose.eye.x << ", " << pose.eye.y << ", " << pose.eye.z << ")" << std::endl;
+            printStatistics(result);
+
+            std::ostringstream name;
+            name << "pose_" << std::setw(2) << std::setfill('0') << p;
+            std::vector<unsigned char> image = flipRows(pixels, width, height, 3);
+
+            if (!options.output.empty())
+            {
+                std::string stem = (fs::path(options.output) / name.str()).generic_string();
+                if (!stbi_write_png((stem + ".png").c_str(), width, height, 3, image.data(), 0) ||
+                    !writeDepth(rasterizer, width, height, stem))
+                {
+                    std::cerr << "Failed to write " << stem << std::endl;
+                    return 1;
+                }
+            }
+
+            if (!options.compare.empty())
+            {
+                std::string reference = (fs::path(options.compare) / (name.str() + ".png")).generic_string();
+                result.differing = compareImage(image, width, height, reference, options.threshold);
+                bool pose_passed = result.differing >= 0.0 && result.differing <= options.tolerance;
+                if (result.differing >= 0.0)
+                    std::cout << "  compared       " << (pose_passed ? "passed, " : "FAILED, ") << result.differing * 100.0
+                              << "% of the pixels differ, " << options.tolerance * 100.0 << "% allowed" << std::endl;
+                else
+                    std::cout << "  compared       FAILED, no usable reference" << std::endl;
+                passed = passed && pose_passed;
+            }
+
+            total.statistics += result.statistics;
+            total.frame_time += result.frame_time;
+            total.covered_pixels += result.covered_pixels;
+        }
+
+        std::cout << "All " << poses.size() << " poses at " << width << "x" << height << std::endl;
+        printStatistics(total);
+
+        if (!options.output.empty())
+        {
+            json11::Json::array pose_list;
+            for (const Pose &pose : poses)
+            {
+                pose_list.push_back(json11::Json::object{
+                    {"Eye", json11::Json::array{pose.eye.x, pose.eye.y, pose.eye.z}},
+                    {"LookAt", json11::Json::array{pose.lookat.x, pose.lookat.y, pose.lookat.z}},
+                    {"Fovy", pose.fovy},
+                });
+            }
+            json11::Json description = json11::Json::object{
+                {"Scene", scene},
+                {"Width", width},
+                {"Height", height},
+                {"Poses", pose_list},
+            };
+            std::ofstream file(fs::path(options.output) / Description);
+            file << description.dump() << std::endl;
+            std::cout << "Saved " << poses.size() << " poses to " << options.output << std::endl;
+        }
+
+        if (!options.json_output.empty())
+        {
+            json11::Json::array runs;
+            for (const PoseResult &result : results)
+            {
+                runs.push_back(toJson(result));
+            }
+            json11::Json statistics = json11::Json::object{
+                {"scene", scene},
+                {"width", width},
+                {"height", height},
+                {"frames", options.frames},
+                {"threads", static_cast<int>(tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism))},
+                {"octree_build_time", tree.build_time},
+                {"octree_nodes", static_cast<int>(tree.nodes.size())},
+                {"poses", runs},
+                {"total", toJson(total)},
+            };
+
+            std::ofstream file(options.json_output);
+            if (!file)
+            {
+                std::cerr << "Failed to open " << options.json_output << " for writing" << std::endl;
+                return 1;
+            }
+            file << statistics.dump() << std::endl;
+            std::cout << "Saved " << options.json_output << std::endl;
+        }
+
+        return passed ? 0 : 2;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::cout << Usage;
+        return 1;
+    }
+
+    std::optional<tbb::global_control> thread_limit;
+    if (options.threads > 0)
+        thread_limit.emplace(tbb::global_control::max_allowed_parallelism, options.threads);
+
+    return run(options);
+}